@@ -1,9 +1,15 @@
 #version 150
 
 in vec4 vertex;
-in vec3 normal;
+in vec2 normal; // octahedral-encoded
 in vec4 color;
 
+// Tube vertices of the 4D curves
+in vec4 hyperPoint;
+in vec4 hyperOther;
+in vec4 hyperJoint;
+in vec4 hyperRing;
+
 out vec3 vert;
 out vec3 vertNormal;
 out vec4 col;
@@ -13,12 +19,108 @@ uniform mat4 projMatrix;
 uniform mat4 mvMatrix;
 uniform mat3 normalMatrix;
 
+// 4D projection of the curve tubes, see Diffuse_shader::Hyper_array. The 5x5
+// map of the homogeneous 4D points is split into the upper 4x4 block, the last
+// column and the last row (the translation). The fifth coordinate of a point
+// is not homogeneous, it is weighted by 'hyperWRow' and 'hyperCorner.y'
+uniform bool hyperMode;
+uniform mat4 hyperMatrix;
+uniform vec4 hyperColumn;
+uniform vec4 hyperOffset;
+uniform vec4 hyperWRow;
+uniform vec2 hyperCorner;
+uniform float hyperThickness;
+// The 3D map of the unfolding applied after the projection, and the opacity of
+// the tubes
+uniform mat4 hyperPostMatrix;
+uniform float hyperOpacity;
+
+// Step along the curve used to project its direction
+const float jointStep = 0.001;
+
+vec3 decodeNormal(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0)
+    {
+        vec2 signNotZero = vec2(n.x >= 0.0 ? 1.0 : -1.0,
+                                n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signNotZero;
+    }
+    return normalize(n);
+}
+
+// The xyz-components are divided by the 4D perspective and moved by the post
+// matrix, the w-component is the depth the tube diameter is divided by
+vec4 projectHyper(vec4 p, float w)
+{
+    vec4 v = hyperMatrix * p + hyperOffset + w * hyperWRow;
+    float d = dot(hyperColumn, p) + hyperCorner.x + w * hyperCorner.y;
+    vec3 q = (hyperPostMatrix * vec4(v.xyz / d, 1.0)).xyz;
+    return vec4(q, v.w);
+}
+
+// The first two columns of the rotation aligning the Z-axis with the direction
+// of a tube, as in Mesh_emitter
+void tubeFrame(vec3 dir, out vec3 u, out vec3 v)
+{
+    float k = 1.0 + dir.z;
+    if(k < 1e-6)
+    {
+        u = vec3(-1.0, 0.0, 0.0);
+        v = vec3( 0.0, 1.0, 0.0);
+        return;
+    }
+    u = vec3(1.0 - dir.x * dir.x / k, -dir.x * dir.y / k, -dir.x);
+    v = vec3(-dir.x * dir.y / k, 1.0 - dir.y * dir.y / k, -dir.y);
+}
+
+// The vertex of a tube ring around the projected segment. As in
+// Mesh_emitter::cylinder_v2, the ring is cut by the plane bisecting the joint
+// with the neighbouring segment
+void hyperVertex(out vec4 position, out vec3 n)
+{
+    float w = hyperRing.w;
+    vec4 p = projectHyper(hyperPoint, w);
+    vec4 o = projectHyper(hyperOther, w);
+    vec3 joint = normalize(
+        projectHyper(hyperPoint + jointStep * hyperJoint, w).xyz - p.xyz);
+
+    vec3 dir = normalize(hyperRing.z > 0.5 ? p.xyz - o.xyz : o.xyz - p.xyz);
+    // avoid very sharp angles
+    if(dot(joint, dir) < 0.1)
+        joint = dir;
+
+    vec3 u, v;
+    tubeFrame(dir, u, v);
+    n = u * hyperRing.x + v * hyperRing.y;
+
+    vec3 s = p.xyz + 0.5 * hyperThickness / p.w * n;
+    vec3 e = o.xyz + 0.5 * hyperThickness / o.w * n;
+    vec3 ray = e - s;
+    position = vec4(s - ray * dot(joint, s - p.xyz) / dot(joint, ray), 1.0);
+}
+
 void main()
 {
-    vert = vertex.xyz;
-    vertNormal = normalMatrix * normal;
+    vec4 position;
+    vec3 n;
+    if(hyperMode)
+    {
+        hyperVertex(position, n);
+    }
+    else
+    {
+        position = vertex;
+        n = decodeNormal(normal);
+    }
+
+    vert = position.xyz;
+    vertNormal = normalMatrix * n;
     col = color;
-    viewSpace = mvMatrix * vec4(vertex);
+    if(hyperMode)
+        col.a *= hyperOpacity;
+    viewSpace = mvMatrix * position;
 
-    gl_Position = projMatrix * mvMatrix * vertex;
+    gl_Position = projMatrix * mvMatrix * position;
 }
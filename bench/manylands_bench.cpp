@@ -0,0 +1,944 @@
+//******************************************************************************
+// manylands_bench
+//
+// Offline benchmarks of the data and geometry pipeline. No OpenGL context is
+// required.
+//
+// The first part loads an ODE model, emits the curve tubes and a timeplayer
+// marker and reports the number of bytes that would be uploaded to the GPU,
+// both for the compact indexed vertex format and for the legacy format (44
+// bytes per vertex, vertices duplicated per face). The tessellation is fixed:
+// 5 sides per tube and a 5x5 marker sphere. Scene_renderer picks the
+// tessellation per view (see Scene_renderer::tessellation_level), so the
+// sizes are those of a typical view rather than of a particular frame. The
+// diameters do not change the sizes.
+//
+// The second part runs the pipeline stages on synthetic 4D trajectories of
+// 1e3 to 1e8 samples: loading, simplification, statistics, interpolation, the
+// 4D projection, tube meshes, line extrusion, pictograms, the audio callback,
+// the oscillator bank, the voice pool, the effects graph and the offline audio
+// render. The trajectories are generated deterministically, so the results can
+// be compared between releases. Everything is printed as JSON.
+//
+// Finally the audio callback runs on a null backend for a moment, its timing
+// histogram is printed as 'audio_callback'.
+//
+// Usage: manylands_bench [model file] [iterations] [max samples] [case]
+//
+// 'max samples' defaults to 1e6, larger trajectories need several GB of memory.
+// If 'case' is given, only the cases whose name contains it are run.
+//******************************************************************************
+
+// Local
+#include "src/Audio.h"
+#include "src/AudioBackend.h"
+#include "src/AudioGraph.h"
+#include "src/AudioRenderer.h"
+#include "src/Consts.h"
+#include "src/Matrix_lib.h"
+#include "src/Mesh_emitter.h"
+#include "src/Mesh_generator.h"
+#include "src/OscillatorBank.h"
+#include "src/Profiler.h"
+#include "src/Scene.h"
+#include "src/Scene_renderer.h"
+#include "src/Scene_state.h"
+#include "src/Screen_shader.h"
+#include "src/SonificationMapping.h"
+#include "src/Tesseract.h"
+#include "src/Timeline_renderer.h"
+#include "src/Transport.h"
+#include "src/VoicePool.h"
+// boost
+#include <boost/numeric/ublas/assignment.hpp>
+#include <boost/numeric/ublas/matrix.hpp>
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// vec4 position + vec3 normal + vec4 color
+const size_t Legacy_vertex_size = 44;
+const unsigned int Tube_verts = 5;
+const unsigned int Sphere_segments = 5, Sphere_rings = 5;
+
+struct Frame_size
+{
+    size_t vertices = 0, indices = 0, bytes = 0;
+};
+
+//******************************************************************************
+// legacy_size
+//
+// Size of a mesh after the per-face triangulation of the former
+// Diffuse_shader::append_to_geometry
+//******************************************************************************
+
+void legacy_size(const Mesh& m, Frame_size& out)
+{
+    for(const auto& obj : m.objects)
+    {
+        for(const auto& f : obj.faces)
+        {
+            out.vertices += f.size();
+            out.indices += 3 * (f.size() - 2);
+        }
+    }
+}
+
+//******************************************************************************
+// curve_point
+//******************************************************************************
+
+glm::vec3 curve_point(const Curve& c, size_t i)
+{
+    const auto& p = c.vertices()[i];
+    return glm::vec3(p(0), p(1), p(2));
+}
+
+//******************************************************************************
+// tube_directions
+//******************************************************************************
+
+std::vector<glm::vec3> tube_directions(const Curve& c)
+{
+    const size_t n = c.vertices().size();
+    std::vector<glm::vec3> dirs(n);
+    dirs.front() = glm::normalize(curve_point(c, 1) - curve_point(c, 0));
+    for(size_t i = 1; i < n - 1; ++i)
+    {
+        dirs[i] = glm::normalize(
+            glm::normalize(curve_point(c, i) - curve_point(c, i - 1)) +
+            glm::normalize(curve_point(c, i + 1) - curve_point(c, i)));
+    }
+    dirs.back() = glm::normalize(curve_point(c, n - 1) - curve_point(c, n - 2));
+    return dirs;
+}
+
+//******************************************************************************
+// emit_compact
+//******************************************************************************
+
+Frame_size emit_compact(const Scene_state& state, Diffuse_shader::Mesh_geometry& geom)
+{
+    geom.data_array.clear();
+    geom.indices.clear();
+
+    Mesh_emitter emitter(geom);
+    const glm::vec4 color(1.f);
+
+    for(const auto& c : state.curves)
+    {
+        emitter.reserve(
+            c->edges().size() * Mesh_emitter::cylinder_vertices(Tube_verts),
+            c->edges().size() * Mesh_emitter::cylinder_indices(Tube_verts));
+
+        const auto dirs = tube_directions(*c);
+        for(const auto& e : c->edges())
+        {
+            emitter.cylinder_v2(
+                Tube_verts,
+                1.f,
+                1.f,
+                curve_point(*c, e.vert1),
+                curve_point(*c, e.vert2),
+                dirs[e.vert1],
+                dirs[e.vert2],
+                color);
+        }
+        emitter.sphere(
+            Sphere_segments, Sphere_rings, 8.f, curve_point(*c, 0), color);
+    }
+
+    Frame_size size;
+    size.vertices = geom.data_array.size();
+    size.indices = geom.indices.size();
+    size.bytes = size.vertices * sizeof(Diffuse_shader::Data_array) +
+                 size.indices * sizeof(GLuint);
+    return size;
+}
+
+//******************************************************************************
+// emit_legacy
+//******************************************************************************
+
+Frame_size emit_legacy(const Scene_state& state)
+{
+    Frame_size size;
+    const glm::vec4 color(1.f);
+
+    for(const auto& c : state.curves)
+    {
+        Mesh mesh;
+        const auto dirs = tube_directions(*c);
+        for(const auto& e : c->edges())
+        {
+            Mesh_generator::cylinder_v2(
+                Tube_verts,
+                1.f,
+                1.f,
+                curve_point(*c, e.vert1),
+                curve_point(*c, e.vert2),
+                dirs[e.vert1],
+                dirs[e.vert2],
+                color,
+                mesh);
+        }
+        Mesh_generator::sphere(
+            Sphere_segments, Sphere_rings, 8.f, curve_point(*c, 0), color, mesh);
+        legacy_size(mesh, size);
+    }
+
+    size.bytes = size.vertices * Legacy_vertex_size +
+                 size.indices * sizeof(GLuint);
+    return size;
+}
+
+//******************************************************************************
+// Synthetic trajectories
+//******************************************************************************
+
+const double Trajectory_duration = 100.;
+const float Trajectory_amplitude = 100.f;
+const float Trajectory_noise = 0.25f;
+
+//******************************************************************************
+// Random
+//
+// splitmix64, the sequence is the same on every platform and compiler
+//******************************************************************************
+
+class Random
+{
+public:
+    explicit Random(std::uint64_t seed) : state_(seed) {}
+
+    std::uint64_t next()
+    {
+        std::uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [-1, 1)
+    float uniform()
+    {
+        return static_cast<float>(next() >> 40) / (1 << 23) - 1.f;
+    }
+
+private:
+    std::uint64_t state_;
+};
+
+//******************************************************************************
+// trajectory_point
+//
+// A 4D trajectory that moves through 4D, 3D and 2D regions, so it has
+// dimensionality switches like the ODE models. 'samples' only changes the
+// sampling density, the shape is the same for all sizes
+//******************************************************************************
+
+void trajectory_point(double t, Random& rnd, float out[4])
+{
+    const double fade_z = std::max(0., std::sin(0.05 * t));
+    const double fade_w = std::max(0., std::cos(0.031 * t));
+
+    out[0] = static_cast<float>(std::sin(0.9 * t) * std::cos(0.13 * t));
+    out[1] = static_cast<float>(std::sin(1.3 * t + 0.5));
+    out[2] = static_cast<float>(std::sin(0.7 * t + 1.1) * fade_z);
+    out[3] = static_cast<float>(std::cos(1.1 * t) * fade_w);
+
+    for(int i = 0; i < 4; ++i)
+    {
+        out[i] = Trajectory_amplitude * out[i] +
+                 Trajectory_noise * rnd.uniform();
+    }
+}
+
+//******************************************************************************
+// make_trajectory
+//******************************************************************************
+
+Curve make_trajectory(size_t samples)
+{
+    Curve c;
+    c.get_vertices().reserve(samples);
+    Random rnd(samples);
+
+    for(size_t i = 0; i < samples; ++i)
+    {
+        const double t = Trajectory_duration * i / (samples - 1);
+        float p[4];
+        trajectory_point(t, rnd, p);
+
+        Scene_vertex_t v(5);
+        v <<= p[0], p[1], p[2], p[3], 1.f;
+        c.add_point(v, static_cast<float>(t));
+    }
+    return c;
+}
+
+//******************************************************************************
+// write_trajectory
+//
+// Writes the trajectory in the format of the ODE model files
+//******************************************************************************
+
+bool write_trajectory(const std::string& fname, size_t samples)
+{
+    FILE* f = std::fopen(fname.c_str(), "w");
+    if(!f)
+        return false;
+
+    Random rnd(samples);
+    for(size_t i = 0; i < samples; ++i)
+    {
+        const double t = Trajectory_duration * i / (samples - 1);
+        float p[4];
+        trajectory_point(t, rnd, p);
+        std::fprintf(
+            f, "%.9g %.9g %.9g %.9g %.9g\n", t, p[0], p[1], p[2], p[3]);
+    }
+    return std::fclose(f) == 0;
+}
+
+//******************************************************************************
+// Measurements
+//******************************************************************************
+
+// Every case is repeated until it ran for this time or this many times
+const double Min_case_ms = 200.;
+const size_t Max_case_iterations = 100;
+
+const size_t Max_file_samples = 10000000;
+const size_t Point_queries = 100000;
+const float Min_curve_radius = 0.8f;
+
+struct Result
+{
+    std::string name;
+    size_t samples = 0, items = 0, iterations = 0;
+    double min_ms = 0., median_ms = 0.;
+    double allocations = 0.;
+};
+
+//******************************************************************************
+// measure
+//
+// 'setup' prepares an iteration and is not timed. 'run' returns the number of
+// processed items, e.g. points or vertices
+//******************************************************************************
+
+template<class Setup, class Run>
+Result measure(const char* name, size_t samples, Setup setup, Run run)
+{
+    Result r;
+    r.name = name;
+    r.samples = samples;
+
+    std::vector<double> times;
+    double total_ms = 0.;
+    std::uint64_t allocations = 0;
+    while(times.empty() ||
+          (total_ms < Min_case_ms && times.size() < Max_case_iterations))
+    {
+        setup();
+
+        const auto allocs_start = Profiler::allocation_count();
+        const auto start = std::chrono::steady_clock::now();
+        r.items = run();
+        const std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        allocations += Profiler::allocation_count() - allocs_start;
+
+        times.push_back(elapsed.count());
+        total_ms += elapsed.count();
+    }
+
+    std::sort(times.begin(), times.end());
+    r.iterations = times.size();
+    r.min_ms = times.front();
+    r.median_ms = times[times.size() / 2];
+    r.allocations = static_cast<double>(allocations) / times.size();
+    return r;
+}
+
+//******************************************************************************
+// init_tick_data
+//
+// Eight overtones with a sounding gate
+//******************************************************************************
+
+void init_tick_data(TickData& data)
+{
+    const float steps[] = {0.f, 12.f, 19.f, 24.f, 28.f, 31.f, 34.f, 36.f};
+    data.initSines(8);
+    for(size_t i = 0; i < 8; ++i)
+    {
+        data.overtoneSteps.push_back(steps[i]);
+        data.overToneLoudness.push_back(1.f / (i + 1));
+    }
+    data.setGate(true);
+}
+
+//******************************************************************************
+// measure_audio_callback
+//
+// Timing of the audio callback on a null backend that requests the buffers
+// without waiting
+//******************************************************************************
+
+CallbackStats::Snapshot measure_audio_callback()
+{
+    TickData data;
+    init_tick_data(data);
+
+    NullAudioBackend backend(false);
+    backend.open(static_cast<unsigned int>(stk::Stk::sampleRate()),
+                 stk::RT_BUFFER_SIZE,
+                 1,
+                 &tick,
+                 &data);
+    std::this_thread::sleep_for(
+        std::chrono::duration<double, std::milli>(Min_case_ms));
+    backend.close();
+
+    return backend.getStats().getSnapshot();
+}
+
+//******************************************************************************
+// run_cases
+//******************************************************************************
+
+void run_cases(size_t samples,
+               const std::string& filter,
+               std::vector<Result>& results)
+{
+    auto is_selected = [&filter](const char* name) {
+        return filter.empty() ||
+               std::string(name).find(filter) != std::string::npos;
+    };
+    auto nothing = []() {};
+
+    Curve raw = make_trajectory(samples);
+
+    if(is_selected("load_curve") && samples <= Max_file_samples)
+    {
+        const std::string fname =
+            "manylands_bench_" + std::to_string(samples) + ".txt";
+        if(write_trajectory(fname, samples))
+        {
+            auto state = std::make_shared<Scene_state>();
+            Scene scene(state);
+            results.push_back(measure("load_curve", samples, nothing, [&]() {
+                return scene.load_curve(fname)->vertices().size();
+            }));
+        }
+        std::remove(fname.c_str());
+    }
+
+    if(is_selected("get_simpified_curve"))
+    {
+        results.push_back(
+            measure("get_simpified_curve", samples, nothing, [&]() {
+                raw.get_simpified_curve(Min_curve_radius);
+                return raw.vertices().size();
+            }));
+    }
+
+    // The scene keeps the simplified curve, the stages below work on it as
+    // Scene::load_ode does
+    auto state = std::make_shared<Scene_state>();
+    auto curve =
+        std::make_shared<Curve>(raw.get_simpified_curve(Min_curve_radius));
+
+    if(is_selected("update_stats"))
+    {
+        results.push_back(measure("update_stats", samples, nothing, [&]() {
+            curve->update_stats(state->stat_kernel_size,
+                                state->stat_max_movement,
+                                state->stat_max_value);
+            return curve->vertices().size();
+        }));
+    }
+    curve->update_stats(state->stat_kernel_size,
+                        state->stat_max_movement,
+                        state->stat_max_value);
+
+    if(is_selected("get_point"))
+    {
+        Random rnd(Point_queries);
+        std::vector<float> times(Point_queries);
+        for(auto& t : times)
+        {
+            t = static_cast<float>(
+                0.5 * Trajectory_duration * (rnd.uniform() + 1.f));
+        }
+
+        volatile float sink = 0.f;
+        results.push_back(measure("get_point", samples, nothing, [&]() {
+            float sum = 0.f;
+            for(float t : times)
+                sum += raw.get_point(t)(0);
+            sink = sum;
+            return times.size();
+        }));
+    }
+
+    state->curves.push_back(curve);
+    Scene_vertex_t origin(4), size(4);
+    for(char i = 0; i < 4; ++i)
+    {
+        origin(i) = -0.5f * state->tesseract_size[i];
+        size(i) = state->tesseract_size[i];
+    }
+    state->tesseract = std::make_shared<Tesseract>(
+        origin,
+        size,
+        state->get_color(X_axis),
+        state->get_color(Y_axis),
+        state->get_color(Z_axis),
+        state->get_color(W_axis));
+    state->camera_4D <<= 0., 0., 0., 550., 0.;
+    const float fov_4d = 30.f * static_cast<float>(DEG_TO_RAD);
+    state->projection_4D = Matrix_lib_f::get4DProjectionMatrix(
+        fov_4d, fov_4d, fov_4d, 1.f, 10.f);
+
+    if(is_selected("project_to_3D"))
+    {
+        Scene_renderer renderer(state);
+        const boost::numeric::ublas::matrix<float> rot_mat =
+            boost::numeric::ublas::identity_matrix<float>(5);
+        std::vector<Scene_vertex_t> verts;
+
+        results.push_back(measure(
+            "project_to_3D",
+            samples,
+            [&]() { verts = raw.vertices(); },
+            [&]() {
+                renderer.project_to_3D(verts, rot_mat);
+                return verts.size();
+            }));
+    }
+
+    if(is_selected("mesh_generator"))
+    {
+        results.push_back(measure("mesh_generator", samples, nothing, [&]() {
+            return emit_legacy(*state).vertices;
+        }));
+    }
+
+    if(is_selected("mesh_emitter"))
+    {
+        Diffuse_shader::Mesh_geometry geom;
+        results.push_back(measure("mesh_emitter", samples, nothing, [&]() {
+            return emit_compact(*state, geom).vertices;
+        }));
+    }
+
+    if(is_selected("append_to_geometry"))
+    {
+        Diffuse_shader diffuse;
+        Diffuse_shader::Mesh_geometry geom;
+        Mesh mesh;
+        const auto dirs = tube_directions(*curve);
+        for(const auto& e : curve->edges())
+        {
+            Mesh_generator::cylinder_v2(
+                Tube_verts,
+                1.f,
+                1.f,
+                curve_point(*curve, e.vert1),
+                curve_point(*curve, e.vert2),
+                dirs[e.vert1],
+                dirs[e.vert2],
+                glm::vec4(1.f),
+                mesh);
+        }
+
+        results.push_back(measure(
+            "append_to_geometry",
+            samples,
+            [&]() {
+                geom.data_array.clear();
+                geom.indices.clear();
+            },
+            [&]() {
+                diffuse.append_to_geometry(geom, mesh);
+                return geom.data_array.size();
+            }));
+    }
+
+    if(is_selected("line_extrusion"))
+    {
+        // The timeline plot of the first dimension without decimation
+        Screen_shader screen;
+        Screen_shader::Screen_geometry geom;
+        Screen_shader::Line_strip strip;
+        strip.reserve(samples);
+        for(size_t i = 0; i < samples; ++i)
+        {
+            strip.emplace_back(Screen_shader::Line_point(
+                glm::vec2(raw.time_stamp()[i], raw.vertices()[i](0)),
+                1.f,
+                glm::vec4(1.f)));
+        }
+
+        results.push_back(measure(
+            "line_extrusion",
+            samples,
+            [&]() {
+                geom.data_array.clear();
+                geom.indices.clear();
+            },
+            [&]() {
+                screen.append_to_geometry(geom, strip);
+                return geom.data_array.size();
+            }));
+    }
+
+    if(is_selected("pictograms"))
+    {
+        // A new renderer per iteration, so the triangulations are not cached
+        auto screen = std::make_shared<Screen_shader>();
+        std::unique_ptr<Timeline_renderer> timeline;
+
+        results.push_back(measure(
+            "pictograms",
+            samples,
+            [&]() {
+                timeline = std::make_unique<Timeline_renderer>(state);
+                timeline->set_shader(screen);
+                timeline->set_pictogram_size(50.f);
+                timeline->set_redering_region(
+                    Base_renderer::Region(0.f, 0.f, 1920.f, 200.f), 1.f, 1.f);
+            },
+            [&]() { return timeline->build_pictograms(); }));
+    }
+
+    if(is_selected("audio_tick"))
+    {
+        // 'samples' mono samples in buffers of the RtAudio size
+        TickData data;
+        init_tick_data(data);
+        std::vector<stk::StkFloat> buffer(stk::RT_BUFFER_SIZE);
+
+        results.push_back(measure("audio_tick", samples, nothing, [&]() {
+            size_t rendered = 0;
+            for(; rendered < samples; rendered += stk::RT_BUFFER_SIZE)
+            {
+                tick(buffer.data(),
+                     nullptr,
+                     stk::RT_BUFFER_SIZE,
+                     0.,
+                     0,
+                     &data);
+            }
+            return rendered;
+        }));
+    }
+
+    if(is_selected("oscillator_bank"))
+    {
+        // 64 gliding partials, the work per sample of a dense spectrum
+        const int num_partials = 64;
+        OscillatorBank bank;
+        bank.resize(num_partials);
+        std::vector<stk::StkFloat> buffer(stk::RT_BUFFER_SIZE);
+        bool is_up = false;
+
+        results.push_back(measure("oscillator_bank", samples, nothing, [&]() {
+            size_t rendered = 0;
+            for(; rendered < samples; rendered += stk::RT_BUFFER_SIZE)
+            {
+                is_up = !is_up;
+                for(int k = 0; k < num_partials; ++k)
+                {
+                    bank.setFrequency(k, (is_up ? 110. : 100.) * (k + 1));
+                    bank.setAmplitude(k, 1. / (k + 1));
+                }
+                bank.render(buffer.data(), stk::RT_BUFFER_SIZE);
+            }
+            return rendered;
+        }));
+    }
+
+    {
+        // Every feature on a parameter, compiled for the trajectory and
+        // evaluated at 'samples' positions like the blocks of a voice
+        std::istringstream stream(
+            "speed pitch\n"
+            "acceleration brightness shape 0.5 out 0.3 1\n"
+            "curvature loudness log out 0.6 1\n"
+            "x pan out -0.5 0.5\n"
+            "y partial1\n"
+            "z partial2\n"
+            "w partial3 shape 2\n"
+            "dimensionality partial0 in 1 4\n");
+        MappingSpec spec;
+        std::string error;
+        parseMappingSpec(stream, spec, error);
+
+        if(is_selected("compile_mapping"))
+        {
+            results.push_back(
+                measure("compile_mapping", samples, nothing, [&]() {
+                    return compileMapping(*curve, spec) ? samples : 0;
+                }));
+        }
+
+        if(is_selected("evaluate_mapping"))
+        {
+            const auto control = compileMapping(*curve, spec);
+            float parameters[ControlCurve::NO_OF_PARAMETERS];
+            float sum = 0.f;
+            results.push_back(
+                measure("evaluate_mapping", samples, nothing, [&]() {
+                    for(size_t i = 0; i < samples; ++i)
+                    {
+                        control->evaluate(
+                            static_cast<double>(i) / samples, parameters);
+                        sum += parameters[ControlCurve::PITCH];
+                    }
+                    return sum > 0.f ? samples : 0;
+                }));
+        }
+    }
+
+    for(const bool has_effects : {false, true})
+    {
+        // 32 voices on the speed of the trajectory played by a transport like
+        // in the app, 'samples' stereo frames. The graph adds reverb and
+        // chorus sends
+        const char* name = has_effects ? "audio_graph" : "voice_pool";
+        if(!is_selected(name))
+            continue;
+
+        const int num_voices = 32;
+        TickData instrument;
+        init_tick_data(instrument);
+        VoicePool pool;
+        pool.init(num_voices, instrument);
+        pool.setGate(true);
+        Transport transport;
+        transport.setSpeed(0.1);
+        transport.play();
+        const auto control = compileMapping(
+            *curve, defaultMappingSpec(Scene_state::SonificationData::SPEED));
+        for(int i = 0; i < num_voices; ++i)
+        {
+            bool is_new;
+            const int voice = pool.acquire(&control + i, is_new);
+            pool.getVoice(voice).setControlCurve(control);
+            pool.setMix(voice, 1.f / num_voices, i % 2 ? 0.5f : -0.5f);
+        }
+        AudioGraph graph;
+        graph.setTransport(&transport);
+        const int voices =
+            graph.addNode(std::make_unique<VoicesNode>(&pool, &transport));
+        const int master = graph.addNode(std::make_unique<MixNode>());
+        graph.connect(voices, master);
+        if(has_effects)
+        {
+            const int reverb = graph.addNode(std::make_unique<ReverbNode>());
+            const int chorus = graph.addNode(std::make_unique<ChorusNode>());
+            graph.connect(voices, reverb, 0.2f);
+            graph.connect(reverb, master);
+            graph.connect(voices, chorus, 0.2f);
+            graph.connect(chorus, master);
+        }
+        graph.compile(master, stk::RT_BUFFER_SIZE);
+        std::vector<stk::StkFloat> buffer(
+            AudioGraph::NO_OF_CHANNELS * stk::RT_BUFFER_SIZE);
+
+        results.push_back(measure(name, samples, nothing, [&]() {
+            size_t rendered = 0;
+            for(; rendered < samples; rendered += stk::RT_BUFFER_SIZE)
+            {
+                tickGraph(buffer.data(),
+                          nullptr,
+                          stk::RT_BUFFER_SIZE,
+                          0.,
+                          0,
+                          &graph);
+            }
+            return rendered;
+        }));
+    }
+
+    if(is_selected("audio_render"))
+    {
+        // 10 s of the speed of the trajectory, rendered offline
+        const double duration = 10.;
+        TickData instrument;
+        instrument.initSines(4);
+        instrument.overtoneSteps = {0.f, 3.f, 7.f, 12.f};
+        instrument.overToneLoudness = {0.2f, 0.2f, 0.2f, 0.2f};
+        AudioRenderer renderer;
+        std::vector<stk::StkFloat> buffer;
+
+        results.push_back(measure("audio_render", samples, nothing, [&]() {
+            renderer.render(
+                instrument,
+                *curve,
+                defaultMappingSpec(Scene_state::SonificationData::SPEED),
+                duration,
+                buffer);
+            return buffer.size();
+        }));
+    }
+}
+
+//******************************************************************************
+// json_escape
+//
+// Escapes a string to be printed inside the quotes of a JSON string, e.g. a
+// Windows path of the model
+//******************************************************************************
+
+std::string json_escape(const std::string& text)
+{
+    std::string escaped;
+    for(const char c : text)
+    {
+        if(c == '\\' || c == '"')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if(static_cast<unsigned char>(c) < 0x20)
+        {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+} // namespace
+
+//******************************************************************************
+// main
+//******************************************************************************
+
+int main(int argc, char** argv)
+{
+    const std::string model =
+        argc > 1 ? argv[1] : "assets/model1-default.txt";
+    const int iterations = argc > 2 ? std::stoi(argv[2]) : 100;
+    const size_t max_samples =
+        argc > 3 ? static_cast<size_t>(std::stod(argv[3])) : 1000000;
+    const std::string filter = argc > 4 ? argv[4] : "";
+
+    Profiler::instance().set_enabled(false);
+
+    auto state = std::make_shared<Scene_state>();
+    Scene scene(state);
+    scene.load_ode({model}, 0.8f);
+    if(state->curves.empty())
+    {
+        std::fprintf(stderr, "Cannot load '%s'\n", model.c_str());
+        return 1;
+    }
+
+    Diffuse_shader::Mesh_geometry geom;
+    Frame_size compact;
+    const auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; ++i)
+        compact = emit_compact(*state, geom);
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    const Frame_size legacy = emit_legacy(*state);
+
+    std::vector<Result> results;
+    for(size_t samples = 1000; samples <= max_samples; samples *= 10)
+        run_cases(samples, filter, results);
+
+    const bool has_callback_stats =
+        std::string("audio_callback").find(filter) != std::string::npos;
+    CallbackStats::Snapshot callback_stats{};
+    if(has_callback_stats)
+        callback_stats = measure_audio_callback();
+
+    std::printf(
+        "{\n"
+        "  \"model\": \"%s\",\n"
+        "  \"curve_points\": %zu,\n"
+        "  \"legacy\": {\"vertices\": %zu, \"indices\": %zu, \"bytes\": %zu},\n"
+        "  \"compact\": {\"vertices\": %zu, \"indices\": %zu, \"bytes\": %zu},\n"
+        "  \"reduction\": %.2f,\n"
+        "  \"emit_ms\": %.3f,\n"
+        "  \"cases\": [",
+        json_escape(model).c_str(),
+        state->curves.front()->vertices().size(),
+        legacy.vertices, legacy.indices, legacy.bytes,
+        compact.vertices, compact.indices, compact.bytes,
+        static_cast<double>(legacy.bytes) / compact.bytes,
+        elapsed.count() / iterations);
+
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        std::printf(
+            "%s\n    {\"name\": \"%s\", \"samples\": %zu, \"items\": %zu, "
+            "\"iterations\": %zu, \"min_ms\": %.4f, \"median_ms\": %.4f, "
+            "\"ns_per_item\": %.2f",
+            i > 0 ? "," : "",
+            json_escape(r.name).c_str(),
+            r.samples,
+            r.items,
+            r.iterations,
+            r.min_ms,
+            r.median_ms,
+            r.items > 0 ? 1e6 * r.median_ms / r.items : 0.);
+        // Only counted with the MANYLANDS_COUNT_ALLOCATIONS option
+        if(Profiler::counts_allocations())
+            std::printf(", \"allocations\": %.1f", r.allocations);
+        std::printf("}");
+    }
+    std::printf("\n  ]");
+
+    if(has_callback_stats)
+    {
+        std::printf(
+            ",\n  \"audio_callback\": {\"backend\": \"null\", "
+            "\"callbacks\": %llu, \"xruns\": %llu, \"budget_us\": %.1f, "
+            "\"mean_us\": %.2f, \"max_us\": %.2f, \"mean_load\": %.5f, "
+            "\"max_load\": %.5f, \"histogram_us\": [",
+            static_cast<unsigned long long>(callback_stats.callbacks),
+            static_cast<unsigned long long>(callback_stats.xruns),
+            callback_stats.budgetMicros,
+            callback_stats.meanMicros,
+            callback_stats.maxMicros,
+            callback_stats.meanLoad,
+            callback_stats.maxLoad);
+        for(int i = 0; i < CallbackStats::NO_OF_BUCKETS; ++i)
+        {
+            std::printf(
+                "%s%llu",
+                i > 0 ? ", " : "",
+                static_cast<unsigned long long>(callback_stats.buckets[i]));
+        }
+        std::printf("]}");
+    }
+    std::printf("\n}\n");
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "Frame_writer.h"
+// Local
+#include "Png_writer.h"
+// std
+#include <algorithm>
+
+//******************************************************************************
+// Frame_writer
+//******************************************************************************
+
+Frame_writer::Frame_writer(unsigned int num_threads, size_t max_pending)
+    : max_pending_(std::max<size_t>(max_pending, 1))
+    , busy_workers_(0)
+    , failed_(0)
+    , stop_(false)
+{
+    for(unsigned int i = 0; i < std::max(num_threads, 1u); ++i)
+        workers_.emplace_back(&Frame_writer::worker_loop, this);
+}
+
+//******************************************************************************
+// ~Frame_writer
+//******************************************************************************
+
+Frame_writer::~Frame_writer()
+{
+    finish();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    job_cv_.notify_all();
+
+    for(auto& w : workers_)
+        w.join();
+}
+
+//******************************************************************************
+// write
+//******************************************************************************
+
+void Frame_writer::write(
+    const std::string& fname,
+    std::vector<unsigned char> rgba,
+    int width,
+    int height)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_cv_.wait(lock, [this] { return jobs_.size() < max_pending_; });
+
+    jobs_.push_back({fname, std::move(rgba), width, height});
+    lock.unlock();
+
+    job_cv_.notify_one();
+}
+
+//******************************************************************************
+// finish
+//******************************************************************************
+
+size_t Frame_writer::finish()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] {
+        return jobs_.empty() && busy_workers_ == 0;
+    });
+
+    return failed_;
+}
+
+//******************************************************************************
+// worker_loop
+//******************************************************************************
+
+void Frame_writer::worker_loop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(;;)
+    {
+        job_cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+        if(jobs_.empty())
+            return;
+
+        Job job = std::move(jobs_.front());
+        jobs_.pop_front();
+        ++busy_workers_;
+        lock.unlock();
+        space_cv_.notify_one();
+
+        const bool is_written = Png_writer::write(
+            job.fname, job.rgba, job.width, job.height, true);
+
+        lock.lock();
+        if(!is_written)
+            ++failed_;
+        --busy_workers_;
+        if(jobs_.empty() && busy_workers_ == 0)
+            done_cv_.notify_all();
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+// std
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//******************************************************************************
+// Frame_writer
+//
+// Encodes and writes PNG frames on background threads, so the renderer can go
+// on with the next frame. The queue is bounded: 'write' blocks while too many
+// frames are pending, which keeps the memory use constant on long sweeps.
+//******************************************************************************
+
+class Frame_writer
+{
+public:
+    Frame_writer(unsigned int num_threads, size_t max_pending);
+    ~Frame_writer();
+
+    Frame_writer(const Frame_writer&) = delete;
+    Frame_writer& operator=(const Frame_writer&) = delete;
+
+    // 'rgba' is bottom-up, as returned by glReadPixels
+    void write(
+        const std::string& fname,
+        std::vector<unsigned char> rgba,
+        int width,
+        int height);
+
+    // Waits until all queued frames are written and returns the number of
+    // frames that could not be written
+    size_t finish();
+
+private:
+    struct Job
+    {
+        std::string fname;
+        std::vector<unsigned char> rgba;
+        int width, height;
+    };
+
+    void worker_loop();
+
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable job_cv_, space_cv_, done_cv_;
+    std::deque<Job> jobs_;
+    size_t max_pending_;
+    size_t busy_workers_;
+    size_t failed_;
+    bool stop_;
+};
@@ -0,0 +1,327 @@
+#include "Png_writer.h"
+// std
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+
+namespace
+{
+
+//******************************************************************************
+// Bit_writer
+//
+// Writes bits starting with the least significant one, as deflate requires
+//******************************************************************************
+
+class Bit_writer
+{
+public:
+    explicit Bit_writer(std::vector<unsigned char>& out)
+        : out_(out)
+        , bits_(0)
+        , num_bits_(0)
+    {
+    }
+
+    void put(std::uint32_t value, int count)
+    {
+        bits_ |= static_cast<std::uint64_t>(value) << num_bits_;
+        num_bits_ += count;
+        while(num_bits_ >= 8)
+        {
+            out_.push_back(static_cast<unsigned char>(bits_ & 0xff));
+            bits_ >>= 8;
+            num_bits_ -= 8;
+        }
+    }
+
+    // Huffman codes are stored starting with the most significant bit
+    void put_code(std::uint32_t code, int count)
+    {
+        std::uint32_t reversed = 0;
+        for(int i = 0; i < count; ++i)
+            reversed |= ((code >> i) & 1) << (count - 1 - i);
+        put(reversed, count);
+    }
+
+    void flush()
+    {
+        if(num_bits_ > 0)
+            out_.push_back(static_cast<unsigned char>(bits_ & 0xff));
+        bits_ = 0;
+        num_bits_ = 0;
+    }
+
+private:
+    std::vector<unsigned char>& out_;
+    std::uint64_t bits_;
+    int num_bits_;
+};
+
+const int Length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const int Length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const int Distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+    16385, 24577};
+const int Distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+const size_t Window_size = 32768;
+const size_t Min_match = 3, Max_match = 258;
+const int Hash_bits = 15;
+
+//******************************************************************************
+// put_literal
+//
+// Fixed Huffman code of a literal/length symbol
+//******************************************************************************
+
+void put_literal(Bit_writer& bits, int symbol)
+{
+    if(symbol < 144)
+        bits.put_code(0x30 + symbol, 8);
+    else if(symbol < 256)
+        bits.put_code(0x190 + symbol - 144, 9);
+    else if(symbol < 280)
+        bits.put_code(symbol - 256, 7);
+    else
+        bits.put_code(0xc0 + symbol - 280, 8);
+}
+
+//******************************************************************************
+// put_match
+//******************************************************************************
+
+void put_match(Bit_writer& bits, size_t length, size_t distance)
+{
+    int l = 28;
+    while(Length_base[l] > static_cast<int>(length))
+        --l;
+    put_literal(bits, 257 + l);
+    bits.put(static_cast<std::uint32_t>(length - Length_base[l]),
+             Length_extra[l]);
+
+    int d = 29;
+    while(Distance_base[d] > static_cast<int>(distance))
+        --d;
+    bits.put_code(d, 5);
+    bits.put(static_cast<std::uint32_t>(distance - Distance_base[d]),
+             Distance_extra[d]);
+}
+
+//******************************************************************************
+// deflate
+//
+// Compresses the data as one block with the fixed Huffman codes
+//******************************************************************************
+
+void deflate(const std::vector<unsigned char>& data,
+             std::vector<unsigned char>& out)
+{
+    Bit_writer bits(out);
+    bits.put(1, 1); // Last block
+    bits.put(1, 2); // Fixed Huffman codes
+
+    std::vector<std::int64_t> head(size_t(1) << Hash_bits, -1);
+    auto hash = [&data](size_t i) {
+        const std::uint32_t v = data[i] | data[i + 1] << 8 | data[i + 2] << 16;
+        return (v * 2654435761u) >> (32 - Hash_bits);
+    };
+
+    const size_t size = data.size();
+    size_t i = 0;
+    while(i < size)
+    {
+        size_t length = 0, distance = 0;
+        if(i + Min_match <= size)
+        {
+            const std::uint32_t h = hash(i);
+            const std::int64_t candidate = head[h];
+            head[h] = static_cast<std::int64_t>(i);
+
+            if(candidate >= 0 && i - candidate <= Window_size)
+            {
+                const size_t max_length = std::min(Max_match, size - i);
+                while(length < max_length &&
+                      data[candidate + length] == data[i + length])
+                {
+                    ++length;
+                }
+                distance = i - static_cast<size_t>(candidate);
+            }
+        }
+
+        if(length >= Min_match)
+        {
+            put_match(bits, length, distance);
+
+            // Index the positions inside the match sparsely to keep the
+            // encoder fast on long runs
+            for(size_t j = i + 1; j < i + length && j + Min_match <= size;
+                j += 8)
+            {
+                head[hash(j)] = static_cast<std::int64_t>(j);
+            }
+            i += length;
+        }
+        else
+        {
+            put_literal(bits, data[i]);
+            ++i;
+        }
+    }
+
+    put_literal(bits, 256); // End of block
+    bits.flush();
+}
+
+//******************************************************************************
+// crc32
+//******************************************************************************
+
+std::uint32_t crc32(const unsigned char* data, size_t size, std::uint32_t crc)
+{
+    static const auto table = []() {
+        std::array<std::uint32_t, 256> t;
+        for(std::uint32_t n = 0; n < 256; ++n)
+        {
+            std::uint32_t c = n;
+            for(int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for(size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+//******************************************************************************
+// adler32
+//******************************************************************************
+
+std::uint32_t adler32(const std::vector<unsigned char>& data)
+{
+    std::uint32_t a = 1, b = 0;
+    for(auto c : data)
+    {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    return b << 16 | a;
+}
+
+//******************************************************************************
+// put_u32
+//******************************************************************************
+
+void put_u32(std::vector<unsigned char>& out, std::uint32_t v)
+{
+    out.push_back(static_cast<unsigned char>(v >> 24));
+    out.push_back(static_cast<unsigned char>(v >> 16));
+    out.push_back(static_cast<unsigned char>(v >> 8));
+    out.push_back(static_cast<unsigned char>(v));
+}
+
+//******************************************************************************
+// put_chunk
+//******************************************************************************
+
+void put_chunk(std::vector<unsigned char>& out,
+               const char* type,
+               const std::vector<unsigned char>& data)
+{
+    put_u32(out, static_cast<std::uint32_t>(data.size()));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_u32(out, crc32(&out[start], out.size() - start, 0));
+}
+
+} // namespace
+
+//******************************************************************************
+// encode
+//******************************************************************************
+
+std::vector<unsigned char> Png_writer::encode(
+    const std::vector<unsigned char>& rgba,
+    int width,
+    int height,
+    bool flip_y)
+{
+    const size_t stride = static_cast<size_t>(width) * 4;
+
+    // Every row starts with the filter type. The 'Up' filter is used for all
+    // rows but the first one, it turns repeated rows into zeros
+    std::vector<unsigned char> filtered;
+    filtered.reserve((stride + 1) * height);
+    const unsigned char* prev = nullptr;
+    for(int y = 0; y < height; ++y)
+    {
+        const int src_y = flip_y ? height - 1 - y : y;
+        const unsigned char* row = &rgba[src_y * stride];
+
+        filtered.push_back(prev ? 2 : 0);
+        for(size_t x = 0; x < stride; ++x)
+        {
+            filtered.push_back(
+                static_cast<unsigned char>(row[x] - (prev ? prev[x] : 0)));
+        }
+        prev = row;
+    }
+
+    // zlib stream
+    std::vector<unsigned char> compressed = {0x78, 0x01};
+    deflate(filtered, compressed);
+    put_u32(compressed, adler32(filtered));
+
+    std::vector<unsigned char> png = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+    std::vector<unsigned char> header;
+    put_u32(header, static_cast<std::uint32_t>(width));
+    put_u32(header, static_cast<std::uint32_t>(height));
+    header.push_back(8); // Bit depth
+    header.push_back(6); // RGBA
+    header.push_back(0); // Deflate
+    header.push_back(0); // Adaptive filtering
+    header.push_back(0); // No interlace
+
+    put_chunk(png, "IHDR", header);
+    put_chunk(png, "IDAT", compressed);
+    put_chunk(png, "IEND", {});
+
+    return png;
+}
+
+//******************************************************************************
+// write
+//******************************************************************************
+
+bool Png_writer::write(
+    const std::string& fname,
+    const std::vector<unsigned char>& rgba,
+    int width,
+    int height,
+    bool flip_y)
+{
+    const auto png = encode(rgba, width, height, flip_y);
+
+    std::ofstream file(fname, std::ios::binary);
+    if(!file.is_open())
+        return false;
+
+    file.write(reinterpret_cast<const char*>(png.data()), png.size());
+    return file.good();
+}
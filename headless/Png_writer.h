@@ -0,0 +1,32 @@
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+
+//******************************************************************************
+// Png_writer
+//
+// A small PNG encoder without external dependencies. The image data is
+// compressed with the fixed Huffman codes of deflate and a single-candidate
+// LZ77 match search, which is fast and works well for the large uniform areas
+// of the rendered frames.
+//******************************************************************************
+
+namespace Png_writer
+{
+    // Encodes an RGBA image. If 'flip_y' is set, the first row of 'rgba' is
+    // the bottom row of the image, as returned by glReadPixels
+    std::vector<unsigned char> encode(
+        const std::vector<unsigned char>& rgba,
+        int width,
+        int height,
+        bool flip_y);
+
+    bool write(
+        const std::string& fname,
+        const std::vector<unsigned char>& rgba,
+        int width,
+        int height,
+        bool flip_y);
+}
@@ -0,0 +1,740 @@
+//******************************************************************************
+// manylands_render
+//
+// Renders the scene and the timeline without a display. An OpenGL ES 3
+// context is created with EGL on the surfaceless platform (Mesa), the frames
+// are drawn into a multisampled framebuffer object, read back through pixel
+// buffer objects and written as PNG files by background threads.
+//
+// The frames are described by a script, one command per line:
+//
+//   size 1280 720               Size of the frames in pixels
+//   samples 4                   Multisampling
+//   timeline 200                Height of the timeline, 0 hides it
+//   theme bright                Colors: bright or dark
+//   projection gpu              4D projection of the curves: gpu or cpu
+//   load a.txt [b.txt ...]      Loads the ODE models
+//   output frames/%05d.png      Pattern of the file names, one %d of the index
+//   show legend 0               tesseract, curve, legend, timepoint, dali
+//   set xw 30                   Sets a parameter
+//   sweep unfolding 0 1 120     Renders frames changing a parameter linearly
+//   frame [count]               Renders frames of the current state
+//
+// Parameters: unfolding, time (both in [0, 1]), xy, yz, zx, xw, yw, zw (4D
+// rotations in degrees), x, y, z (3D rotations in degrees), distance (3D
+// camera), fov (degrees). Lines starting with '#' are comments.
+//
+// Usage: manylands_render <script>
+//******************************************************************************
+
+// Local
+#include "Frame_writer.h"
+#include "src/Consts.h"
+#include "src/Diffuse_shader.h"
+#include "src/Matrix_lib.h"
+#include "src/Scene.h"
+#include "src/Scene_renderer.h"
+#include "src/Scene_state.h"
+#include "src/Screen_shader.h"
+#include "src/Text_renderer.h"
+#include "src/Timeline_renderer.h"
+// EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+// ImGui
+#include "imgui.h"
+#include "src/imgui_impl_opengl3.h"
+// glm
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/euler_angles.hpp>
+// boost
+#include <boost/numeric/ublas/assignment.hpp>
+// std
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const float Separator_thickness = 4.f;
+
+//******************************************************************************
+// Egl_context
+//******************************************************************************
+
+class Egl_context
+{
+public:
+    Egl_context()
+        : display_(EGL_NO_DISPLAY)
+        , context_(EGL_NO_CONTEXT)
+    {
+    }
+
+    ~Egl_context()
+    {
+        if(display_ == EGL_NO_DISPLAY)
+            return;
+
+        eglMakeCurrent(
+            display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if(context_ != EGL_NO_CONTEXT)
+            eglDestroyContext(display_, context_);
+        eglTerminate(display_);
+    }
+
+    // Creates an OpenGL ES 3 context without a surface
+    bool create()
+    {
+        auto get_platform_display =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if(get_platform_display)
+        {
+            display_ = get_platform_display(
+                EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if(display_ == EGL_NO_DISPLAY)
+            display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        if(display_ == EGL_NO_DISPLAY || !eglInitialize(display_, 0, 0))
+            return false;
+
+        const EGLint config_attribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+            EGL_NONE};
+        EGLConfig config = nullptr;
+        EGLint num_configs = 0;
+        eglChooseConfig(display_, config_attribs, &config, 1, &num_configs);
+
+        eglBindAPI(EGL_OPENGL_ES_API);
+        const EGLint context_attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_NONE};
+        context_ = eglCreateContext(
+            display_,
+            num_configs > 0 ? config : EGL_NO_CONFIG_KHR,
+            EGL_NO_CONTEXT,
+            context_attribs);
+        if(context_ == EGL_NO_CONTEXT)
+            return false;
+
+        return eglMakeCurrent(
+            display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_) == EGL_TRUE;
+    }
+
+private:
+    EGLDisplay display_;
+    EGLContext context_;
+};
+
+//******************************************************************************
+// Offscreen_target
+//
+// A multisampled framebuffer, a resolved framebuffer and two pixel buffers.
+// The pixels of a frame are read back while the next frame is rendered
+//******************************************************************************
+
+class Offscreen_target
+{
+public:
+    Offscreen_target(int width, int height, int samples)
+        : width_(width)
+        , height_(height)
+        , next_pbo_(0)
+        , pending_(false)
+    {
+        GLint max_samples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+        samples = std::min(samples, static_cast<int>(max_samples));
+
+        glGenFramebuffers(1, &fbo_);
+        glGenRenderbuffers(2, rbo_);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+        glBindRenderbuffer(GL_RENDERBUFFER, rbo_[0]);
+        glRenderbufferStorageMultisample(
+            GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo_[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, rbo_[1]);
+        glRenderbufferStorageMultisample(
+            GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER,
+            GL_DEPTH_STENCIL_ATTACHMENT,
+            GL_RENDERBUFFER,
+            rbo_[1]);
+        is_complete_ = glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+                       GL_FRAMEBUFFER_COMPLETE;
+
+        glGenFramebuffers(1, &resolve_fbo_);
+        glGenRenderbuffers(1, &resolve_rbo_);
+        glBindFramebuffer(GL_FRAMEBUFFER, resolve_fbo_);
+        glBindRenderbuffer(GL_RENDERBUFFER, resolve_rbo_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolve_rbo_);
+        is_complete_ &= glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+                        GL_FRAMEBUFFER_COMPLETE;
+
+        glGenBuffers(2, pbo_);
+        for(auto pbo : pbo_)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+            glBufferData(
+                GL_PIXEL_PACK_BUFFER, frame_bytes(), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    ~Offscreen_target()
+    {
+        glDeleteBuffers(2, pbo_);
+        glDeleteFramebuffers(1, &fbo_);
+        glDeleteFramebuffers(1, &resolve_fbo_);
+        glDeleteRenderbuffers(2, rbo_);
+        glDeleteRenderbuffers(1, &resolve_rbo_);
+    }
+
+    bool is_complete() const { return is_complete_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    void bind()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+        glViewport(0, 0, width_, height_);
+    }
+
+    // Resolves the frame and starts its asynchronous read back. The pixels of
+    // the previous frame are passed to the writer
+    void read_back(Frame_writer& writer, const std::string& fname)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_fbo_);
+        glBlitFramebuffer(0, 0, width_, height_,
+                          0, 0, width_, height_,
+                          GL_COLOR_BUFFER_BIT,
+                          GL_NEAREST);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, resolve_fbo_);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo_[next_pbo_]);
+        glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        flush(writer);
+
+        pending_ = true;
+        pending_fname_ = fname;
+        next_pbo_ = 1 - next_pbo_;
+    }
+
+    // Passes the last frame to the writer
+    void flush(Frame_writer& writer)
+    {
+        if(!pending_)
+            return;
+
+        const GLuint pbo = pbo_[1 - next_pbo_];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        auto data = static_cast<const unsigned char*>(glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, frame_bytes(), GL_MAP_READ_BIT));
+        if(data)
+        {
+            writer.write(
+                pending_fname_,
+                std::vector<unsigned char>(data, data + frame_bytes()),
+                width_,
+                height_);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        pending_ = false;
+    }
+
+private:
+    GLsizeiptr frame_bytes() const
+    {
+        return static_cast<GLsizeiptr>(width_) * height_ * 4;
+    }
+
+    int width_, height_;
+    bool is_complete_;
+
+    GLuint fbo_, rbo_[2];
+    GLuint resolve_fbo_, resolve_rbo_;
+    GLuint pbo_[2];
+    int next_pbo_;
+
+    bool pending_;
+    std::string pending_fname_;
+};
+
+//******************************************************************************
+// Render_settings
+//******************************************************************************
+
+struct Render_settings
+{
+    int width = 1280, height = 720, samples = 4;
+    float timeline_height = 200.f;
+    std::string output = "frame_%05d.png";
+    glm::vec4 background = glm::vec4(1.f);
+    bool gpu_projection = true;
+
+    // Rotations in radians
+    float rot_3d[3] = {0.f, 0.f, 0.f};
+    float fov_4d = 30.f * static_cast<float>(DEG_TO_RAD);
+};
+
+//******************************************************************************
+// Renderer
+//******************************************************************************
+
+class Headless_renderer
+{
+public:
+    Headless_renderer()
+        : state_(std::make_shared<Scene_state>())
+        , scene_(state_)
+        , scene_renderer_(state_)
+        , timeline_(state_)
+        , diffuse_(std::make_shared<Diffuse_shader>())
+        , screen_(std::make_shared<Screen_shader>())
+        , scene_text_(std::make_shared<Text_renderer>())
+        , timeline_text_(std::make_shared<Text_renderer>())
+        , writer_(std::max(2u, std::thread::hardware_concurrency()) - 1, 8)
+        , frame_index_(0)
+    {
+        diffuse_->initialize();
+        screen_->initialize();
+        scene_renderer_.set_shaders(diffuse_, screen_);
+        scene_renderer_.set_text_renderer(scene_text_);
+        timeline_.set_shader(screen_);
+        timeline_.set_text_renderer(timeline_text_);
+
+        scene_renderer_.set_line_thickness(3.f, 3.f);
+        scene_renderer_.set_sphere_diameter(3.f);
+        scene_renderer_.set_fog(10.f, 2.f);
+        timeline_.set_pictogram_size(50.f);
+        timeline_.set_pictogram_magnification(1.5f, 4);
+
+        state_->camera_4D <<= 0., 0., 0., 550., 0.;
+        state_->camera_3D.z = -3.f;
+        state_->fov_y = 45.f * static_cast<float>(DEG_TO_RAD);
+
+        set_theme("bright");
+    }
+
+    ~Headless_renderer()
+    {
+        finish();
+    }
+
+    Scene_state& state() { return *state_; }
+    Render_settings& settings() { return settings_; }
+
+    bool set_theme(const std::string& name)
+    {
+        std::map<int, Color> colors;
+        if(name == "bright")
+        {
+            colors[Background]       = Color(255, 255, 255);
+            colors[Curve_low_speed]  = Color(  0,   0,   0);
+            colors[Curve_high_speed] = Color(220, 220, 220);
+        }
+        else if(name == "dark")
+        {
+            colors[Background]       = Color(  0,   0,   0);
+            colors[Curve_low_speed]  = Color(255, 255, 255);
+            colors[Curve_high_speed] = Color( 35,  35,  35);
+        }
+        else
+        {
+            return false;
+        }
+        colors[X_axis] = Color(215,  25,  28);
+        colors[Y_axis] = Color(253, 174,  97);
+        colors[Z_axis] = Color(171, 217, 233);
+        colors[W_axis] = Color( 44, 123, 182);
+
+        for(const auto& c : colors)
+            state_->update_color(c.first, c.second);
+
+        const Color& bg = colors[Background];
+        settings_.background =
+            glm::vec4(bg.r_norm(), bg.g_norm(), bg.b_norm(), bg.a_norm());
+        return true;
+    }
+
+    void load(const std::vector<std::string>& fnames)
+    {
+        scene_.load_ode(fnames, 0.8f);
+    }
+
+    bool render_frame()
+    {
+        if(!target_ ||
+           target_->width() != settings_.width ||
+           target_->height() != settings_.height)
+        {
+            if(target_)
+                target_->flush(writer_);
+            target_ = std::make_unique<Offscreen_target>(
+                settings_.width, settings_.height, settings_.samples);
+            if(!target_->is_complete())
+            {
+                std::fprintf(stderr, "Cannot create the framebuffer\n");
+                return false;
+            }
+        }
+
+        const float width = static_cast<float>(settings_.width);
+        const float height = static_cast<float>(settings_.height);
+
+        state_->rotation_3D = glm::eulerAngleXYZ(settings_.rot_3d[0],
+                                                 settings_.rot_3d[1],
+                                                 settings_.rot_3d[2]);
+        state_->projection_4D = Matrix_lib_f::get4DProjectionMatrix(
+            settings_.fov_4d, settings_.fov_4d, settings_.fov_4d, 1.f, 10.f);
+        scene_renderer_.set_gpu_projection(settings_.gpu_projection);
+
+        target_->bind();
+        glClearColor(settings_.background.r,
+                     settings_.background.g,
+                     settings_.background.b,
+                     settings_.background.a);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        ImGuiIO& io = ImGui::GetIO();
+        io.DisplaySize = ImVec2(width, height);
+        io.DisplayFramebufferScale = ImVec2(1.f, 1.f);
+        io.DeltaTime = 1.f / 30.f;
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui::NewFrame();
+
+        const float timeline_height = settings_.timeline_height;
+        const bool show_timeline = timeline_height > 0.f;
+        const float scene_bottom =
+            show_timeline ? timeline_height + 0.5f * Separator_thickness : 0.f;
+
+        scene_renderer_.set_redering_region(
+            Base_renderer::Region(0.f, scene_bottom, width, height), 1.f, 1.f);
+        timeline_.set_redering_region(
+            Base_renderer::Region(
+                0.f,
+                0.f,
+                width,
+                timeline_height - 0.5f * Separator_thickness),
+            1.f,
+            1.f);
+
+        // Every frame of a sweep differs, so the geometry is always rebuilt
+        state_->mark_dirty(Scene_state::Dirty_all);
+
+        scene_renderer_.render();
+        if(show_timeline)
+            timeline_.render();
+        state_->clear_dirty();
+
+        // Renderers set their own viewports
+        glViewport(0, 0, settings_.width, settings_.height);
+        scene_text_->render(settings_.width, settings_.height);
+        if(show_timeline)
+            timeline_text_->render(settings_.width, settings_.height);
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+        char fname[1024];
+        std::snprintf(
+            fname, sizeof(fname), settings_.output.c_str(), frame_index_);
+        target_->read_back(writer_, fname);
+
+        ++frame_index_;
+        return true;
+    }
+
+    // Returns the number of frames that could not be written
+    size_t finish()
+    {
+        if(target_)
+            target_->flush(writer_);
+        return writer_.finish();
+    }
+
+    int num_frames() const { return frame_index_; }
+
+private:
+    std::shared_ptr<Scene_state> state_;
+    Scene scene_;
+    Scene_renderer scene_renderer_;
+    Timeline_renderer timeline_;
+
+    std::shared_ptr<Diffuse_shader> diffuse_;
+    std::shared_ptr<Screen_shader> screen_;
+    // The renderers clear their own texts
+    std::shared_ptr<Text_renderer> scene_text_, timeline_text_;
+
+    Render_settings settings_;
+    std::unique_ptr<Offscreen_target> target_;
+    Frame_writer writer_;
+    int frame_index_;
+};
+
+//******************************************************************************
+// set_parameter
+//******************************************************************************
+
+bool set_parameter(Headless_renderer& r, const std::string& name, float value)
+{
+    Scene_state& s = r.state();
+    const float rad = value * static_cast<float>(DEG_TO_RAD);
+
+    if     (name == "unfolding") s.unfolding_anim = std::clamp(value, 0.f, 1.f);
+    else if(name == "time")      s.timeplayer_pos = std::clamp(value, 0.f, 1.f);
+    else if(name == "xy")        s.xy_rot = rad;
+    else if(name == "yz")        s.yz_rot = rad;
+    else if(name == "zx")        s.zx_rot = rad;
+    else if(name == "xw")        s.xw_rot = rad;
+    else if(name == "yw")        s.yw_rot = rad;
+    else if(name == "zw")        s.zw_rot = rad;
+    else if(name == "x")         r.settings().rot_3d[0] = rad;
+    else if(name == "y")         r.settings().rot_3d[1] = rad;
+    else if(name == "z")         r.settings().rot_3d[2] = rad;
+    else if(name == "distance")  s.camera_3D.z = -value;
+    else if(name == "fov")       s.fov_y = rad;
+    else return false;
+
+    return true;
+}
+
+//******************************************************************************
+// set_visibility
+//******************************************************************************
+
+bool set_visibility(Scene_state& s, const std::string& name, bool value)
+{
+    if     (name == "tesseract") s.show_tesseract = value;
+    else if(name == "curve")     s.show_curve = value;
+    else if(name == "legend")    s.show_legend = value;
+    else if(name == "timepoint") s.is_timeplayer_active = value;
+    else if(name == "dali")      s.use_simple_dali_cross = value;
+    else return false;
+
+    return true;
+}
+
+//******************************************************************************
+// is_frame_pattern
+//
+// The pattern is the format of snprintf with the frame index, so it must have
+// exactly one integer conversion ('%d' or '%05d'). '%%' is a literal '%'
+//******************************************************************************
+
+bool is_frame_pattern(const std::string& pattern)
+{
+    int conversions = 0;
+    for(size_t i = 0; i < pattern.size(); ++i)
+    {
+        if(pattern[i] != '%')
+            continue;
+
+        if(++i < pattern.size() && pattern[i] == '%')
+            continue;
+
+        while(i < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[i])))
+            ++i;
+        if(i == pattern.size() || pattern[i] != 'd')
+            return false;
+
+        ++conversions;
+    }
+    return conversions == 1;
+}
+
+//******************************************************************************
+// run_command
+//******************************************************************************
+
+bool run_command(Headless_renderer& r, std::istringstream& line)
+{
+    std::string cmd;
+    if(!(line >> cmd) || cmd[0] == '#')
+        return true;
+
+    auto& settings = r.settings();
+
+    if(cmd == "size")
+        return static_cast<bool>(line >> settings.width >> settings.height) &&
+               settings.width > 0 && settings.height > 0;
+    if(cmd == "samples")
+        return static_cast<bool>(line >> settings.samples);
+    if(cmd == "timeline")
+        return static_cast<bool>(line >> settings.timeline_height);
+    if(cmd == "output")
+    {
+        std::string pattern;
+        if(!(line >> pattern) || !is_frame_pattern(pattern))
+            return false;
+
+        settings.output = pattern;
+        return true;
+    }
+
+    if(cmd == "theme")
+    {
+        std::string name;
+        return line >> name && r.set_theme(name);
+    }
+
+    if(cmd == "projection")
+    {
+        std::string name;
+        if(!(line >> name) || (name != "gpu" && name != "cpu"))
+            return false;
+
+        settings.gpu_projection = name == "gpu";
+        return true;
+    }
+
+    if(cmd == "load")
+    {
+        std::vector<std::string> fnames;
+        std::string fname;
+        while(line >> fname)
+            fnames.push_back(fname);
+        if(fnames.empty())
+            return false;
+
+        r.load(fnames);
+        return !r.state().curves.empty();
+    }
+
+    if(cmd == "show")
+    {
+        std::string name;
+        int value = 0;
+        return line >> name >> value &&
+               set_visibility(r.state(), name, value != 0);
+    }
+
+    if(cmd == "set")
+    {
+        std::string name;
+        float value = 0.f;
+        return line >> name >> value && set_parameter(r, name, value);
+    }
+
+    if(cmd == "frame")
+    {
+        int count = 1;
+        line >> count;
+        for(int i = 0; i < count; ++i)
+        {
+            if(!r.render_frame())
+                return false;
+        }
+        return true;
+    }
+
+    if(cmd == "sweep")
+    {
+        std::string name;
+        float from = 0.f, to = 0.f;
+        int count = 0;
+        if(!(line >> name >> from >> to >> count) || count <= 0)
+            return false;
+
+        for(int i = 0; i < count; ++i)
+        {
+            const float t = count > 1 ? static_cast<float>(i) / (count - 1)
+                                      : 0.f;
+            if(!set_parameter(r, name, from + t * (to - from)) ||
+               !r.render_frame())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    return false;
+}
+
+} // namespace
+
+//******************************************************************************
+// main
+//******************************************************************************
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::fprintf(stderr, "Usage: manylands_render <script>\n");
+        return 1;
+    }
+
+    std::ifstream script(argv[1]);
+    if(!script.is_open())
+    {
+        std::fprintf(stderr, "Cannot open '%s'\n", argv[1]);
+        return 1;
+    }
+
+    Egl_context context;
+    if(!context.create())
+    {
+        std::fprintf(stderr, "Cannot create an EGL context\n");
+        return 1;
+    }
+
+    ImGui::CreateContext();
+    ImGui::GetIO().IniFilename = nullptr;
+    ImGui::GetIO().Fonts->AddFontFromFileTTF("assets/Roboto-Regular.ttf", 14.f);
+    ImGui_ImplOpenGL3_Init("#version 300 es");
+
+    int result = 0;
+    {
+        Headless_renderer renderer;
+
+        std::string line;
+        for(int line_num = 1; std::getline(script, line); ++line_num)
+        {
+            std::istringstream stream(line);
+            if(!run_command(renderer, stream))
+            {
+                std::fprintf(stderr,
+                             "%s:%d: cannot execute '%s'\n",
+                             argv[1],
+                             line_num,
+                             line.c_str());
+                result = 1;
+                break;
+            }
+        }
+
+        const size_t failed = renderer.finish();
+        if(failed > 0)
+        {
+            std::fprintf(stderr, "%zu frames could not be written\n", failed);
+            result = 1;
+        }
+
+        std::printf("%d frames rendered\n", renderer.num_frames());
+    }
+
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui::DestroyContext();
+
+    return result;
+}
@@ -0,0 +1,47 @@
+//******************************************************************************
+// Allocation_counter
+//
+// Replaces the global operator new to count the heap allocations for the
+// Profiler. Every allocation pays an atomic increment, therefore the file is
+// only built with the MANYLANDS_COUNT_ALLOCATIONS option
+//******************************************************************************
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+std::atomic<std::uint64_t> Allocation_counter(0);
+
+//******************************************************************************
+// operator new
+//******************************************************************************
+
+void* operator new(std::size_t size)
+{
+    Allocation_counter.fetch_add(1, std::memory_order_relaxed);
+
+    if(void* p = std::malloc(size > 0 ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+//******************************************************************************
+// operator delete
+//******************************************************************************
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+//******************************************************************************
+// operator delete
+//******************************************************************************
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
@@ -3,85 +3,47 @@
 //
 
 #include "Audio.h"
+#include "AudioGraph.h"
+#include "VoicePool.h"
 
 #include "RtAudio.h"
 #include "SineWave.h"
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
 
 int tick( void *outputBuffer, void *inputBuffer, unsigned int nBufferFrames,
           double streamTime, RtAudioStreamStatus status, void *dataPointer )
 {
     // TODO assertions with vector sizes in TickData
     auto *data = (TickData *) dataPointer;
-    int numberOfTones = data->overtoneSteps.size();
-
-
-    /*const StkFrames& samples = effect->lastFrame();
-    *oSamples++ = data->envelope.tick() * samples[0];
-    *oSamples++ = data->envelope.lastOut() * samples[1];*/
-
-    auto sines = data->sines;
-    float midi = data->calcMidiFromFrequency(data->fundamentalFrequency);
-
-    for (int j = 0; j < numberOfTones; j++) {
-        float midiSine = midi + data->overtoneSteps[j];
-        data->sines[j]->setFrequency(data->calcFrequencyFromMidi(midiSine));
-    }
 
-
-    stk::StkFloat *samples = (stk::StkFloat *) outputBuffer;
-    for ( unsigned int i=0; i<nBufferFrames; i++ ) {
-        stk::StkFloat sample = 0;
-        //const stk::StkFrames& effectSamples = effect->lastFrame();
-        for (int k = 0; k < numberOfTones; k++) {
-            sample += sines[k]->tick() * data->overToneLoudness[k];
-        }
-        *samples++ = sample
-                * data->scaler
-                * data->envelope.tick(); /* * effectSamples[0];
-        *samples++ = sample
-                     * data->scaler
-                     * data->envelope.lastOut() * effectSamples[1];*/
-    }
+    data->applyPendingParameters(nBufferFrames);
+    data->render((stk::StkFloat *) outputBuffer, nBufferFrames);
 
     return 0;
 }
 
-void Audio::initStream(TickData* userData) {
-    if (this->isStreamOpen) {
-        dac_->closeStream();
-    }
-    RtAudio::StreamParameters outputParameters;
-    outputParameters.deviceId = dac_->getDefaultOutputDevice();
-    outputParameters.nChannels = 1;
-    RtAudio::StreamParameters inputParameters;
-    inputParameters.deviceId = dac_->getDefaultInputDevice();
-    inputParameters.nChannels = 1;
-    RtAudioFormat format = RTAUDIO_FLOAT64;
-    unsigned int bufferFrames = stk::RT_BUFFER_SIZE;
+bool Audio::initStream(VoicePool* userData, AudioGraph* graph) {
     this->userData_ = userData;
-    if ( dac_->openStream( &outputParameters,
-                         &inputParameters,
-                         format,
-                         (unsigned int)stk::Stk::sampleRate(),
-                         &bufferFrames,
-                         &tick,
-                         userData ) ) {
-        std::cout << dac_->getErrorText() << std::endl;
-    } else {
-        this->isStreamOpen = true;
-        if ( dac_->startStream() ) {
-            std::cout << dac_->getErrorText() << std::endl;
-        }
-
-    }
+    return backend_->open((unsigned int)stk::Stk::sampleRate(),
+                          stk::RT_BUFFER_SIZE,
+                          AudioGraph::NO_OF_CHANNELS,
+                          &tickGraph,
+                          graph);
+}
 
+void Audio::setBackend(std::unique_ptr<AudioBackend> backend) {
+    backend_->close();
+    backend_ = std::move(backend);
 }
 
 void Audio::startPlayingAudio() {
 
     if (!isPlayingSound) {
-        userData_->envelope.keyOn();
+        userData_->setGate(true);
         isPlayingSound = true;
     }
 
@@ -89,20 +51,58 @@ void Audio::startPlayingAudio() {
 
 void Audio::stopPlayingAudio() {
     if (isPlayingSound) {
-        userData_->envelope.keyOff();
+        userData_->setGate(false);
         isPlayingSound = false;
     }
 }
 
 void Audio::closeStream() {
-    dac_->closeStream();
+    backend_->close();
     isPlayingSound = false;
 }
 
+ControlCurve::ControlCurve(std::vector<float> positions,
+                           std::vector<float> tracks,
+                           std::vector<Operation> operations,
+                           const float (&base)[NO_OF_PARAMETERS],
+                           std::vector<Switch> switches)
+        : positions(std::move(positions)), tracks(std::move(tracks)),
+          operations(std::move(operations)), mappedParameters(0),
+          switches(std::move(switches)) {
+    std::copy(base, base + NO_OF_PARAMETERS, this->base);
+    for (const Operation& operation : this->operations) {
+        mappedParameters |= 1u << operation.parameter;
+    }
+}
+
+void ControlCurve::evaluate(double position, float* parameters) const {
+    // One search for all tracks, they share the positions
+    const size_t noOfPoints = positions.size();
+    const size_t next = std::upper_bound(positions.begin(), positions.end(),
+                                         (float) position) - positions.begin();
+    const size_t i = std::min(std::max<size_t>(next, 1), noOfPoints - 1);
+    const float span = positions[i] - positions[i - 1];
+    const float t = span > 0.0f
+            ? std::min(std::max(((float) position - positions[i - 1]) / span,
+                                0.0f), 1.0f)
+            : 0.0f;
+
+    std::copy(base, base + NO_OF_PARAMETERS, parameters);
+    for (const Operation& operation : operations) {
+        const float* track = &tracks[operation.track * noOfPoints];
+        const float value = track[i - 1] + t * (track[i] - track[i - 1]);
+        parameters[operation.parameter] += operation.scale * value;
+    }
+}
+
+float ControlCurve::defaultValue(int parameter) {
+    return parameter == PITCH || parameter == PAN ? 0.0f : 1.0f;
+}
+
 void TickData::setFundamentalFrequencyFromSpeed(float speed, float min, float max) {
 
     float percentage = (speed - min) / (max - min);
-    fundamentalFrequency = exp(percentage * (log(this->maxFreq) - log(this->minFreq)) + log(this->minFreq));
+    setFundamentalFrequency(calcFrequencyFromPercentage(percentage));
 
 
 //    float midiNote = percentage * (MAX_MIDI - MIN_MIDI) + MIN_MIDI;
@@ -111,24 +111,259 @@ void TickData::setFundamentalFrequencyFromSpeed(float speed, float min, float ma
 
 }
 
+void TickData::setFundamentalFrequency(stk::StkFloat frequency) {
+    fundamentalFrequency = frequency;
+    pendingFrequency.store(frequency, std::memory_order_relaxed);
+}
+
+void TickData::setGate(bool isOn) {
+    pendingGate.store(isOn, std::memory_order_relaxed);
+}
+
+void TickData::setControlCurve(std::shared_ptr<const ControlCurve> curve) {
+    // Once the callback uses the current curve, it does not use the retired
+    // ones any more
+    if (usedControlCurve.load(std::memory_order_acquire) == controlCurve.get()) {
+        retiredControlCurves.clear();
+    }
+    if (controlCurve) {
+        retiredControlCurves.push_back(controlCurve);
+    }
+    controlCurve = std::move(curve);
+    pendingControlCurve.store(controlCurve.get(), std::memory_order_release);
+}
+
+void TickData::seek(double position) {
+    pendingSeekPosition.store(position, std::memory_order_relaxed);
+    seekCount.fetch_add(1, std::memory_order_release);
+    playbackPosition.store(position, std::memory_order_relaxed);
+}
+
+void TickData::setPlaybackSpeed(double speed) {
+    playbackSpeed.store(speed, std::memory_order_relaxed);
+}
+
+double TickData::getPlaybackPosition() const {
+    return playbackPosition.load(std::memory_order_relaxed);
+}
+
+void TickData::applyPendingParameters(unsigned int nFrames) {
+    applyGate();
+
+    unsigned int seeks = seekCount.load(std::memory_order_acquire);
+    if (seeks != appliedSeekCount) {
+        position = pendingSeekPosition.load(std::memory_order_relaxed);
+        appliedSeekCount = seeks;
+    }
+
+    double end = position;
+    if (appliedGate) {
+        end += nFrames * playbackSpeed.load(std::memory_order_relaxed)
+               / stk::Stk::sampleRate();
+    }
+    applyPlayback(nFrames, end);
+}
+
+void TickData::applyPendingParameters(unsigned int nFrames,
+                                      const Transport::Block& block) {
+    applyGate();
+    position = block.start;
+    applyPlayback(nFrames, block.end);
+}
+
+void TickData::applyGate() {
+    bool gate = pendingGate.load(std::memory_order_relaxed);
+    if (gate != appliedGate) {
+        if (gate) {
+            envelope.keyOn();
+        } else {
+            envelope.keyOff();
+        }
+        appliedGate = gate;
+    }
+}
+
+void TickData::applyPlayback(unsigned int nFrames, double end) {
+    // The curve is marked as used before it is read
+    const ControlCurve* control =
+            pendingControlCurve.load(std::memory_order_acquire);
+    usedControlCurve.store(control, std::memory_order_release);
+
+    if (control && end > position) {
+        strikeSwitches(*control, position, end, nFrames);
+    }
+
+    // The parameters at the end of the block. During the release they are
+    // held at the ones of the last gated block, the position may have
+    // wrapped around to the start of the curve
+    float* parameters = heldParameters;
+    if (appliedGate) {
+        if (control) {
+            control->evaluate(end, parameters);
+        } else {
+            for (int p = 0; p < ControlCurve::NO_OF_PARAMETERS; p++) {
+                parameters[p] = ControlCurve::defaultValue(p);
+            }
+        }
+    }
+
+    // A mapped pitch is held during the release
+    stk::StkFloat frequency = pendingFrequency.load(std::memory_order_relaxed);
+    if (control && control->isMapped(ControlCurve::PITCH)) {
+        frequency = appliedGate
+                ? calcFrequencyFromPercentage(parameters[ControlCurve::PITCH])
+                : appliedFrequency;
+    }
+    position = end - std::floor(end);
+    playbackPosition.store(position, std::memory_order_relaxed);
+
+    // The partials are only retuned when the frequency has changed, they
+    // glide to the new frequency and amplitudes during the block
+    const bool isRetuned = frequency != appliedFrequency;
+    if (isRetuned) {
+        float midi = calcMidiFromFrequency(frequency);
+        for (size_t j = 0; j < overtoneSteps.size(); j++) {
+            float midiSine = midi + overtoneSteps[j];
+            oscillators.setFrequency(j, calcFrequencyFromMidi(midiSine));
+        }
+    }
+    // Partials without a frequency stay silent
+    if (frequency != 0.0) {
+        applyTimbre(parameters);
+    }
+    if (isRetuned) {
+        // New partials start at the frequency instead of gliding from zero
+        if (appliedFrequency == 0.0) {
+            oscillators.reset();
+        }
+        appliedFrequency = frequency;
+    }
+
+    targetLoudness = parameters[ControlCurve::LOUDNESS];
+    appliedPan = parameters[ControlCurve::PAN];
+}
+
+void TickData::applyTimbre(const float* parameters) {
+    // The brightness tilts the partials linearly down to the last one
+    const float tilt = 1.0f - parameters[ControlCurve::BRIGHTNESS];
+    const size_t noOfPartials = overtoneSteps.size();
+    for (size_t j = 0; j < noOfPartials; j++) {
+        const float weight = j < ControlCurve::MAX_PARTIALS
+                ? parameters[ControlCurve::PARTIAL + j] : 1.0f;
+        const float slope = noOfPartials > 1
+                ? (float) j / (noOfPartials - 1) : 0.0f;
+        const float gain = std::max(0.0f, weight * (1.0f - tilt * slope));
+        oscillators.setAmplitude(j, overToneLoudness[j] * gain);
+    }
+}
+
+void TickData::strikeSwitches(const ControlCurve& control, double start,
+                              double end, unsigned int nFrames) {
+    const auto& switches = control.getSwitches();
+    const double framesPerPosition = nFrames / (end - start);
+    auto isBefore = [](double position, const ControlCurve::Switch& s) {
+        return position < s.position;
+    };
+
+    // The second lap are the switches after wrapping around the end
+    const int noOfLaps = end >= 1.0 ? 2 : 1;
+    for (int lap = 0; lap < noOfLaps; lap++) {
+        auto s = std::upper_bound(switches.begin(), switches.end(),
+                                  start - lap, isBefore);
+        for (; s != switches.end() && s->position + lap <= end; ++s) {
+            const double frame = (s->position + lap - start) * framesPerPosition;
+            resonators.strike(std::min(nFrames - 1, (unsigned int) frame),
+                              s->axes);
+        }
+    }
+}
+
+void TickData::render(stk::StkFloat* samples, unsigned int nFrames) {
+    // All partials of the block are rendered in one pass. The effects are
+    // nodes of the AudioGraph
+    stk::StkFloat *block = samples;
+    std::fill(samples, samples + nFrames, 0.0);
+    oscillators.render(samples, nFrames);
+
+    // The loudness of the control curve glides over the block
+    float loudness = appliedLoudness;
+    const float loudnessStep = (targetLoudness - appliedLoudness) / nFrames;
+    for ( unsigned int i=0; i<nFrames; i++ ) {
+        loudness += loudnessStep;
+        *samples++ *= scaler * envelope.tick() * loudness;
+    }
+    appliedLoudness = targetLoudness;
+
+    // The resonators ring out independent of the envelope
+    resonators.render(block, nFrames);
+}
+
+bool TickData::isSilent() const {
+    return !appliedGate && envelope.getState() == stk::ADSR::IDLE
+           && !resonators.isRinging();
+}
+
+void TickData::advance(unsigned int nFrames) {
+    applyPendingParameters(nFrames);
+    oscillators.advance(nFrames);
+    resonators.advance(nFrames);
+    for (unsigned int i = 0; i < nFrames; i++) {
+        envelope.tick();
+    }
+    appliedLoudness = targetLoudness;
+}
+
+void TickData::copyFrom(const TickData& other) {
+    oscillators = other.oscillators;
+    overtoneSteps = other.overtoneSteps;
+    overToneLoudness = other.overToneLoudness;
+    fundamentalFrequency = other.fundamentalFrequency;
+    scaler = other.scaler;
+    envelope = other.envelope;
+    resonators = other.resonators;
+    minFreq.store(other.minFreq.load());
+    maxFreq.store(other.maxFreq.load());
+    minMidi = other.minMidi;
+    maxMidi = other.maxMidi;
+    pendingFrequency.store(other.pendingFrequency.load());
+    pendingGate.store(other.pendingGate.load());
+    controlCurve = other.controlCurve;
+    retiredControlCurves.clear();
+    pendingControlCurve.store(other.pendingControlCurve.load());
+    usedControlCurve.store(other.usedControlCurve.load());
+    pendingSeekPosition.store(other.pendingSeekPosition.load());
+    seekCount.store(other.seekCount.load());
+    playbackSpeed.store(other.playbackSpeed.load());
+    playbackPosition.store(other.playbackPosition.load());
+    appliedFrequency = other.appliedFrequency;
+    appliedGate = other.appliedGate;
+    appliedSeekCount = other.appliedSeekCount;
+    position = other.position;
+    appliedLoudness = other.appliedLoudness;
+    targetLoudness = other.targetLoudness;
+    appliedPan = other.appliedPan;
+    std::copy(std::begin(other.heldParameters), std::end(other.heldParameters),
+              heldParameters);
+}
+
 float TickData::calcMidiFromFrequency(float freq) {
     return 12.0f * (log(freq/440.0f) / log(2.0f)) + 69.0f;
 }
 
+float TickData::calcFrequencyFromPercentage(float percentage) const {
+    float logMin = log(minFreq.load(std::memory_order_relaxed));
+    float logMax = log(maxFreq.load(std::memory_order_relaxed));
+    return exp(percentage * (logMax - logMin) + logMin);
+}
+
 float TickData::calcFrequencyFromMidi(float midi) {
     return pow(2.0f, (midi -69.0f) / 12.0f) * 440.0f;
 }
 
 void TickData::initSines(int noOfSines) {
-    // delete element before new initialization to ensure vector does not get longer every time
-    for (auto ptr : sines) {
-        delete ptr;
-    }
-    sines.clear();
-    for (int i = 0; i < noOfSines; i++) {
-        stk::SineWave* sine = new stk::SineWave();
-        sines.push_back(sine);
-    }
+    oscillators.resize(noOfSines);
+    // The new partials are tuned by the next block
+    appliedFrequency = 0.0;
 }
 
 void TickData::updateMinMaxFrequency(float minFrequency, float maxFrequency) {
@@ -13,61 +13,272 @@
 #include "Instrmnt.h"
 #include "ADSR.h"
 #include "FreeVerb.h"
+#include "OscillatorBank.h"
+#include "ResonatorBank.h"
+#include "AudioBackend.h"
+#include "Transport.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
 
 
 const static float MIN_FREQ_RANGE = 100.0f;
 const static float MAX_FREQ_RANGE = 900.0f;
 
+// Synth parameters and dimensionality switches of a curve over the playback
+// position, compiled from a MappingSpec. It is not changed after construction,
+// so the audio callback reads it without locks.
+//
+// The features of the curve are mapped to tracks of values at the points of
+// the curve when it is compiled. Each block the callback interpolates all
+// tracks at the playback position and runs the operations, which add a track
+// scaled to a parameter. The operations are the same for every block and do
+// not branch.
+class ControlCurve {
+public:
+    static const int MAX_PARTIALS = 8;
+
+    enum Parameter {
+        // Fraction of the logarithmic frequency range
+        PITCH,
+        // Gain of the voice, 1 is the level of the instrument
+        LOUDNESS,
+        // Tilt of the partials, 1 keeps them and 0 leaves the fundamental
+        BRIGHTNESS,
+        // Added to the pan of the voice, -1 (left) to 1 (right)
+        PAN,
+        // Weight of the partial j at PARTIAL + j
+        PARTIAL,
+        NO_OF_PARAMETERS = PARTIAL + MAX_PARTIALS
+    };
+
+    // Adds 'scale' times the track to the parameter
+    struct Operation {
+        unsigned int track;
+        unsigned int parameter;
+        float scale;
+    };
+
+    // Change to a dimensionality with the ResonatorBank::Axis bits in 'axes'
+    struct Switch {
+        float position;
+        unsigned int axes;
+    };
+
+    // 'positions' are ascending in [0, 1], at least two. 'tracks' are the
+    // values of each track at the positions, one track after another.
+    // 'base' are the values of the parameters before the operations. The
+    // switches are ascending in position as well
+    ControlCurve(std::vector<float> positions, std::vector<float> tracks,
+                 std::vector<Operation> operations,
+                 const float (&base)[NO_OF_PARAMETERS],
+                 std::vector<Switch> switches = {});
+
+    // Writes the NO_OF_PARAMETERS parameters at 'position'. The tracks are
+    // interpolated linearly and clamped to the first and the last point
+    void evaluate(double position, float* parameters) const;
+
+    // True if an operation sets the parameter
+    bool isMapped(Parameter parameter) const {
+        return (mappedParameters >> parameter) & 1u;
+    }
+
+    // Value of a parameter that is not mapped
+    static float defaultValue(int parameter);
+
+    const std::vector<Switch>& getSwitches() const {
+        return switches;
+    }
+
+private:
+    std::vector<float> positions;
+    std::vector<float> tracks;
+    std::vector<Operation> operations;
+    float base[NO_OF_PARAMETERS];
+    unsigned int mappedParameters;
+    std::vector<Switch> switches;
+};
+
+// Parameters of the sound, shared by the UI thread and the audio callback.
+// The oscillators, the overtones and the scaler are set up before the stream
+// is opened. While the stream runs, the UI thread only changes the frequency,
+// the gate, the control curve and the playback, which are handed over to the
+// callback through atomics. The callback applies them at the start of each
+// block and owns the oscillators and the envelope.
+//
+// With a control curve the callback keeps its own playback position and
+// evaluates the synth parameters for the end of every block, so the pitch,
+// the loudness and the timbre glide at audio rate and do not depend on the
+// frame rate of the UI.
 class TickData {
 public:
-    std::vector<stk::SineWave*> sines;
+    // One partial per overtone, the partials without overtone are silent
+    OscillatorBank oscillators;
     std::vector<float> overtoneSteps;
     std::vector<float> overToneLoudness;
+    // Last frequency set by the UI thread, the callback does not read it
     stk::StkFloat fundamentalFrequency;
     stk::StkFloat scaler;
     stk::ADSR envelope;
+    // Rings at the switches of the control curve that the playback passes
+    ResonatorBank resonators;
 
+    void setFundamentalFrequency(stk::StkFloat frequency);
     void setFundamentalFrequencyFromSpeed(float speed, float min, float max);
+    void setGate(bool isOn);
     float calcMidiFromFrequency(float freq);
     float calcFrequencyFromMidi(float midi);
     void initSines(int noOfSines);
 
+    // The parameters follow the control curve while one is set. Without one,
+    // or if the curve does not map the pitch, the frequency set by the UI
+    // thread is used. Old curves are released when the callback does not use
+    // them any more
+    void setControlCurve(std::shared_ptr<const ControlCurve> curve);
+    // Playback position in [0, 1), it wraps around at the end of the curve.
+    // The position is published right away, the callback moves on from it
+    // with the next block
+    void seek(double position);
+    // Positions per second, the position moves while the gate is on
+    void setPlaybackSpeed(double speed);
+    // Position at the end of the last rendered block
+    double getPlaybackPosition() const;
+
+    // Called by the audio callback at the start of a block of nFrames. Does
+    // not allocate or lock
+    void applyPendingParameters(unsigned int nFrames);
+    // Like above, but the block plays the part of the curve given by the
+    // transport instead of the own playback position and speed
+    void applyPendingParameters(unsigned int nFrames,
+                                const Transport::Block& block);
+
+    // Renders nFrames mono samples after applyPendingParameters(), the
+    // switches passed in the block strike the resonators at their frame
+    void render(stk::StkFloat* samples, unsigned int nFrames);
+
+    // True while the gate is off and the release and the resonators have
+    // ended. Only used by the callback
+    bool isSilent() const;
+
+    // Pan of the control curve at the end of the last block, added to the pan
+    // of the voice. Only used by the callback
+    float getPan() const {
+        return appliedPan;
+    }
+
+    // Moves on by nFrames like tick() without rendering
+    void advance(unsigned int nFrames);
+
+    // Copies the settings and the state of 'other', this continues where
+    // 'other' stopped. Neither may be used by a running stream
+    void copyFrom(const TickData& other);
+
     // Default constructor.
     TickData()
-            : sines(), fundamentalFrequency(440.0), scaler(1.0), envelope() {
+            : oscillators(), fundamentalFrequency(440.0), scaler(1.0), envelope(),
+              pendingFrequency(440.0), pendingGate(false),
+              pendingControlCurve(nullptr), usedControlCurve(nullptr),
+              pendingSeekPosition(0.0), seekCount(0), playbackSpeed(0.0),
+              playbackPosition(0.0),
+              appliedFrequency(0.0), appliedGate(false),
+              appliedSeekCount(0), position(0.0), appliedLoudness(1.0f),
+              targetLoudness(1.0f), appliedPan(0.0f) {
         minFreq = 200;
         maxFreq = 800;
         minMidi = calcMidiFromFrequency(minFreq);
         maxMidi = calcMidiFromFrequency(maxFreq);
+        for (int p = 0; p < ControlCurve::NO_OF_PARAMETERS; p++) {
+            heldParameters[p] = ControlCurve::defaultValue(p);
+        }
     }
 
     void updateMinMaxFrequency(float minFrequency, float maxFrequency);
 
 private:
-    float minFreq;
-    float maxFreq;
+    float calcFrequencyFromPercentage(float percentage) const;
+    void applyGate();
+    // Plays the block from 'position' to 'end' and applies the parameters of
+    // the control curve at 'end'
+    void applyPlayback(unsigned int nFrames, double end);
+    // Sets the amplitudes of the partials from the brightness and the
+    // weights of the partials
+    void applyTimbre(const float* parameters);
+    // Strikes the switches in (start, end] of a block of nFrames
+    void strikeSwitches(const ControlCurve& control, double start, double end,
+                        unsigned int nFrames);
+
+    // Read by the callback with a control curve
+    std::atomic<float> minFreq;
+    std::atomic<float> maxFreq;
 
     float minMidi;
     float maxMidi;
+
+    // Written by the UI thread, read by the callback
+    std::atomic<stk::StkFloat> pendingFrequency;
+    std::atomic<bool> pendingGate;
+    static_assert(std::atomic<stk::StkFloat>::is_always_lock_free,
+                  "The audio callback must not lock");
+
+    // Control curves of the UI thread, the last one is handed to the callback
+    std::shared_ptr<const ControlCurve> controlCurve;
+    std::vector<std::shared_ptr<const ControlCurve>> retiredControlCurves;
+    std::atomic<const ControlCurve*> pendingControlCurve;
+    // Curve the callback uses, written before it is used
+    std::atomic<const ControlCurve*> usedControlCurve;
+
+    // A seek is pending while seekCount differs from appliedSeekCount
+    std::atomic<double> pendingSeekPosition;
+    std::atomic<unsigned int> seekCount;
+    std::atomic<double> playbackSpeed;
+    std::atomic<double> playbackPosition;
+
+    // Values the callback has applied, only used by the callback
+    stk::StkFloat appliedFrequency;
+    bool appliedGate;
+    unsigned int appliedSeekCount;
+    double position;
+    // The loudness is ramped over a block
+    float appliedLoudness;
+    float targetLoudness;
+    float appliedPan;
+    // Parameters of the control curve at the end of the last gated block
+    float heldParameters[ControlCurve::NO_OF_PARAMETERS];
 };
 
+// RtAudio callback, renders nBufferFrames mono samples of the TickData
+int tick(void *outputBuffer, void *inputBuffer, unsigned int nBufferFrames,
+         double streamTime, RtAudioStreamStatus status, void *dataPointer);
+
+class AudioGraph;
+class VoicePool;
+
 class Audio {
 
 public:
-    Audio(RtAudio* dac): dac_(dac), userData_() {}
+    explicit Audio(std::unique_ptr<AudioBackend> backend)
+            : backend_(std::move(backend)), userData_() {}
     bool isPlayingSound = false;
 
-    void initStream(TickData* userData);
+    // Opens a stereo stream of the graph, the gates of the voices start and
+    // stop the sound. Returns false if the backend cannot open it
+    bool initStream(VoicePool* userData, AudioGraph* graph);
     void startPlayingAudio();
     void stopPlayingAudio();
     void closeStream();
-    void setTickData(TickData* tickData) {
-        this->userData_ = tickData;
+    bool hasStream() const {
+        return backend_->isOpen();
+    }
+
+    // Closes the stream of the current backend, initStream() opens the new one
+    void setBackend(std::unique_ptr<AudioBackend> backend);
+    const AudioBackend& getBackend() const {
+        return *backend_;
     }
 private:
-    RtAudio* dac_;
-    TickData* userData_;
-    bool isStreamOpen = false;
+    std::unique_ptr<AudioBackend> backend_;
+    VoicePool* userData_;
 };
 
 
@@ -0,0 +1,253 @@
+//
+// Outputs of the audio stream: the sound device, a clock without output and a
+// WAV file.
+//
+
+#include "AudioBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+
+CallbackStats::CallbackStats() {
+    reset(0.0);
+}
+
+void CallbackStats::reset(double budgetSeconds) {
+    callbacks.store(0);
+    xruns.store(0);
+    totalNanos.store(0);
+    maxNanos.store(0);
+    budgetNanos.store((uint64_t) (budgetSeconds * 1e9));
+    for (auto& bucket : buckets) {
+        bucket.store(0);
+    }
+}
+
+void CallbackStats::record(double seconds, bool isXrun) {
+    // There is only one writer, so loads and stores suffice
+    const uint64_t nanos = (uint64_t) (seconds * 1e9);
+    auto add = [](std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+    };
+
+    add(callbacks, 1);
+    add(xruns, isXrun ? 1 : 0);
+    add(totalNanos, nanos);
+    if (nanos > maxNanos.load(std::memory_order_relaxed)) {
+        maxNanos.store(nanos, std::memory_order_relaxed);
+    }
+
+    int bucket = 0;
+    for (uint64_t limit = 1000; nanos >= limit && bucket < NO_OF_BUCKETS - 1;
+         limit *= 2) {
+        bucket++;
+    }
+    add(buckets[bucket], 1);
+}
+
+CallbackStats::Snapshot CallbackStats::getSnapshot() const {
+    Snapshot snapshot;
+    snapshot.callbacks = callbacks.load(std::memory_order_relaxed);
+    snapshot.xruns = xruns.load(std::memory_order_relaxed);
+    snapshot.budgetMicros = budgetNanos.load(std::memory_order_relaxed) * 1e-3;
+    snapshot.meanMicros = snapshot.callbacks > 0
+            ? totalNanos.load(std::memory_order_relaxed) * 1e-3
+              / snapshot.callbacks
+            : 0.0;
+    snapshot.maxMicros = maxNanos.load(std::memory_order_relaxed) * 1e-3;
+    snapshot.meanLoad = snapshot.budgetMicros > 0.0
+            ? snapshot.meanMicros / snapshot.budgetMicros : 0.0;
+    snapshot.maxLoad = snapshot.budgetMicros > 0.0
+            ? snapshot.maxMicros / snapshot.budgetMicros : 0.0;
+    for (int i = 0; i < NO_OF_BUCKETS; i++) {
+        snapshot.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+void AudioBackend::prepare(unsigned int sampleRate, unsigned int bufferFrames,
+                           RtAudioCallback callback, void *userData) {
+    this->callback = callback;
+    this->userData = userData;
+    stats.reset((double) bufferFrames / sampleRate);
+}
+
+int AudioBackend::process(void *outputBuffer, unsigned int nFrames,
+                          double streamTime, RtAudioStreamStatus status) {
+    const auto start = std::chrono::steady_clock::now();
+    const int result = callback(outputBuffer, nullptr, nFrames, streamTime,
+                                status, userData);
+    const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+    stats.record(elapsed.count(), (status & RTAUDIO_OUTPUT_UNDERFLOW) != 0);
+    return result;
+}
+
+DeviceAudioBackend::~DeviceAudioBackend() {
+    close();
+}
+
+bool DeviceAudioBackend::open(unsigned int sampleRate,
+                              unsigned int bufferFrames,
+                              unsigned int nChannels,
+                              RtAudioCallback callback, void *userData) {
+    close();
+    if (dac->getDeviceCount() == 0) {
+        std::cout << "No audio device found" << std::endl;
+        return false;
+    }
+
+    // Only the output is used, the input device may not exist
+    RtAudio::StreamParameters outputParameters;
+    outputParameters.deviceId = dac->getDefaultOutputDevice();
+    outputParameters.nChannels = nChannels;
+    if ( dac->openStream( &outputParameters,
+                           nullptr,
+                           RTAUDIO_FLOAT64,
+                           sampleRate,
+                           &bufferFrames,
+                           &deviceCallback,
+                           this ) ) {
+        std::cout << dac->getErrorText() << std::endl;
+        return false;
+    }
+
+    // RtAudio may have changed the buffer size
+    prepare(sampleRate, bufferFrames, callback, userData);
+    if ( dac->startStream() ) {
+        std::cout << dac->getErrorText() << std::endl;
+        dac->closeStream();
+        return false;
+    }
+    return true;
+}
+
+void DeviceAudioBackend::close() {
+    if (dac->isStreamOpen()) {
+        dac->closeStream();
+    }
+}
+
+bool DeviceAudioBackend::isOpen() const {
+    return dac->isStreamOpen();
+}
+
+int DeviceAudioBackend::deviceCallback(void *outputBuffer, void *,
+                                       unsigned int nFrames, double streamTime,
+                                       RtAudioStreamStatus status,
+                                       void *backend) {
+    return ((DeviceAudioBackend *) backend)->process(outputBuffer, nFrames,
+                                                     streamTime, status);
+}
+
+NullAudioBackend::NullAudioBackend(bool isRealtime)
+        : isRealtime(isRealtime), stop(false) {
+}
+
+NullAudioBackend::~NullAudioBackend() {
+    NullAudioBackend::close();
+}
+
+bool NullAudioBackend::open(unsigned int sampleRate, unsigned int bufferFrames,
+                            unsigned int nChannels, RtAudioCallback callback,
+                            void *userData) {
+    // Not virtual, FileAudioBackend has opened its file already
+    NullAudioBackend::close();
+    prepare(sampleRate, bufferFrames, callback, userData);
+    stop = false;
+    thread = std::thread(&NullAudioBackend::run, this, sampleRate,
+                         bufferFrames, nChannels);
+    return true;
+}
+
+void NullAudioBackend::close() {
+    if (thread.joinable()) {
+        stop = true;
+        thread.join();
+    }
+}
+
+bool NullAudioBackend::isOpen() const {
+    return thread.joinable();
+}
+
+void NullAudioBackend::run(unsigned int sampleRate,
+                           unsigned int bufferFrames, unsigned int nChannels) {
+    using Clock = std::chrono::steady_clock;
+    std::vector<stk::StkFloat> buffer(bufferFrames * nChannels);
+    auto start = Clock::now();
+    unsigned long long frames = 0;
+    RtAudioStreamStatus status = 0;
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        const double streamTime = (double) frames / sampleRate;
+        if (process(buffer.data(), bufferFrames, streamTime, status) != 0) {
+            break;
+        }
+        write(buffer.data(), bufferFrames);
+        frames += bufferFrames;
+        status = 0;
+
+        if (isRealtime) {
+            // The next buffer is due when this one has been played. If it is
+            // late, the stream continues from now
+            const std::chrono::duration<double> seconds(
+                    (double) frames / sampleRate);
+            const auto played =
+                    std::chrono::duration_cast<Clock::duration>(seconds);
+            const auto now = Clock::now();
+            if (now > start + played) {
+                status = RTAUDIO_OUTPUT_UNDERFLOW;
+                start = now - played;
+            } else {
+                std::this_thread::sleep_until(start + played);
+            }
+        }
+    }
+}
+
+FileAudioBackend::FileAudioBackend(std::string fileName, bool isRealtime)
+        : NullAudioBackend(isRealtime), fileName(std::move(fileName)) {
+}
+
+FileAudioBackend::~FileAudioBackend() {
+    FileAudioBackend::close();
+}
+
+bool FileAudioBackend::open(unsigned int sampleRate, unsigned int bufferFrames,
+                            unsigned int nChannels, RtAudioCallback callback,
+                            void *userData) {
+    close();
+    frames.resize(bufferFrames, nChannels);
+    try {
+        file.openFile(fileName, nChannels, stk::FileWrite::FILE_WAV,
+                      stk::Stk::STK_SINT16);
+    } catch (stk::StkError& error) {
+        std::cout << error.getMessage() << std::endl;
+        return false;
+    }
+    return NullAudioBackend::open(sampleRate, bufferFrames, nChannels,
+                                  callback, userData);
+}
+
+void FileAudioBackend::close() {
+    NullAudioBackend::close();
+    file.closeFile();
+}
+
+void FileAudioBackend::write(const stk::StkFloat* samples,
+                             unsigned int nFrames) {
+    // Only a buffer of another size is reallocated
+    if (nFrames != frames.frames()) {
+        frames.resize(nFrames, frames.channels());
+    }
+    // The frames are interleaved like the stream
+    std::copy(samples, samples + nFrames * frames.channels(), &frames[0]);
+    file.tick(frames);
+}
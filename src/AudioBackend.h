@@ -0,0 +1,169 @@
+//
+// Outputs of the audio stream: the sound device, a clock without output and a
+// WAV file.
+//
+
+#ifndef MANYLANDS_AUDIOBACKEND_H
+#define MANYLANDS_AUDIOBACKEND_H
+
+#include "FileWvOut.h"
+#include "RtAudio.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Timing of the audio callback. It is only written by the audio thread and
+// read by other threads without locks
+class CallbackStats {
+public:
+    // Bucket i counts the callbacks that took less than 2^i microseconds and
+    // did not fit into bucket i - 1. The last bucket counts all longer ones
+    static const int NO_OF_BUCKETS = 16;
+
+    struct Snapshot {
+        uint64_t callbacks;
+        uint64_t xruns;
+        // Duration of one buffer
+        double budgetMicros;
+        double meanMicros;
+        double maxMicros;
+        // Mean and longest duration as fraction of the budget
+        double meanLoad;
+        double maxLoad;
+        uint64_t buckets[NO_OF_BUCKETS];
+    };
+
+    CallbackStats();
+
+    // Must not be called while the stream runs
+    void reset(double budgetSeconds);
+
+    // Called by the audio thread after every callback
+    void record(double seconds, bool isXrun);
+
+    Snapshot getSnapshot() const;
+
+private:
+    std::atomic<uint64_t> callbacks;
+    std::atomic<uint64_t> xruns;
+    std::atomic<uint64_t> totalNanos;
+    std::atomic<uint64_t> maxNanos;
+    std::atomic<uint64_t> budgetNanos;
+    std::atomic<uint64_t> buckets[NO_OF_BUCKETS];
+};
+
+// Output of the audio stream. The backend calls the callback for every buffer
+// of interleaved RTAUDIO_FLOAT64 frames and records how long the callback took
+class AudioBackend {
+public:
+    virtual ~AudioBackend() = default;
+
+    // Opens and starts the stream. Returns false if it cannot be opened
+    virtual bool open(unsigned int sampleRate, unsigned int bufferFrames,
+                      unsigned int nChannels, RtAudioCallback callback,
+                      void *userData) = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+    virtual const char* getName() const = 0;
+
+    const CallbackStats& getStats() const {
+        return stats;
+    }
+
+protected:
+    void prepare(unsigned int sampleRate, unsigned int bufferFrames,
+                 RtAudioCallback callback, void *userData);
+
+    // Calls the callback and records its timing
+    int process(void *outputBuffer, unsigned int nFrames, double streamTime,
+                RtAudioStreamStatus status);
+
+    RtAudioCallback callback = nullptr;
+    void *userData = nullptr;
+    CallbackStats stats;
+};
+
+// The default output device of RtAudio
+class DeviceAudioBackend : public AudioBackend {
+public:
+    explicit DeviceAudioBackend(RtAudio* dac): dac(dac) {}
+    ~DeviceAudioBackend() override;
+
+    bool open(unsigned int sampleRate, unsigned int bufferFrames,
+              unsigned int nChannels, RtAudioCallback callback,
+              void *userData) override;
+    void close() override;
+    bool isOpen() const override;
+    const char* getName() const override {
+        return "device";
+    }
+
+private:
+    static int deviceCallback(void *outputBuffer, void *inputBuffer,
+                              unsigned int nFrames, double streamTime,
+                              RtAudioStreamStatus status, void *backend);
+
+    RtAudio* dac;
+};
+
+// Calls the callback from its own thread and drops the samples, for machines
+// without a sound device. In real time the buffers are requested at the pace
+// of the sample rate and a buffer that is late counts as an xrun, otherwise
+// they follow each other without waiting
+class NullAudioBackend : public AudioBackend {
+public:
+    explicit NullAudioBackend(bool isRealtime = true);
+    ~NullAudioBackend() override;
+
+    bool open(unsigned int sampleRate, unsigned int bufferFrames,
+              unsigned int nChannels, RtAudioCallback callback,
+              void *userData) override;
+    void close() override;
+    bool isOpen() const override;
+    const char* getName() const override {
+        return "null";
+    }
+
+protected:
+    // Called by the stream thread with every rendered buffer
+    virtual void write(const stk::StkFloat*, unsigned int) {}
+
+private:
+    void run(unsigned int sampleRate, unsigned int bufferFrames,
+             unsigned int nChannels);
+
+    bool isRealtime;
+    std::thread thread;
+    std::atomic<bool> stop;
+};
+
+// Writes the stream to a 16 bit WAV file with the channels of the stream, in
+// real time like the sound device by default
+class FileAudioBackend : public NullAudioBackend {
+public:
+    explicit FileAudioBackend(std::string fileName, bool isRealtime = true);
+    ~FileAudioBackend() override;
+
+    bool open(unsigned int sampleRate, unsigned int bufferFrames,
+              unsigned int nChannels, RtAudioCallback callback,
+              void *userData) override;
+    void close() override;
+    const char* getName() const override {
+        return "file";
+    }
+
+protected:
+    void write(const stk::StkFloat* samples, unsigned int nFrames) override;
+
+private:
+    std::string fileName;
+    stk::FileWvOut file;
+    // Buffer of the stream thread, allocated when the file is opened and
+    // resized for a buffer of another size
+    stk::StkFrames frames;
+};
+
+
+#endif //MANYLANDS_AUDIOBACKEND_H
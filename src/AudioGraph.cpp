@@ -0,0 +1,156 @@
+//
+// Block processing graph of the audio stream.
+//
+
+#include "AudioGraph.h"
+#include "VoicePool.h"
+
+#include <algorithm>
+#include <functional>
+
+
+int tickGraph(void *outputBuffer, void *inputBuffer, unsigned int nBufferFrames,
+              double streamTime, RtAudioStreamStatus status, void *dataPointer)
+{
+    auto *graph = (AudioGraph *) dataPointer;
+    graph->render((stk::StkFloat *) outputBuffer, nBufferFrames);
+    return 0;
+}
+
+void VoicesNode::process(stk::StkFrames& input, stk::StkFrames& output) {
+    voices->render(&output[0], (unsigned int) output.frames(),
+                   transport ? &transport->getBlock() : nullptr);
+}
+
+void MixNode::process(stk::StkFrames& input, stk::StkFrames& output) {
+    std::copy(&input[0], &input[0] + input.size(), &output[0]);
+}
+
+ReverbNode::ReverbNode() {
+    reverb.setEffectMix(1.0);
+}
+
+void ReverbNode::process(stk::StkFrames& input, stk::StkFrames& output) {
+    reverb.tick(input, output, 0, 0);
+}
+
+ChorusNode::ChorusNode() {
+    chorus.setModDepth(0.2);
+    chorus.setModFrequency(0.25);
+    chorus.setEffectMix(1.0);
+}
+
+void ChorusNode::process(stk::StkFrames& input, stk::StkFrames& output) {
+    // The chorus reads the left channel
+    for (unsigned int i = 0; i < input.frames(); i++) {
+        input(i, 0) = 0.5 * (input(i, 0) + input(i, 1));
+    }
+    chorus.tick(input, output, 0, 0);
+}
+
+int AudioGraph::addNode(std::unique_ptr<AudioNode> node) {
+    nodes.push_back(std::move(node));
+    return (int) nodes.size() - 1;
+}
+
+int AudioGraph::connect(int from, int to, float gain) {
+    connections.push_back(std::make_unique<Connection>());
+    Connection& connection = *connections.back();
+    connection.from = from;
+    connection.to = to;
+    connection.gain.store(gain);
+    return (int) connections.size() - 1;
+}
+
+void AudioGraph::setGain(int connection, float gain) {
+    connections[connection]->gain.store(gain, std::memory_order_relaxed);
+}
+
+void AudioGraph::setTransport(Transport* transport) {
+    this->transport = transport;
+}
+
+bool AudioGraph::compile(int output, unsigned int maxFrames) {
+    inputConnections.assign(nodes.size(), {});
+    for (auto& connection : connections) {
+        inputConnections[connection->to].push_back(connection.get());
+    }
+
+    // Depth first from the output, a node follows all of its inputs
+    enum Mark { NEW, VISITING, DONE };
+    std::vector<Mark> marks(nodes.size(), NEW);
+    order.clear();
+    std::function<bool(int)> visit = [&](int node) {
+        if (marks[node] == VISITING) {
+            return false;
+        }
+        if (marks[node] == NEW) {
+            marks[node] = VISITING;
+            for (const Connection* connection : inputConnections[node]) {
+                if (!visit(connection->from)) {
+                    return false;
+                }
+            }
+            marks[node] = DONE;
+            order.push_back(node);
+        }
+        return true;
+    };
+    if (!visit(output)) {
+        order.clear();
+        return false;
+    }
+
+    inputs.assign(nodes.size(), stk::StkFrames());
+    outputs.assign(nodes.size(), stk::StkFrames());
+    for (int node : order) {
+        inputs[node].resize(maxFrames, NO_OF_CHANNELS, 0.0);
+        outputs[node].resize(maxFrames, NO_OF_CHANNELS, 0.0);
+    }
+    outputNode = output;
+    this->maxFrames = maxFrames;
+    return true;
+}
+
+void AudioGraph::render(stk::StkFloat* out, unsigned int nFrames) {
+    if (order.empty()) {
+        std::fill(out, out + NO_OF_CHANNELS * nFrames, 0.0);
+        return;
+    }
+
+    for (unsigned int start = 0; start < nFrames; start += maxFrames) {
+        const unsigned int count = std::min(maxFrames, nFrames - start);
+        if (transport) {
+            transport->advance(count);
+        }
+        processBlock(count);
+        stk::StkFrames& block = outputs[outputNode];
+        std::copy(&block[0], &block[0] + block.size(),
+                  out + NO_OF_CHANNELS * start);
+    }
+}
+
+void AudioGraph::processBlock(unsigned int nFrames) {
+    for (int node : order) {
+        // Shrinking within the allocated size does not allocate
+        stk::StkFrames& input = inputs[node];
+        stk::StkFrames& output = outputs[node];
+        input.resize(nFrames, NO_OF_CHANNELS);
+        output.resize(nFrames, NO_OF_CHANNELS);
+
+        std::fill(&input[0], &input[0] + input.size(), 0.0);
+        for (const Connection* connection : inputConnections[node]) {
+            const stk::StkFloat gain =
+                    connection->gain.load(std::memory_order_relaxed);
+            if (gain == 0.0) {
+                continue;
+            }
+            const stk::StkFrames& source = outputs[connection->from];
+            for (size_t i = 0; i < input.size(); i++) {
+                input[i] += gain * source[i];
+            }
+        }
+
+        nodes[node]->process(input, output);
+    }
+}
@@ -0,0 +1,133 @@
+//
+// Block processing graph of the audio stream.
+//
+
+#ifndef MANYLANDS_AUDIOGRAPH_H
+#define MANYLANDS_AUDIOGRAPH_H
+
+#include "Chorus.h"
+#include "FreeVerb.h"
+#include "RtAudio.h"
+#include "Stk.h"
+#include "Transport.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class VoicePool;
+
+// Node of the graph. It processes a whole block of stereo frames at a time
+class AudioNode {
+public:
+    virtual ~AudioNode() = default;
+
+    // Writes the block to 'output'. 'input' holds the sum of the inputs of
+    // the node, it may be changed. Both have the frames of the block and must
+    // not be resized. Called by the audio callback, must not allocate or lock
+    virtual void process(stk::StkFrames& input, stk::StkFrames& output) = 0;
+};
+
+// The voices of the sonification, a source without inputs. With a transport
+// the voices play the block the graph has moved the transport on by
+class VoicesNode : public AudioNode {
+public:
+    explicit VoicesNode(VoicePool* voices, const Transport* transport = nullptr)
+            : voices(voices), transport(transport) {}
+    void process(stk::StkFrames& input, stk::StkFrames& output) override;
+
+private:
+    VoicePool* voices;
+    const Transport* transport;
+};
+
+// Passes the sum of its inputs on, for buses and the master
+class MixNode : public AudioNode {
+public:
+    void process(stk::StkFrames& input, stk::StkFrames& output) override;
+};
+
+// Wet signal of a stk::FreeVerb, for a send
+class ReverbNode : public AudioNode {
+public:
+    ReverbNode();
+    void process(stk::StkFrames& input, stk::StkFrames& output) override;
+
+private:
+    stk::FreeVerb reverb;
+};
+
+// Wet signal of a stk::Chorus on the mono sum of the input, for a send
+class ChorusNode : public AudioNode {
+public:
+    ChorusNode();
+    void process(stk::StkFrames& input, stk::StkFrames& output) override;
+
+private:
+    stk::Chorus chorus;
+};
+
+// Nodes connected by gains, for example
+//
+//   voices -> master
+//   voices -> reverb -> master
+//
+// The nodes and connections are set up by the UI thread before the stream is
+// opened. compile() sorts the nodes that feed the output in topological order
+// and allocates a stereo input and output buffer per node. The audio callback
+// then runs the nodes one after another, every node processes the whole block
+// in one call. Only the gains of the connections change while the stream
+// runs, they are handed over through atomics.
+class AudioGraph {
+public:
+    static const unsigned int NO_OF_CHANNELS = 2;
+
+    // Returns the id of the node
+    int addNode(std::unique_ptr<AudioNode> node);
+    // Adds the output of 'from' to the input of 'to'. Returns the id of the
+    // connection
+    int connect(int from, int to, float gain = 1.0f);
+    // May be called while the stream runs
+    void setGain(int connection, float gain);
+
+    // The graph moves the transport on at the start of every block. Must not
+    // be called while the stream runs
+    void setTransport(Transport* transport);
+
+    // Prepares the nodes that 'output' depends on for blocks of up to
+    // maxFrames. Returns false if the connections form a cycle
+    bool compile(int output, unsigned int maxFrames);
+
+    // Called by the audio callback, renders nFrames interleaved stereo frames
+    // of the output node. Longer blocks are split
+    void render(stk::StkFloat* out, unsigned int nFrames);
+
+private:
+    struct Connection {
+        int from;
+        int to;
+        std::atomic<float> gain;
+    };
+
+    void processBlock(unsigned int nFrames);
+
+    std::vector<std::unique_ptr<AudioNode>> nodes;
+    std::vector<std::unique_ptr<Connection>> connections;
+
+    // Set by compile()
+    std::vector<int> order;
+    // Connections into each node
+    std::vector<std::vector<const Connection*>> inputConnections;
+    std::vector<stk::StkFrames> inputs;
+    std::vector<stk::StkFrames> outputs;
+    int outputNode = -1;
+    unsigned int maxFrames = 0;
+    Transport* transport = nullptr;
+};
+
+// RtAudio callback, renders nBufferFrames stereo frames of the AudioGraph
+int tickGraph(void *outputBuffer, void *inputBuffer, unsigned int nBufferFrames,
+              double streamTime, RtAudioStreamStatus status, void *dataPointer);
+
+
+#endif //MANYLANDS_AUDIOGRAPH_H
@@ -0,0 +1,100 @@
+//
+// Sonification of a whole curve, rendered faster than real time.
+//
+
+#include "AudioRenderer.h"
+
+#include "ADSR.h"
+#include "FileWvOut.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+
+
+void setFrequencyFromCurve(TickData& data, Curve& curve,
+                           Scene_state::SonificationData source, float time) {
+    const Curve_stats& stats = curve.get_stats();
+    if (source == Scene_state::SonificationData::SPEED) {
+        data.setFundamentalFrequencyFromSpeed(
+                curve.get_interpolated_speed_at(time),
+                stats.min_speed, stats.max_speed);
+    } else if (source == Scene_state::SonificationData::ACC) {
+        data.setFundamentalFrequencyFromSpeed(
+                curve.get_interpolated_acceleration_at(time),
+                stats.min_acceleration, stats.max_acceleration);
+    }
+}
+
+void AudioRenderer::render(const TickData& instrument, Curve& curve,
+                           const MappingSpec& mapping, double duration,
+                           std::vector<stk::StkFloat>& samples) {
+    const unsigned int blockSize = stk::RT_BUFFER_SIZE;
+    const double blocksPerSecond = stk::Stk::sampleRate() / blockSize;
+    const size_t curveBlocks = std::max<size_t>(
+            1, (size_t) std::ceil(duration * blocksPerSecond));
+    const size_t maxBlocks = curveBlocks
+            + (size_t) std::ceil(MAX_RELEASE_SECONDS * blocksPerSecond);
+
+    // The partials start in phase, like after initSines(). The curve ends
+    // with the last block of the gate
+    TickData state;
+    state.copyFrom(instrument);
+    state.initSines(instrument.oscillators.size());
+    state.setControlCurve(compileMapping(curve, mapping));
+    state.seek(0.0);
+    state.setPlaybackSpeed(blocksPerSecond / curveBlocks);
+
+    // Serial pass, the chunk states are created on this thread because the
+    // STK objects register themselves in a global list
+    size_t noOfBlocks = 0;
+    std::vector<std::unique_ptr<TickData>> chunkStates;
+    for (size_t block = 0; block < maxBlocks; block++) {
+        const bool gate = block < curveBlocks;
+        if (!gate && state.isSilent()) {
+            break;
+        }
+
+        if (block % CHUNK_BLOCKS == 0) {
+            chunkStates.push_back(std::make_unique<TickData>());
+            chunkStates.back()->copyFrom(state);
+        }
+
+        state.setGate(gate);
+        state.advance(blockSize);
+        noOfBlocks++;
+    }
+
+    samples.assign(noOfBlocks * blockSize, 0.0);
+    pool.parallel_for(chunkStates.size(), [&](size_t chunk) {
+        TickData& data = *chunkStates[chunk];
+        const size_t first = chunk * CHUNK_BLOCKS;
+        const size_t last = std::min(first + CHUNK_BLOCKS, noOfBlocks);
+        for (size_t block = first; block < last; block++) {
+            data.setGate(block < curveBlocks);
+            tick(&samples[block * blockSize], nullptr, blockSize, 0.0, 0,
+                 &data);
+        }
+    });
+}
+
+bool AudioRenderer::renderToFile(const TickData& instrument, Curve& curve,
+                                 const MappingSpec& mapping, double duration,
+                                 const std::string& fileName) {
+    std::vector<stk::StkFloat> samples;
+    render(instrument, curve, mapping, duration, samples);
+
+    try {
+        stk::FileWvOut file(fileName, 1, stk::FileWrite::FILE_WAV,
+                            stk::Stk::STK_SINT16);
+        for (stk::StkFloat sample : samples) {
+            file.tick(sample);
+        }
+    } catch (stk::StkError& error) {
+        std::cout << error.getMessage() << std::endl;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,63 @@
+//
+// Sonification of a whole curve, rendered faster than real time.
+//
+
+#ifndef MANYLANDS_AUDIORENDERER_H
+#define MANYLANDS_AUDIORENDERER_H
+
+#include "Audio.h"
+#include "Curve.h"
+#include "Scene_state.h"
+#include "SonificationMapping.h"
+#include "Thread_pool.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Sets the fundamental frequency of 'data' from the sonified value of the
+// curve at 'time', for the frequencies sent over OSC
+void setFrequencyFromCurve(TickData& data, Curve& curve,
+                           Scene_state::SonificationData source, float time);
+
+// Renders the sonification of a curve without an audio device, for example
+// to write it to a WAV file. The curve is played from start to end in the
+// given duration, the samples are produced by the same tick() and compiled
+// mapping as the player.
+//
+// The render is split into chunks of CHUNK_BLOCKS blocks. A serial pass
+// advances a copy of the instrument without rendering, which gives the state
+// of the envelope, the oscillators and the playback at the start of every
+// chunk. Then the chunks are rendered in parallel. The chunks do not depend on
+// the number of threads, the result is the same as rendering the blocks one
+// after another.
+class AudioRenderer {
+public:
+    static const unsigned int CHUNK_BLOCKS = 64;
+    // The release is cut off after that
+    static constexpr double MAX_RELEASE_SECONDS = 10.0;
+
+    // Uses one thread per core
+    AudioRenderer() = default;
+    explicit AudioRenderer(unsigned int noOfWorkers) : pool(noOfWorkers) {}
+
+    // Renders 'duration' seconds of the curve, the release of the envelope
+    // and the ringing of the resonators into 'samples'. 'instrument' provides
+    // the overtones, the scaler, the frequency range and the envelope, it is
+    // not changed and must not be used by a running stream
+    void render(const TickData& instrument, Curve& curve,
+                const MappingSpec& mapping, double duration,
+                std::vector<stk::StkFloat>& samples);
+
+    // Renders like render() and writes a mono 16 bit WAV file. Returns false
+    // if the file cannot be written
+    bool renderToFile(const TickData& instrument, Curve& curve,
+                      const MappingSpec& mapping, double duration,
+                      const std::string& fileName);
+
+private:
+    Thread_pool pool;
+};
+
+
+#endif //MANYLANDS_AUDIORENDERER_H
@@ -4,8 +4,11 @@
 // Base_renderer
 //******************************************************************************
 
-Base_renderer::Base_renderer()
+Base_renderer::Base_renderer(std::uint32_t view_flag)
     : region_(0.f, 0.f, 0.f, 0.f)
+    , display_scale_x_(1.f)
+    , display_scale_y_(1.f)
+    , view_flag_(view_flag)
 {
 }
 
@@ -26,6 +29,17 @@ void Base_renderer::set_redering_region(Region region,
                                         float scale_x,
                                         float scale_y)
 {
+    if(region.left()   != region_.left()   ||
+       region.bottom() != region_.bottom() ||
+       region.right()  != region_.right()  ||
+       region.top()    != region_.top()    ||
+       scale_x != display_scale_x_ ||
+       scale_y != display_scale_y_)
+    {
+        if(state_)
+            state_->mark_dirty(view_flag_);
+    }
+
     region_ = region;
     display_scale_x_ = scale_x;
     display_scale_y_ = scale_y;
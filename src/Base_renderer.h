@@ -35,17 +35,21 @@ public:
             : mouse_pos(0.f, 0.f)
             , mouse_move(0.f, 0.f)
             , mouse_down(false)
+            , right_mouse_down(false)
             , mouse_wheel(0.f)
+            , key_shift(false)
         { }
 
         glm::vec2 mouse_pos;
         glm::vec2 mouse_move;
         bool      mouse_down;
+        bool      right_mouse_down;
         bool      mouse_up;
         bool      mouse_wheel;
         float     mouse_wheel_y;
 
         bool key_pressed;
+        bool key_shift;
         Key key;
     };
 
@@ -102,7 +106,10 @@ public:
         float left_, bottom_, right_, top_;
     };
 
-    Base_renderer();
+    // 'view_flag' is the dirty flag of the settings, the region and the input
+    // of the renderer
+    explicit Base_renderer(
+        std::uint32_t view_flag = Scene_state::Dirty_view);
 
     virtual void set_state(std::shared_ptr<Scene_state> state);
     virtual void set_redering_region(Region region,
@@ -115,4 +122,5 @@ protected:
     std::shared_ptr<Scene_state> state_;
     Region region_;
     float display_scale_x_, display_scale_y_;
+    const std::uint32_t view_flag_;
 };
@@ -131,6 +131,24 @@ float Curve::t_duration() const
     return (t_max() - t_min());
 }
 
+//******************************************************************************
+// get_index_range
+//******************************************************************************
+
+std::pair<size_t, size_t>
+Curve::get_index_range(const Curve_selection& selection) const
+{
+    // We assume that points are already sorted by the time stamp value
+    const auto first = std::lower_bound(
+        time_stamp_.begin(), time_stamp_.end(), selection.t_start);
+    const auto last = std::upper_bound(
+        first, time_stamp_.end(), selection.t_end);
+
+    return std::make_pair(
+        static_cast<size_t>(first - time_stamp_.begin()),
+        static_cast<size_t>(last - time_stamp_.begin()));
+}
+
 //******************************************************************************
 // get_simpified_curve
 //
@@ -189,7 +207,7 @@ void Curve::update_stats(float kernel_size, float max_movement, float max_value)
 // get_stats
 //******************************************************************************
 
-const Curve_stats& Curve::get_stats()
+const Curve_stats& Curve::get_stats() const
 {
     return stats_;
 }
@@ -460,7 +478,7 @@ Curve::get_markers(const Curve_selection& selection)
 
 float Curve::get_interpolated_speed_at(float time) {
     int idx = this->get_index(time);
-    auto speeds = this->get_stats().speed;
+    const auto& speeds = this->get_stats().speed;
     auto timeStampCurr = this->time_stamp()[idx];
     auto timeStampNext = this->time_stamp()[(idx+1) % this->time_stamp().size()];
     auto currSpeed = speeds[idx];
@@ -471,7 +489,7 @@ float Curve::get_interpolated_speed_at(float time) {
 
 float Curve::get_interpolated_acceleration_at(float time) {
 
-    auto accs = this->get_stats().acceleration;
+    const auto& accs = this->get_stats().acceleration;
 
     int idx = this->get_index(time);
     auto timeStampCurr = this->time_stamp()[idx];
@@ -484,7 +502,7 @@ float Curve::get_interpolated_acceleration_at(float time) {
 
 std::basic_string<char> Curve::get_dimensionality_at(float time) {
     int idx = this->get_index(time);
-    auto dimens = this->get_stats().dimensionality;
+    const auto& dimens = this->get_stats().dimensionality;
     return dimens[idx];
 }
 
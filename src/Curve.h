@@ -9,6 +9,7 @@
 #include "boost/tuple/tuple.hpp"
 #include <boost/numeric/ublas/vector.hpp>
 // std
+#include <utility>
 #include <vector>
 
 class Curve : public Scene_wireframe_object
@@ -18,13 +19,16 @@ public:
 
     void add_point(Scene_vertex_t vertex, float time);
     Scene_vertex_t get_point(float time);
-    int Curve::get_index(float time);
+    int get_index(float time);
 
     // Timestamp-related functions
     const std::vector<float>& time_stamp() const;
     float t_min() const;
     float t_max() const;
     float t_duration() const;
+    // Range [first, last) of the points with time stamps in the selection
+    std::pair<size_t, size_t> get_index_range(
+        const Curve_selection& selection) const;
 
     Curve get_simpified_curve(const float max_deviation);
 
@@ -32,7 +36,7 @@ public:
         float kernel_size,
         float max_movement,
         float max_value);
-    const Curve_stats& get_stats();
+    const Curve_stats& get_stats() const;
 
     std::vector<Curve_annotations> get_arrows(const Curve_selection& selection);
     std::vector<Scene_vertex_t> get_markers(const Curve_selection& selection);
@@ -0,0 +1,206 @@
+#include "Curve_pyramid.h"
+// std
+#include <algorithm>
+#include <cmath>
+
+//******************************************************************************
+// Curve_pyramid
+//******************************************************************************
+
+Curve_pyramid::Curve_pyramid(const Curve& curve)
+    : time_(curve.time_stamp())
+{
+    const size_t n = time_.size();
+
+    for(size_t d = 0; d < Num_dims; ++d)
+    {
+        auto& values = values_[d];
+        values.resize(n);
+        for(size_t i = 0; i < n; ++i)
+            values[i] = static_cast<float>(curve.vertices()[i](d));
+
+        auto merge = [&values](Bucket& dst, const Bucket& src) {
+            if(values[src.min] < values[dst.min]) dst.min = src.min;
+            if(values[src.max] > values[dst.max]) dst.max = src.max;
+        };
+
+        // The finest level is built from the samples
+        std::vector<Bucket> level((n + Base_bucket - 1) / Base_bucket);
+        for(size_t b = 0; b < level.size(); ++b)
+        {
+            const auto first = static_cast<std::uint32_t>(b * Base_bucket);
+            level[b] = {first, first};
+            const size_t last = std::min(n, (b + 1) * Base_bucket);
+            for(auto i = first + 1; i < last; ++i)
+                merge(level[b], {i, i});
+        }
+
+        // Coarser levels are built from the previous ones
+        while(level.size() > 1)
+        {
+            std::vector<Bucket> next((level.size() + Branching - 1) / Branching);
+            for(size_t b = 0; b < next.size(); ++b)
+            {
+                next[b] = level[b * Branching];
+                const size_t last = std::min(level.size(), (b + 1) * Branching);
+                for(size_t i = b * Branching + 1; i < last; ++i)
+                    merge(next[b], level[i]);
+            }
+            levels_[d].push_back(std::move(level));
+            level = std::move(next);
+        }
+        levels_[d].push_back(std::move(level));
+    }
+}
+
+//******************************************************************************
+// size
+//******************************************************************************
+
+size_t Curve_pyramid::size() const
+{
+    return time_.size();
+}
+
+//******************************************************************************
+// decimate
+//******************************************************************************
+
+void Curve_pyramid::decimate(
+    size_t dim,
+    float t_start,
+    float t_end,
+    size_t columns,
+    std::vector<Point>& out) const
+{
+    if(time_.empty() || columns == 0 || t_end <= t_start || dim >= Num_dims)
+        return;
+
+    // Visible samples plus one sample on each side
+    size_t first = std::lower_bound(time_.begin(), time_.end(), t_start) -
+                   time_.begin();
+    size_t last = std::upper_bound(time_.begin(), time_.end(), t_end) -
+                  time_.begin();
+    if(first > 0) --first;
+    if(last < time_.size()) ++last;
+    if(first >= last)
+        return;
+
+    const double col_scale = columns / static_cast<double>(t_end - t_start);
+    auto column_of = [&](size_t i) {
+        return static_cast<long long>(
+            std::floor((time_[i] - t_start) * col_scale));
+    };
+
+    // Choose the coarsest level with at least two buckets per column
+    const double samples_per_column =
+        static_cast<double>(last - first) / columns;
+    int level = -1;
+    size_t bucket_size = 1;
+    while(level + 1 < static_cast<int>(levels_[dim].size()))
+    {
+        const size_t next_size =
+            level < 0 ? Base_bucket : bucket_size * Branching;
+        if(2 * next_size > samples_per_column)
+            break;
+        bucket_size = next_size;
+        ++level;
+    }
+
+    Column col = {column_of(first), first, first, first, first};
+
+    auto add_sample = [&](size_t i) {
+        add_to_column(dim, col, column_of(i), i, i, i, i, out);
+    };
+
+    if(level < 0)
+    {
+        for(size_t i = first + 1; i < last; ++i)
+            add_sample(i);
+    }
+    else
+    {
+        // Samples up to the first whole bucket, the whole buckets and the
+        // remaining samples
+        const size_t b_first = (first + bucket_size) / bucket_size;
+        const size_t b_last = last / bucket_size;
+
+        if(b_first >= b_last)
+        {
+            for(size_t i = first + 1; i < last; ++i)
+                add_sample(i);
+        }
+        else
+        {
+            for(size_t i = first + 1; i < b_first * bucket_size; ++i)
+                add_sample(i);
+
+            const auto& buckets = levels_[dim][level];
+            for(size_t b = b_first; b < b_last; ++b)
+            {
+                const size_t b_start = b * bucket_size;
+                add_to_column(
+                    dim,
+                    col,
+                    column_of(b_start),
+                    b_start,
+                    b_start + bucket_size - 1,
+                    buckets[b].min,
+                    buckets[b].max,
+                    out);
+            }
+
+            for(size_t i = b_last * bucket_size; i < last; ++i)
+                add_sample(i);
+        }
+    }
+
+    flush_column(dim, col, out);
+}
+
+//******************************************************************************
+// add_to_column
+//******************************************************************************
+
+void Curve_pyramid::add_to_column(
+    size_t dim,
+    Column& col,
+    long long col_index,
+    size_t first,
+    size_t last,
+    size_t min,
+    size_t max,
+    std::vector<Point>& out) const
+{
+    if(col_index != col.index)
+    {
+        flush_column(dim, col, out);
+        col = {col_index, first, last, min, max};
+        return;
+    }
+
+    const auto& values = values_[dim];
+    col.last = last;
+    if(values[min] < values[col.min]) col.min = min;
+    if(values[max] > values[col.max]) col.max = max;
+}
+
+//******************************************************************************
+// flush_column
+//******************************************************************************
+
+void Curve_pyramid::flush_column(
+    size_t dim,
+    const Column& col,
+    std::vector<Point>& out) const
+{
+    size_t inds[4] = {col.first, col.min, col.max, col.last};
+    std::sort(inds, inds + 4);
+
+    for(size_t i = 0; i < 4; ++i)
+    {
+        if(i > 0 && inds[i] == inds[i - 1])
+            continue;
+        out.push_back({time_[inds[i]], values_[dim][inds[i]]});
+    }
+}
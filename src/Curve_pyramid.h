@@ -0,0 +1,80 @@
+#pragma once
+
+// Local
+#include "Curve.h"
+// std
+#include <cstdint>
+#include <vector>
+
+//******************************************************************************
+// Curve_pyramid
+//
+// Min/max decimation pyramid of the X, Y, Z and W coordinates of a curve. The
+// finest level groups 'Base_bucket' samples, every next level groups
+// 'Branching' buckets of the previous one. For every bucket the indices of the
+// minimum and the maximum sample are stored.
+//
+// 'decimate' implements the M4 aggregation: for every pixel column it returns
+// the first, the minimum, the maximum and the last sample. A bucket that
+// straddles a column boundary counts to the column of its first sample, so
+// an extreme may be drawn up to one column off. Otherwise the polyline
+// matches the full one and its size depends only on the number of columns.
+//******************************************************************************
+
+class Curve_pyramid
+{
+public:
+    struct Point
+    {
+        float t, value;
+    };
+
+    explicit Curve_pyramid(const Curve& curve);
+
+    // Appends points of the dimension 'dim' in [t_start, t_end] to 'out'. One
+    // sample before and one after the range are added to reach the borders
+    void decimate(
+        size_t dim,
+        float t_start,
+        float t_end,
+        size_t columns,
+        std::vector<Point>& out) const;
+
+    size_t size() const;
+
+private:
+    static const size_t Num_dims = 4,
+                        Base_bucket = 8,
+                        Branching = 4;
+
+    struct Bucket
+    {
+        std::uint32_t min, max;
+    };
+
+    // The aggregated column of the M4 algorithm
+    struct Column
+    {
+        long long index;
+        size_t first, last, min, max;
+    };
+
+    void add_to_column(
+        size_t dim,
+        Column& col,
+        long long col_index,
+        size_t first,
+        size_t last,
+        size_t min,
+        size_t max,
+        std::vector<Point>& out) const;
+    void flush_column(
+        size_t dim,
+        const Column& col,
+        std::vector<Point>& out) const;
+
+    std::vector<float> time_;
+    std::vector<float> values_[Num_dims];
+    // levels_[dim][level][bucket]
+    std::vector<std::vector<Bucket>> levels_[Num_dims];
+};
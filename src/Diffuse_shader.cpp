@@ -1,6 +1,14 @@
 #include "Diffuse_shader.h"
 // glm
 #include <glm/glm.hpp>
+// std
+#include <cmath>
+#include <cstddef>
+
+static_assert(sizeof(Diffuse_shader::Data_array) == 20,
+              "The vertex format is expected to be tightly packed");
+static_assert(sizeof(Diffuse_shader::Hyper_array) == 60,
+              "The vertex format is expected to be tightly packed");
 
 //******************************************************************************
 // initialize
@@ -8,7 +16,7 @@
 
 void Diffuse_shader::initialize()
 {
-#ifdef __EMSCRIPTEN__
+#if defined(__EMSCRIPTEN__) || defined(MANYLANDS_HEADLESS)
     program_id = load_shaders(
         "assets/Diffuse_ES.vert",
         "assets/Diffuse_ES.frag");
@@ -25,9 +33,64 @@ void Diffuse_shader::initialize()
     light_pos_id  = glGetUniformLocation(program_id,    "lightPos");
     fog_range_id  = glGetUniformLocation(program_id,    "fogRange");
 
+    hyper_mode_id      = glGetUniformLocation(program_id,     "hyperMode");
+    hyper_matrix_id    = glGetUniformLocation(program_id,   "hyperMatrix");
+    hyper_column_id    = glGetUniformLocation(program_id,   "hyperColumn");
+    hyper_offset_id    = glGetUniformLocation(program_id,   "hyperOffset");
+    hyper_w_row_id     = glGetUniformLocation(program_id,     "hyperWRow");
+    hyper_corner_id    = glGetUniformLocation(program_id,   "hyperCorner");
+    hyper_thickness_id = glGetUniformLocation(program_id,"hyperThickness");
+    hyper_post_matrix_id =
+        glGetUniformLocation(program_id, "hyperPostMatrix");
+    hyper_opacity_id   = glGetUniformLocation(program_id,  "hyperOpacity");
+
     vertex_attrib_id = glGetAttribLocation(program_id, "vertex");
     normal_attrib_id = glGetAttribLocation(program_id, "normal");
     color_attrib_id  = glGetAttribLocation(program_id,  "color");
+
+    hyper_point_attrib_id = glGetAttribLocation(program_id, "hyperPoint");
+    hyper_other_attrib_id = glGetAttribLocation(program_id, "hyperOther");
+    hyper_joint_attrib_id = glGetAttribLocation(program_id, "hyperJoint");
+    hyper_ring_attrib_id  = glGetAttribLocation(program_id,  "hyperRing");
+}
+
+//******************************************************************************
+// pack_normal
+//
+// Octahedral encoding, the inverse is implemented in the vertex shader
+//******************************************************************************
+
+glm::i16vec2 Diffuse_shader::pack_normal(const glm::vec3& n)
+{
+    auto sign_not_zero = [](float v) { return v >= 0.f ? 1.f : -1.f; };
+
+    glm::vec2 p = glm::vec2(n.x, n.y) /
+                  (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+    if(n.z < 0.f)
+    {
+        p = glm::vec2((1.f - std::abs(p.y)) * sign_not_zero(p.x),
+                      (1.f - std::abs(p.x)) * sign_not_zero(p.y));
+    }
+
+    return glm::i16vec2(glm::round(glm::clamp(p, -1.f, 1.f) * 32767.f));
+}
+
+//******************************************************************************
+// pack_direction
+//******************************************************************************
+
+glm::i16vec4 Diffuse_shader::pack_direction(const glm::vec4& d)
+{
+    return glm::i16vec4(glm::round(glm::clamp(d, -1.f, 1.f) * 32767.f));
+}
+
+//******************************************************************************
+// pack_color
+//******************************************************************************
+
+glm::u8vec4 Diffuse_shader::pack_color(const glm::vec4& c)
+{
+    return glm::u8vec4(glm::round(glm::clamp(c, 0.f, 1.f) * 255.f));
 }
 
 //******************************************************************************
@@ -41,61 +104,26 @@ void Diffuse_shader::append_to_geometry(Mesh_geometry& geom, const Mesh& m)
     for(size_t i = 0; i < m.objects.size(); ++i)
     {
         const auto& obj = m.objects[i];
-        const auto& c = m.colors[i];
+        const auto c = pack_color(m.colors[i]);
 
         for(auto const& f : obj.faces)
         {
             size_t num_verts = f.size();
             size_t num_triangles = num_verts - 2;
 
-            for(size_t i = 0; i < num_triangles; ++i)
+            // Every face gets its own vertices, the face is triangulated as a
+            // fan around the first vertex
+            for(auto const& v : f)
             {
-                if(i == 0)
-                {
-                    // If the current triangle is first in the face we add three
-                    // pairs of vertices and normals to the array
-
-                    // Vertex 1
-                    {
-                        Data_array vnc;
-                        vnc.vert = glm::vec4(m.vertices[f[0].vertex_id], 1);
-                        vnc.norm = m.normals[f[0].normal_id];
-                        vnc.color = c;
-                        geom.data_array.push_back(vnc);
-                    }
-                    // Vertex 2
-                    {
-                        Data_array vnc;
-                        vnc.vert = glm::vec4(m.vertices[f[i + 1].vertex_id], 1);
-                        vnc.norm = m.normals[f[i + 1].normal_id];
-                        vnc.color = c;
-                        geom.data_array.push_back(vnc);
-                    }
-                    // Vertex 3
-                    {
-                        Data_array vnc;
-                        vnc.vert = glm::vec4(m.vertices[f[i + 2].vertex_id], 1);
-                        vnc.norm = m.normals[f[i + 2].normal_id];
-                        vnc.color = c;
-                        geom.data_array.push_back(vnc);
-                    }
-                }
-                else
-                {
-                    // If the current triangle is not the first in the face it
-                    // is enough to add only the one pair of vertices and
-                    // normals to the array
-
-                    // Vertex 3
-                    {
-                        Data_array vnc;
-                        vnc.vert = glm::vec4(m.vertices[f[i + 2].vertex_id], 1);
-                        vnc.norm = m.normals[f[i + 2].normal_id];
-                        vnc.color = c;
-                        geom.data_array.push_back(vnc);
-                    }
-                }
+                Data_array vnc;
+                vnc.vert  = m.vertices[v.vertex_id];
+                vnc.norm  = pack_normal(m.normals[v.normal_id]);
+                vnc.color = c;
+                geom.data_array.push_back(vnc);
+            }
 
+            for(size_t i = 0; i < num_triangles; ++i)
+            {
                 geom.indices.push_back(static_cast<GLint>(ind        )); // Vertex 1
                 geom.indices.push_back(static_cast<GLint>(ind + i + 1)); // Vertex 2
                 geom.indices.push_back(static_cast<GLint>(ind + i + 2)); // Vertex 3
@@ -122,22 +150,22 @@ void Diffuse_shader::draw_geometry(
     glEnableVertexAttribArray(color_attrib_id );
 
     GLsizei stride = sizeof(Data_array);
-    void* ptr1 = reinterpret_cast<void*>(4 * sizeof(GLfloat));
-    void* ptr2 = reinterpret_cast<void*>(7 * sizeof(GLfloat));
+    void* ptr1 = reinterpret_cast<void*>(offsetof(Data_array, norm));
+    void* ptr2 = reinterpret_cast<void*>(offsetof(Data_array, color));
     glVertexAttribPointer(vertex_attrib_id,
-                          4,
+                          3,
                           GL_FLOAT,
                           GL_FALSE,
                           stride, 0);
     glVertexAttribPointer(normal_attrib_id,
-                          3,
-                          GL_FLOAT,
-                          GL_FALSE,
+                          2,
+                          GL_SHORT,
+                          GL_TRUE,
                           stride, ptr1);
     glVertexAttribPointer(color_attrib_id,
                           4,
-                          GL_FLOAT,
-                          GL_FALSE,
+                          GL_UNSIGNED_BYTE,
+                          GL_TRUE,
                           stride,
                           ptr2);
 
@@ -150,3 +178,68 @@ void Diffuse_shader::draw_geometry(
     glDisableVertexAttribArray(normal_attrib_id);
     glDisableVertexAttribArray(color_attrib_id );
 }
+
+//******************************************************************************
+// draw_hyper_geometry
+//******************************************************************************
+
+void Diffuse_shader::draw_hyper_geometry(
+    const std::unique_ptr<Hyper_geometry>& geom)
+{
+    glUniform1i(hyper_mode_id, 1);
+
+    glBindVertexArray(geom->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, geom->array_buff_id);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geom->index_buff_id);
+
+    const GLuint attribs[] = {hyper_point_attrib_id,
+                              hyper_other_attrib_id,
+                              hyper_joint_attrib_id,
+                              hyper_ring_attrib_id,
+                              color_attrib_id};
+    for(auto a : attribs)
+        glEnableVertexAttribArray(a);
+
+    GLsizei stride = sizeof(Hyper_array);
+    auto offset = [](size_t o) { return reinterpret_cast<void*>(o); };
+    glVertexAttribPointer(hyper_point_attrib_id,
+                          4,
+                          GL_FLOAT,
+                          GL_FALSE,
+                          stride,
+                          offset(offsetof(Hyper_array, point)));
+    glVertexAttribPointer(hyper_other_attrib_id,
+                          4,
+                          GL_FLOAT,
+                          GL_FALSE,
+                          stride,
+                          offset(offsetof(Hyper_array, other)));
+    glVertexAttribPointer(hyper_joint_attrib_id,
+                          4,
+                          GL_SHORT,
+                          GL_TRUE,
+                          stride,
+                          offset(offsetof(Hyper_array, joint)));
+    glVertexAttribPointer(hyper_ring_attrib_id,
+                          4,
+                          GL_FLOAT,
+                          GL_FALSE,
+                          stride,
+                          offset(offsetof(Hyper_array, ring)));
+    glVertexAttribPointer(color_attrib_id,
+                          4,
+                          GL_UNSIGNED_BYTE,
+                          GL_TRUE,
+                          stride,
+                          offset(offsetof(Hyper_array, color)));
+
+    glDrawElements(GL_TRIANGLES,
+                   static_cast<GLsizei>(geom->indices.size()),
+                   GL_UNSIGNED_INT,
+                   0);
+
+    for(auto a : attribs)
+        glDisableVertexAttribArray(a);
+
+    glUniform1i(hyper_mode_id, 0);
+}
@@ -4,25 +4,54 @@
 #include "Base_shader.h"
 #include "Geometry_engine.h"
 #include "Mesh.h"
+// glm
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 // sdl
 #include <memory>
 
 class Diffuse_shader : public Base_shader
 {
 public:
+    // Compact vertex format (20 bytes per vertex). The w-component of the
+    // position is implied to be 1, the normal is octahedral-encoded into two
+    // normalized shorts and the color is stored as normalized RGBA8
     struct Data_array
     {
-        glm::vec4 vert;
-        glm::vec3 norm;
-        glm::vec4 color;
+        glm::vec3    vert;
+        glm::i16vec2 norm;
+        glm::u8vec4  color;
     };
 
     typedef Geometry_engine<Data_array> Mesh_geometry;
 
+    // Vertex format of the tubes of the 4D curves (60 bytes per vertex). The
+    // tubes are built once around the unprojected segments, the vertex shader
+    // projects both ends of a segment and places the vertex on the ring
+    // around 'point'
+    struct Hyper_array
+    {
+        glm::vec4    point; // End of the segment
+        glm::vec4    other; // The other end of the segment
+        glm::i16vec4 joint; // Normalized direction of the curve at 'point'
+        // Cosine and sine of the angle on the ring, 1 at the end of the
+        // segment (0 at the start) and the fifth coordinate of the points
+        glm::vec4    ring;
+        glm::u8vec4  color;
+    };
+
+    typedef Geometry_engine<Hyper_array> Hyper_geometry;
+
+    static glm::i16vec2 pack_normal(const glm::vec3& n);
+    static glm::i16vec4 pack_direction(const glm::vec4& d);
+    static glm::u8vec4  pack_color(const glm::vec4& c);
+
     void initialize() override;
 
     void append_to_geometry(Mesh_geometry& geom, const Mesh& m);
     void draw_geometry(const std::unique_ptr<Mesh_geometry>& geom);
+    // The hyper uniforms have to be set before
+    void draw_hyper_geometry(const std::unique_ptr<Hyper_geometry>& geom);
 
     GLuint program_id,
            proj_mat_id,
@@ -32,5 +61,18 @@ public:
            vertex_attrib_id,
            normal_attrib_id,
            color_attrib_id,
-           fog_range_id;
+           fog_range_id,
+           hyper_mode_id,
+           hyper_matrix_id,
+           hyper_column_id,
+           hyper_offset_id,
+           hyper_w_row_id,
+           hyper_corner_id,
+           hyper_thickness_id,
+           hyper_post_matrix_id,
+           hyper_opacity_id,
+           hyper_point_attrib_id,
+           hyper_other_attrib_id,
+           hyper_joint_attrib_id,
+           hyper_ring_attrib_id;
 };
@@ -6,6 +6,8 @@
 #else
 #include <GL/gl3w.h>
 #endif
+// Local
+#include "Profiler.h"
 // std
 #include <vector>
 
@@ -25,6 +27,10 @@ public:
     ~Geometry_engine();
 
     void init_buffers();
+    // Uploads the arrays again to the same buffers, so a geometry can be
+    // rebuilt without creating new buffer objects. GL_STATIC_DRAW suits the
+    // geometry that is drawn many times before it is rebuilt
+    void update_buffers(GLenum usage = GL_DYNAMIC_DRAW);
 
     std::vector<TArray_data> data_array; // vertices + normals + colors
     std::vector<GLuint> indices;
@@ -83,6 +89,29 @@ void Geometry_engine<TArray_data>::init_buffers()
         GL_STATIC_DRAW);
 }
 
+template<class TArray_data>
+void Geometry_engine<TArray_data>::update_buffers(GLenum usage)
+{
+    PROFILE_SCOPE("Buffer upload");
+    Profiler::instance().add(
+        Profiler::Uploaded_bytes,
+        data_array.size() * sizeof(TArray_data) +
+        indices.size() * sizeof(GLuint));
+
+    glBindBuffer(GL_ARRAY_BUFFER, array_buff_id);
+    glBufferData(
+        GL_ARRAY_BUFFER,
+        data_array.size() * sizeof(TArray_data),
+        data_array.data(),
+        usage);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buff_id);
+    glBufferData(
+        GL_ELEMENT_ARRAY_BUFFER,
+        indices.size() * sizeof(GLuint),
+        indices.data(),
+        usage);
+}
+
 template<class TArray_data>
 Geometry_engine<TArray_data>::Geometry_engine(const Geometry_engine& other)
     : data_array(other.data_array)
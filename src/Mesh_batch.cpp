@@ -0,0 +1,86 @@
+#include "Mesh_batch.h"
+// Local
+#include "Profiler.h"
+// std
+#include <algorithm>
+
+//******************************************************************************
+// add
+//******************************************************************************
+
+void Mesh_batch::add(Task task)
+{
+    tasks_.push_back(std::move(task));
+}
+
+//******************************************************************************
+// empty
+//******************************************************************************
+
+bool Mesh_batch::empty() const
+{
+    return tasks_.empty();
+}
+
+//******************************************************************************
+// clear
+//******************************************************************************
+
+void Mesh_batch::clear()
+{
+    tasks_.clear();
+}
+
+//******************************************************************************
+// build
+//******************************************************************************
+
+void Mesh_batch::build(Diffuse_shader::Mesh_geometry& geom, Thread_pool& pool)
+{
+    const size_t num_tasks = tasks_.size();
+    if(num_tasks == 0)
+        return;
+
+    PROFILE_SCOPE("Mesh generation");
+
+    // Output and sizes of the tasks
+    if(outputs_.size() < num_tasks)
+        outputs_.resize(num_tasks);
+    vertex_offsets_.assign(num_tasks + 1, 0);
+    index_offsets_.assign(num_tasks + 1, 0);
+
+    pool.parallel_for(num_tasks, [this](size_t i) {
+        auto& output = outputs_[i];
+        output.vertices.clear();
+        output.indices.clear();
+        Mesh_emitter emitter(output.vertices, output.indices);
+        tasks_[i](emitter);
+        vertex_offsets_[i + 1] = output.vertices.size();
+        index_offsets_[i + 1] = output.indices.size();
+    });
+
+    // Offsets of the regions
+    vertex_offsets_[0] = geom.data_array.size();
+    index_offsets_[0] = geom.indices.size();
+    for(size_t i = 0; i < num_tasks; ++i)
+    {
+        vertex_offsets_[i + 1] += vertex_offsets_[i];
+        index_offsets_[i + 1] += index_offsets_[i];
+    }
+
+    geom.data_array.resize(vertex_offsets_.back());
+    geom.indices.resize(index_offsets_.back());
+
+    pool.parallel_for(num_tasks, [this, &geom](size_t i) {
+        const auto& output = outputs_[i];
+        std::copy(
+            output.vertices.begin(),
+            output.vertices.end(),
+            geom.data_array.begin() + vertex_offsets_[i]);
+
+        const auto first_vertex = static_cast<GLuint>(vertex_offsets_[i]);
+        auto index = geom.indices.begin() + index_offsets_[i];
+        for(GLuint output_index : output.indices)
+            *index++ = output_index + first_vertex;
+    });
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// Local
+#include "Diffuse_shader.h"
+#include "Mesh_emitter.h"
+#include "Thread_pool.h"
+// std
+#include <functional>
+#include <vector>
+
+//******************************************************************************
+// Mesh_batch
+//
+// Ordered list of mesh generation tasks. Every task is run once in parallel
+// into arrays of its own, then the geometry is resized once and the arrays are
+// copied to their regions of it in parallel, with the indices moved by the
+// first vertex of the region. The result is identical to running the tasks
+// serially in the order they were added.
+//******************************************************************************
+
+class Mesh_batch
+{
+public:
+    typedef std::function<void(Mesh_emitter&)> Task;
+
+    void add(Task task);
+    bool empty() const;
+    void clear();
+
+    // Appends the output of all tasks to the geometry
+    void build(Diffuse_shader::Mesh_geometry& geom, Thread_pool& pool);
+
+private:
+    // Output of a task, kept between the builds to reuse the memory
+    struct Task_output
+    {
+        std::vector<Mesh_emitter::Vertex> vertices;
+        std::vector<GLuint> indices;
+    };
+
+    std::vector<Task> tasks_;
+    std::vector<Task_output> outputs_;
+    std::vector<size_t> vertex_offsets_, index_offsets_;
+};
@@ -0,0 +1,416 @@
+#include "Mesh_emitter.h"
+// Local
+#include "Consts.h"
+// glm
+#include <glm/gtc/quaternion.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+// std
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+//******************************************************************************
+// Ring
+//
+// Precomputed sine and cosine values of 'n + 1' points evenly distributed over
+// an arc. The last point repeats the first one if the arc is a full circle
+//******************************************************************************
+
+struct Ring
+{
+    std::vector<float> cos, sin;
+};
+
+const unsigned int Max_cached_ring = 64;
+
+Ring make_ring(unsigned int n, double arc)
+{
+    Ring r;
+    r.cos.resize(n + 1);
+    r.sin.resize(n + 1);
+    for(unsigned int i = 0; i <= n; ++i)
+    {
+        const double angle = arc * i / n;
+        r.cos[i] = static_cast<float>(std::cos(angle));
+        r.sin[i] = static_cast<float>(std::sin(angle));
+    }
+    return r;
+}
+
+std::vector<Ring> make_ring_cache(double arc)
+{
+    std::vector<Ring> cache(Max_cached_ring + 1);
+    for(unsigned int n = 1; n <= Max_cached_ring; ++n)
+        cache[n] = make_ring(n, arc);
+    return cache;
+}
+
+//******************************************************************************
+// circle
+//******************************************************************************
+
+const Ring& circle(unsigned int n)
+{
+    // The static initialization is thread-safe and happens only once
+    static const std::vector<Ring> cache = make_ring_cache(2 * PI_);
+    if(n <= Max_cached_ring)
+        return cache[n];
+
+    thread_local Ring custom;
+    custom = make_ring(n, 2 * PI_);
+    return custom;
+}
+
+//******************************************************************************
+// half_circle
+//******************************************************************************
+
+const Ring& half_circle(unsigned int n)
+{
+    static const std::vector<Ring> cache = make_ring_cache(PI_);
+    if(n <= Max_cached_ring)
+        return cache[n];
+
+    thread_local Ring custom;
+    custom = make_ring(n, PI_);
+    return custom;
+}
+
+//******************************************************************************
+// tube_rotation
+//
+// Rotation that aligns the Z-axis with the direction of a tube
+//******************************************************************************
+
+glm::mat3 tube_rotation(const glm::vec3& norm_dir)
+{
+    const glm::vec3 up_vec(0.f, 0.f, 1.f);
+    return glm::toMat3(glm::rotation(up_vec, norm_dir));
+}
+} // namespace
+
+//******************************************************************************
+// Mesh_emitter
+//******************************************************************************
+
+Mesh_emitter::Mesh_emitter(
+    std::vector<Vertex>& vertices,
+    std::vector<GLuint>& indices)
+    : vertices_(&vertices)
+    , indices_(&indices)
+    , num_vertices_(0)
+    , num_indices_(0)
+{
+}
+
+//******************************************************************************
+// Mesh_emitter
+//******************************************************************************
+
+Mesh_emitter::Mesh_emitter(Diffuse_shader::Mesh_geometry& geom)
+    : Mesh_emitter(geom.data_array, geom.indices)
+{
+}
+
+//******************************************************************************
+// num_vertices
+//******************************************************************************
+
+size_t Mesh_emitter::num_vertices() const
+{
+    return num_vertices_;
+}
+
+//******************************************************************************
+// num_indices
+//******************************************************************************
+
+size_t Mesh_emitter::num_indices() const
+{
+    return num_indices_;
+}
+
+//******************************************************************************
+// cylinder_vertices
+//******************************************************************************
+
+size_t Mesh_emitter::cylinder_vertices(unsigned int num_verts)
+{
+    return 2 * (num_verts + 1);
+}
+
+//******************************************************************************
+// cylinder_indices
+//******************************************************************************
+
+size_t Mesh_emitter::cylinder_indices(unsigned int num_verts)
+{
+    return 6 * num_verts;
+}
+
+//******************************************************************************
+// sphere_vertices
+//******************************************************************************
+
+size_t Mesh_emitter::sphere_vertices(unsigned int segments, unsigned int rings)
+{
+    return (segments + 1) * (rings + 1);
+}
+
+//******************************************************************************
+// sphere_indices
+//******************************************************************************
+
+size_t Mesh_emitter::sphere_indices(unsigned int segments, unsigned int rings)
+{
+    return 6 * segments * rings;
+}
+
+//******************************************************************************
+// reserve
+//******************************************************************************
+
+void Mesh_emitter::reserve(size_t num_vertices, size_t num_indices)
+{
+    vertices_->reserve(vertices_->size() + num_vertices);
+    indices_->reserve(indices_->size() + num_indices);
+}
+
+//******************************************************************************
+// cylinder
+//******************************************************************************
+
+void Mesh_emitter::cylinder(
+    unsigned int num_verts,
+    float start_diameter,
+    float end_diameter,
+    const glm::vec3& start_point,
+    const glm::vec3& end_point,
+    const glm::vec4& color)
+{
+    assert(num_verts >= 3);
+
+    const auto dir = end_point - start_point;
+    const auto rotation = tube_rotation(glm::normalize(dir));
+    const auto end_center = start_point + rotation[2] * glm::length(dir);
+
+    const float start_rad = 0.5f * start_diameter,
+                end_rad   = 0.5f * end_diameter;
+
+    GLuint* ind;
+    GLuint first;
+    Vertex* v = allocate(
+        cylinder_vertices(num_verts),
+        cylinder_indices(num_verts),
+        ind,
+        first);
+
+    const auto packed_color = Diffuse_shader::pack_color(color);
+
+    const Ring& ring = circle(num_verts);
+    for(unsigned int i = 0; i < num_verts + 1; ++i)
+    {
+        const glm::vec3 normal =
+            rotation[0] * ring.cos[i] + rotation[1] * ring.sin[i];
+        const auto packed_normal = Diffuse_shader::pack_normal(normal);
+
+        v[0].vert  = start_point + start_rad * normal;
+        v[0].norm  = packed_normal;
+        v[0].color = packed_color;
+
+        v[1].vert  = end_center + end_rad * normal;
+        v[1].norm  = packed_normal;
+        v[1].color = packed_color;
+
+        v += 2;
+    }
+
+    cylinder_faces(num_verts, first, ind);
+}
+
+//******************************************************************************
+// cylinder_v2
+//
+// The cylinder ends are cut by the planes bisecting the joints with the
+// neighbouring segments
+//******************************************************************************
+
+void Mesh_emitter::cylinder_v2(
+    unsigned int num_verts,
+    float start_diameter,
+    float end_diameter,
+    const glm::vec3& start_point,
+    const glm::vec3& end_point,
+    const glm::vec3& start_dir,
+    const glm::vec3& end_dir,
+    const glm::vec4& color)
+{
+    assert(num_verts >= 3);
+
+    const auto dir = end_point - start_point;
+    const auto norm_dir = glm::normalize(dir);
+    // avoid very sharp angles
+    if(glm::dot(start_dir, norm_dir) < 0.1f ||
+       glm::dot(end_dir, norm_dir) < 0.1f)
+    {
+        cylinder(
+            num_verts,
+            start_diameter,
+            end_diameter,
+            start_point,
+            end_point,
+            color);
+        return;
+    }
+
+    const auto rotation = tube_rotation(norm_dir);
+    const auto end_center = start_point + rotation[2] * glm::length(dir);
+
+    const float start_rad = 0.5f * start_diameter,
+                end_rad   = 0.5f * end_diameter;
+
+    const float s_d = -glm::dot(start_dir, start_point);
+    const float e_d = -glm::dot(end_dir, end_point);
+
+    GLuint* ind;
+    GLuint first;
+    Vertex* v = allocate(
+        cylinder_vertices(num_verts),
+        cylinder_indices(num_verts),
+        ind,
+        first);
+
+    const auto packed_color = Diffuse_shader::pack_color(color);
+
+    const Ring& ring = circle(num_verts);
+    for(unsigned int i = 0; i < num_verts + 1; ++i)
+    {
+        const glm::vec3 normal =
+            rotation[0] * ring.cos[i] + rotation[1] * ring.sin[i];
+        const auto packed_normal = Diffuse_shader::pack_normal(normal);
+
+        // intersect ray with planes bisecting joints
+        // then adjust points to the intersection points
+        const glm::vec3 s = start_point + start_rad * normal;
+        const glm::vec3 e = end_center + end_rad * normal;
+        const glm::vec3 ray = e - s;
+        const float t_s =
+            -(glm::dot(start_dir, s) + s_d) / glm::dot(start_dir, ray);
+        const float t_e =
+            -(glm::dot(end_dir, s) + e_d) / glm::dot(end_dir, ray);
+
+        v[0].vert  = s + ray * t_s;
+        v[0].norm  = packed_normal;
+        v[0].color = packed_color;
+
+        v[1].vert  = s + ray * t_e;
+        v[1].norm  = packed_normal;
+        v[1].color = packed_color;
+
+        v += 2;
+    }
+
+    cylinder_faces(num_verts, first, ind);
+}
+
+//******************************************************************************
+// sphere
+//******************************************************************************
+
+void Mesh_emitter::sphere(
+    unsigned int segments,
+    unsigned int rings,
+    float diameter,
+    const glm::vec3& position,
+    const glm::vec4& color)
+{
+    GLuint* ind;
+    GLuint first;
+    Vertex* v = allocate(
+        sphere_vertices(segments, rings),
+        sphere_indices(segments, rings),
+        ind,
+        first);
+
+    const auto packed_color = Diffuse_shader::pack_color(color);
+
+    const Ring& alpha = half_circle(segments);
+    const Ring& betta = circle(rings);
+
+    for(unsigned int i = 0; i < segments + 1; ++i)
+    {
+        for(unsigned int j = 0; j < rings + 1; ++j)
+        {
+            const glm::vec3 normal(
+                alpha.sin[i] * betta.cos[j],
+                alpha.sin[i] * betta.sin[j],
+                alpha.cos[i]);
+
+            v->vert  = position + diameter * normal;
+            v->norm  = Diffuse_shader::pack_normal(normal);
+            v->color = packed_color;
+            ++v;
+        }
+    }
+
+    for(unsigned int i = 0; i < segments; ++i)
+    {
+        for(unsigned int j = 0; j < rings; ++j)
+        {
+            const GLuint v1 = first + i * (rings + 1) + j, // (i,     j    )
+                         v2 = v1 + 1,                      // (i,     j + 1)
+                         v3 = v1 + rings + 1,              // (i + 1, j    )
+                         v4 = v3 + 1;                      // (i + 1, j + 1)
+
+            ind[0] = v1; ind[1] = v2; ind[2] = v3;
+            ind[3] = v4; ind[4] = v3; ind[5] = v2;
+            ind += 6;
+        }
+    }
+}
+
+//******************************************************************************
+// allocate
+//******************************************************************************
+
+Mesh_emitter::Vertex* Mesh_emitter::allocate(
+    size_t num_vertices,
+    size_t num_indices,
+    GLuint*& out_indices,
+    GLuint& first_vert)
+{
+    first_vert = static_cast<GLuint>(vertices_->size());
+    vertices_->resize(vertices_->size() + num_vertices);
+
+    const size_t first_ind = indices_->size();
+    indices_->resize(first_ind + num_indices);
+
+    num_vertices_ += num_vertices;
+    num_indices_ += num_indices;
+
+    out_indices = indices_->data() + first_ind;
+    return vertices_->data() + first_vert;
+}
+
+//******************************************************************************
+// cylinder_faces
+//
+// Lower and upper ring vertices are interleaved
+//******************************************************************************
+
+void Mesh_emitter::cylinder_faces(
+    unsigned int num_verts,
+    GLuint first,
+    GLuint* ind)
+{
+    for(unsigned int i = 0; i < num_verts; ++i)
+    {
+        const GLuint shift = first + 2 * i;
+
+        ind[0] = shift;     ind[1] = shift + 2; ind[2] = shift + 1;
+        ind[3] = shift + 1; ind[4] = shift + 2; ind[5] = shift + 3;
+        ind += 6;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+// Local
+#include "Diffuse_shader.h"
+// glm
+#include <glm/glm.hpp>
+// std
+#include <vector>
+
+//******************************************************************************
+// Mesh_emitter
+//
+// Generates tubes and spheres directly into the vertex and index arrays used by
+// the Diffuse_shader. In contrast to Mesh_generator, no intermediate Mesh is
+// created and the vertices of a ring are shared between neighbouring faces.
+// The primitives are appended to the arrays of a geometry.
+//******************************************************************************
+
+class Mesh_emitter
+{
+public:
+    typedef Diffuse_shader::Data_array Vertex;
+
+    Mesh_emitter(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+    explicit Mesh_emitter(Diffuse_shader::Mesh_geometry& geom);
+
+    // Number of vertices and indices emitted so far
+    size_t num_vertices() const;
+    size_t num_indices() const;
+
+    // Sizes of the primitives, can be used to preallocate the arrays
+    static size_t cylinder_vertices(unsigned int num_verts);
+    static size_t cylinder_indices(unsigned int num_verts);
+    static size_t sphere_vertices(unsigned int segments, unsigned int rings);
+    static size_t sphere_indices(unsigned int segments, unsigned int rings);
+
+    void reserve(size_t num_vertices, size_t num_indices);
+
+    void cylinder(
+        unsigned int num_verts,
+        float start_diameter,
+        float end_diameter,
+        const glm::vec3& start_point,
+        const glm::vec3& end_point,
+        const glm::vec4& color);
+
+    void cylinder_v2(
+        unsigned int num_verts,
+        float start_diameter,
+        float end_diameter,
+        const glm::vec3& start_point,
+        const glm::vec3& end_point,
+        const glm::vec3& start_dir,
+        const glm::vec3& end_dir,
+        const glm::vec4& color);
+
+    void sphere(
+        unsigned int segments,
+        unsigned int rings,
+        float diameter,
+        const glm::vec3& position,
+        const glm::vec4& color);
+
+private:
+    // Grows the arrays and returns pointers to the new elements. The index of
+    // the first new vertex is returned via 'first_vert'
+    Vertex* allocate(
+        size_t num_vertices,
+        size_t num_indices,
+        GLuint*& out_indices,
+        GLuint& first_vert);
+
+    void cylinder_faces(unsigned int num_verts, GLuint first, GLuint* ind);
+
+    std::vector<Vertex>* vertices_;
+    std::vector<GLuint>* indices_;
+
+    size_t num_vertices_, num_indices_;
+};
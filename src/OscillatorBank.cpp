@@ -0,0 +1,139 @@
+//
+// Additive synthesis of many sine partials.
+//
+
+#include "OscillatorBank.h"
+
+#include <algorithm>
+#include <cmath>
+
+// std::min() takes the pass size by reference, so it needs a definition
+const unsigned int OscillatorBank::PASS_SIZE;
+
+namespace {
+
+// Sample index and triangular number of every sample of a pass. The phase of
+// sample i is phase + i * increment + i * (i + 1) / 2 * incrementStep
+struct PassRamps {
+    float index[OscillatorBank::PASS_SIZE];
+    float triangle[OscillatorBank::PASS_SIZE];
+
+    PassRamps() {
+        for (unsigned int i = 0; i < OscillatorBank::PASS_SIZE; i++) {
+            index[i] = (float) i;
+            triangle[i] = 0.5f * i * (i + 1);
+        }
+    }
+};
+
+const PassRamps RAMPS;
+
+// sin(2 pi p) for p in [0, 1). The argument is folded to the quarter cycle
+// [0, 0.25], where a Taylor series up to the 9th power is accurate to 4e-6.
+// The folding has no branches, so the loops calling it are vectorized
+inline float sinCycle(float p) {
+    // sin(2 pi p) = -sin(2 pi x), sin(2 pi |x|) = sin(2 pi (0.5 - |x|))
+    const float x = p - 0.5f;
+    const float ax = std::fabs(x);
+    const float a = std::min(ax, 0.5f - ax);
+
+    const float z = 6.28318531f * a;
+    const float z2 = z * z;
+    const float s = z * (1.0f + z2 * (-1.0f / 6.0f + z2 * (1.0f / 120.0f
+                  + z2 * (-1.0f / 5040.0f + z2 * (1.0f / 362880.0f)))));
+
+    return -std::copysign(s, x);
+}
+
+// Drops the whole cycles, the phase is never negative
+inline float wrap(float p) {
+    return p - (float) (int) p;
+}
+
+}
+
+void OscillatorBank::resize(int noOfPartials) {
+    phase.assign(noOfPartials, 0.0f);
+    increment.assign(noOfPartials, 0.0f);
+    targetIncrement.assign(noOfPartials, 0.0f);
+    incrementStep.assign(noOfPartials, 0.0f);
+    amplitude.assign(noOfPartials, 0.0f);
+    targetAmplitude.assign(noOfPartials, 0.0f);
+    amplitudeStep.assign(noOfPartials, 0.0f);
+}
+
+void OscillatorBank::setFrequency(int partial, stk::StkFloat frequency) {
+    targetIncrement[partial] = (float) (frequency / stk::Stk::sampleRate());
+}
+
+void OscillatorBank::setAmplitude(int partial, stk::StkFloat amplitude) {
+    targetAmplitude[partial] = (float) amplitude;
+}
+
+void OscillatorBank::reset() {
+    std::fill(phase.begin(), phase.end(), 0.0f);
+    std::copy(targetIncrement.begin(), targetIncrement.end(), increment.begin());
+    std::copy(targetAmplitude.begin(), targetAmplitude.end(), amplitude.begin());
+}
+
+void OscillatorBank::render(stk::StkFloat* out, unsigned int nFrames) {
+    process(out, nFrames);
+}
+
+void OscillatorBank::advance(unsigned int nFrames) {
+    process(nullptr, nFrames);
+}
+
+void OscillatorBank::process(stk::StkFloat* out, unsigned int nFrames) {
+    if (nFrames == 0) {
+        return;
+    }
+
+    const int noOfPartials = size();
+    const float invFrames = 1.0f / nFrames;
+    for (int k = 0; k < noOfPartials; k++) {
+        incrementStep[k] = (targetIncrement[k] - increment[k]) * invFrames;
+        amplitudeStep[k] = (targetAmplitude[k] - amplitude[k]) * invFrames;
+    }
+
+    for (unsigned int start = 0; start < nFrames; start += PASS_SIZE) {
+        const unsigned int count = std::min(PASS_SIZE, nFrames - start);
+        const float length = (float) count;
+        const float lengthTriangle = 0.5f * length * (length + 1.0f);
+
+        // A whole pass is always computed, the constant trip count lets the
+        // compiler vectorize the loop without a remainder
+        float mix[PASS_SIZE] = {};
+
+        for (int k = 0; k < noOfPartials; k++) {
+            const float p = phase[k];
+            const float inc = increment[k];
+            const float dInc = incrementStep[k];
+            const float a = amplitude[k];
+            const float dA = amplitudeStep[k];
+
+            // Silent partials keep their phase running
+            if (out && (a != 0.0f || dA != 0.0f)) {
+                for (unsigned int i = 0; i < PASS_SIZE; i++) {
+                    const float samplePhase = wrap(p
+                            + RAMPS.index[i] * inc
+                            + RAMPS.triangle[i] * dInc);
+                    mix[i] += (a + RAMPS.index[i] * dA)
+                            * sinCycle(samplePhase);
+                }
+            }
+
+            phase[k] = wrap(p + length * inc + lengthTriangle * dInc);
+            increment[k] = inc + length * dInc;
+            amplitude[k] = a + length * dA;
+        }
+
+        for (unsigned int i = 0; out && i < count; i++) {
+            out[start + i] += mix[i];
+        }
+    }
+
+    // The ramps end exactly at the targets
+    std::copy(targetIncrement.begin(), targetIncrement.end(), increment.begin());
+    std::copy(targetAmplitude.begin(), targetAmplitude.end(), amplitude.begin());
+}
@@ -0,0 +1,60 @@
+//
+// Additive synthesis of many sine partials.
+//
+
+#ifndef MANYLANDS_OSCILLATORBANK_H
+#define MANYLANDS_OSCILLATORBANK_H
+
+#include "Stk.h"
+
+#include <vector>
+
+// Bank of sine oscillators for the partials of the sonification. The state of
+// the partials is stored as structure of arrays and a block is rendered
+// partial by partial, so the compiler can vectorize the inner loop over the
+// samples. The sine is a polynomial, no table lookups are needed.
+//
+// Frequency and amplitude changes are ramped linearly over the next rendered
+// block, so the partials do not jump at block boundaries. Silent partials are
+// skipped.
+class OscillatorBank {
+public:
+    // Samples rendered per pass, the ramps are evaluated in closed form within
+    // a pass
+    static const unsigned int PASS_SIZE = 64;
+
+    // Allocates the partials, must not be called from the audio callback
+    void resize(int noOfPartials);
+    int size() const { return (int) phase.size(); }
+
+    // Targets reached at the end of the next rendered block. Frequencies are
+    // in Hz and must not be negative
+    void setFrequency(int partial, stk::StkFloat frequency);
+    void setAmplitude(int partial, stk::StkFloat amplitude);
+
+    // Jumps to the targets and resets the phases
+    void reset();
+
+    // Adds the sum of all partials to 'out'. Does not allocate or lock
+    void render(stk::StkFloat* out, unsigned int nFrames);
+
+    // Moves on by nFrames without rendering, the state is the same as after
+    // render()
+    void advance(unsigned int nFrames);
+
+private:
+    // Renders if 'out' is not null
+    void process(stk::StkFloat* out, unsigned int nFrames);
+
+    // Phase in cycles [0, 1), increment in cycles per sample
+    std::vector<float> phase;
+    std::vector<float> increment;
+    std::vector<float> targetIncrement;
+    std::vector<float> incrementStep;
+    std::vector<float> amplitude;
+    std::vector<float> targetAmplitude;
+    std::vector<float> amplitudeStep;
+};
+
+
+#endif //MANYLANDS_OSCILLATORBANK_H
@@ -0,0 +1,514 @@
+#include "Profiler.h"
+// ImGui
+#include "imgui.h"
+// std
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifdef MANYLANDS_COUNT_ALLOCATIONS
+// Incremented by the operator new of Allocation_counter.cpp
+extern std::atomic<std::uint64_t> Allocation_counter;
+#endif
+
+namespace
+{
+// Number of frames kept for the percentiles and the trace
+const size_t History_size = 240;
+
+const char* const Counter_names[Profiler::Num_counters] = {
+    "Vertices",
+    "Triangles",
+    "Uploaded bytes",
+    "Allocations"
+};
+
+std::atomic<unsigned int> Thread_counter(0);
+
+//******************************************************************************
+// percentile
+//******************************************************************************
+
+template<class T>
+T percentile(std::vector<T> values, float p)
+{
+    if(values.empty())
+        return T();
+
+    const size_t n = std::min(
+        values.size() - 1,
+        static_cast<size_t>(p * (values.size() - 1) + 0.5f));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+} // namespace
+
+//******************************************************************************
+// Scope
+//******************************************************************************
+
+Profiler::Scope::Scope(const char* name, bool accumulate)
+    : name_(name)
+    , accumulate_(accumulate)
+    , is_active_(Profiler::instance().is_frame_active_)
+{
+    if(!is_active_)
+        return;
+
+    ++thread_depth();
+    start_ = std::chrono::steady_clock::now();
+}
+
+//******************************************************************************
+// ~Scope
+//******************************************************************************
+
+Profiler::Scope::~Scope()
+{
+    if(!is_active_)
+        return;
+
+    const auto end = std::chrono::steady_clock::now();
+    const int depth = --thread_depth();
+
+    Profiler::instance().record(name_, accumulate_, start_, end, depth);
+}
+
+//******************************************************************************
+// Profiler
+//******************************************************************************
+
+Profiler::Profiler()
+    : origin_(std::chrono::steady_clock::now())
+    , is_enabled_(false)
+    , is_frame_active_(false)
+    , frame_allocations_(0)
+    , history_(History_size)
+    , history_next_(0)
+{
+    for(auto& c : counters_)
+        c = 0;
+
+    for(auto& f : history_)
+        f.duration_us = -1;
+}
+
+//******************************************************************************
+// instance
+//******************************************************************************
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+//******************************************************************************
+// begin_frame
+//******************************************************************************
+
+void Profiler::begin_frame()
+{
+    if(!is_enabled_)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The slot of the oldest frame is reused to keep the memory of its arrays
+    current_.events.clear();
+    current_.stage_ms.clear();
+    merge_stages(false);
+
+    frame_start_ = std::chrono::steady_clock::now();
+    frame_allocations_ = allocation_count();
+    for(auto& c : counters_)
+        c = 0;
+
+    is_frame_active_ = true;
+}
+
+//******************************************************************************
+// end_frame
+//******************************************************************************
+
+void Profiler::end_frame()
+{
+    if(!is_frame_active_)
+        return;
+
+    is_frame_active_ = false;
+
+    const auto end = std::chrono::steady_clock::now();
+    counters_[Allocations] = allocation_count() - frame_allocations_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    merge_stages(true);
+    current_.start_us = to_us(frame_start_);
+    current_.duration_us = to_us(end) - current_.start_us;
+    for(size_t i = 0; i < Num_counters; ++i)
+        current_.counters[i] = counters_[i];
+
+    std::swap(history_[history_next_], current_);
+    history_next_ = (history_next_ + 1) % history_.size();
+}
+
+//******************************************************************************
+// set_enabled
+//******************************************************************************
+
+void Profiler::set_enabled(bool enabled)
+{
+    is_enabled_ = enabled;
+}
+
+//******************************************************************************
+// is_enabled
+//******************************************************************************
+
+bool Profiler::is_enabled() const
+{
+    return is_enabled_;
+}
+
+//******************************************************************************
+// add
+//******************************************************************************
+
+void Profiler::add(Counter counter, std::uint64_t value)
+{
+    if(is_frame_active_)
+        counters_[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+//******************************************************************************
+// draw_overlay
+//******************************************************************************
+
+void Profiler::draw_overlay(bool* is_open)
+{
+    ImGui::SetNextWindowSize(ImVec2(420.f, 360.f), ImGuiCond_FirstUseEver);
+    if(!ImGui::Begin("Profiler", is_open))
+    {
+        ImGui::End();
+        return;
+    }
+
+    std::vector<float> frame_ms;
+    std::map<std::string, std::vector<float>> stage_ms;
+    std::array<std::vector<std::uint64_t>, Num_counters> counters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::vector<const Frame*> frames;
+        for(const auto& f : history_)
+        {
+            if(f.duration_us >= 0)
+                frames.push_back(&f);
+        }
+
+        for(const auto* f : frames)
+        {
+            frame_ms.push_back(0.001f * f->duration_us);
+            for(size_t i = 0; i < Num_counters; ++i)
+                counters[i].push_back(f->counters[i]);
+        }
+
+        // Stages that did not run in a frame take zero time there
+        for(size_t i = 0; i < frames.size(); ++i)
+        {
+            for(const auto& s : frames[i]->stage_ms)
+            {
+                auto& values = stage_ms[s.first];
+                values.resize(frames.size(), 0.f);
+                values[i] += s.second;
+            }
+        }
+    }
+
+    ImGui::Text("%u frames", static_cast<unsigned int>(frame_ms.size()));
+
+    ImGui::Columns(4, "stages");
+    ImGui::Text("Stage, ms");   ImGui::NextColumn();
+    ImGui::Text("p50");         ImGui::NextColumn();
+    ImGui::Text("p95");         ImGui::NextColumn();
+    ImGui::Text("p99");         ImGui::NextColumn();
+    ImGui::Separator();
+
+    auto stage_row = [](const char* name, const std::vector<float>& values) {
+        ImGui::Text("%s", name);                           ImGui::NextColumn();
+        ImGui::Text("%.2f", percentile(values, 0.50f));    ImGui::NextColumn();
+        ImGui::Text("%.2f", percentile(values, 0.95f));    ImGui::NextColumn();
+        ImGui::Text("%.2f", percentile(values, 0.99f));    ImGui::NextColumn();
+    };
+
+    stage_row("Frame", frame_ms);
+    for(const auto& s : stage_ms)
+        stage_row(s.first.c_str(), s.second);
+
+    ImGui::Columns(1);
+    ImGui::Separator();
+
+    ImGui::Columns(3, "counters");
+    ImGui::Text("Counter");     ImGui::NextColumn();
+    ImGui::Text("p50");         ImGui::NextColumn();
+    ImGui::Text("p95");         ImGui::NextColumn();
+    ImGui::Separator();
+    for(size_t i = 0; i < Num_counters; ++i)
+    {
+        if(i == Allocations && !counts_allocations())
+            continue;
+
+        ImGui::Text("%s", Counter_names[i]);
+        ImGui::NextColumn();
+        ImGui::Text("%llu", static_cast<unsigned long long>(
+            percentile(counters[i], 0.50f)));
+        ImGui::NextColumn();
+        ImGui::Text("%llu", static_cast<unsigned long long>(
+            percentile(counters[i], 0.95f)));
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+    ImGui::Separator();
+
+    static bool export_failed = false;
+    if(ImGui::Button("Export Chrome trace"))
+        export_failed = !export_chrome_trace("manylands_trace.json");
+    if(export_failed)
+        ImGui::Text("Could not write manylands_trace.json");
+
+    ImGui::End();
+}
+
+//******************************************************************************
+// export_chrome_trace
+//
+// Writes the kept frames in the JSON trace event format
+//******************************************************************************
+
+bool Profiler::export_chrome_trace(const std::string& fname) const
+{
+    std::ofstream file(fname);
+    if(!file.is_open())
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool is_first = true;
+    auto separator = [&file, &is_first]() -> std::ofstream& {
+        if(!is_first)
+            file << ",\n";
+        is_first = false;
+        return file;
+    };
+
+    // Frames from the oldest to the newest
+    for(size_t i = 0; i < history_.size(); ++i)
+    {
+        const Frame& f = history_[(history_next_ + i) % history_.size()];
+        if(f.duration_us < 0)
+            continue;
+
+        separator() << "{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0"
+                    << ",\"ts\":" << f.start_us
+                    << ",\"dur\":" << f.duration_us << "}";
+
+        for(const auto& e : f.events)
+        {
+            separator() << "{\"name\":\"" << e.name << "\",\"ph\":\"X\""
+                        << ",\"pid\":1,\"tid\":" << e.thread
+                        << ",\"ts\":" << e.start_us
+                        << ",\"dur\":" << e.duration_us
+                        << ",\"args\":{\"depth\":" << e.depth << "}}";
+        }
+
+        for(size_t c = 0; c < Num_counters; ++c)
+        {
+            separator() << "{\"name\":\"" << Counter_names[c] << "\""
+                        << ",\"ph\":\"C\",\"pid\":1"
+                        << ",\"ts\":" << f.start_us
+                        << ",\"args\":{\"value\":" << f.counters[c] << "}}";
+        }
+    }
+
+    file << "]}\n";
+
+    return file.good();
+}
+
+//******************************************************************************
+// counts_allocations
+//******************************************************************************
+
+bool Profiler::counts_allocations()
+{
+#ifdef MANYLANDS_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+//******************************************************************************
+// allocation_count
+//******************************************************************************
+
+std::uint64_t Profiler::allocation_count()
+{
+#ifdef MANYLANDS_COUNT_ALLOCATIONS
+    return Allocation_counter.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+//******************************************************************************
+// record
+//******************************************************************************
+
+void Profiler::record(
+    const char* name,
+    bool accumulate,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end,
+    int depth)
+{
+    const std::int64_t duration_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            end - start).count();
+
+    // The stage is added to a slot of the thread
+    Thread_stages& stages = thread_stages();
+    const size_t num_slots =
+        stages.num_slots.load(std::memory_order_relaxed);
+    size_t i = 0;
+    while(i < num_slots && stages.slots[i].name != name)
+        ++i;
+
+    if(i == num_slots && num_slots < Thread_stages::Num_slots)
+    {
+        stages.slots[i].name = name;
+        stages.slots[i].duration_ns.store(0, std::memory_order_relaxed);
+        stages.num_slots.store(num_slots + 1, std::memory_order_release);
+    }
+
+    const bool has_slot = i < Thread_stages::Num_slots;
+    if(has_slot)
+    {
+        stages.slots[i].duration_ns.fetch_add(
+            duration_ns, std::memory_order_relaxed);
+    }
+
+    // Every stage that is not accumulated is also a trace event
+    if(accumulate && has_slot)
+        return;
+
+    const std::int64_t start_us = to_us(start);
+    const std::int64_t duration_us = to_us(end) - start_us;
+    const unsigned int thread = thread_index();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!is_frame_active_)
+        return;
+
+    if(!accumulate)
+        current_.events.push_back({name, start_us, duration_us, depth, thread});
+    if(!has_slot)
+        add_stage(name, 1e-6f * duration_ns);
+}
+
+//******************************************************************************
+// add_stage
+//******************************************************************************
+
+void Profiler::add_stage(const char* name, float ms)
+{
+    for(auto& s : current_.stage_ms)
+    {
+        if(std::strcmp(s.first, name) == 0)
+        {
+            s.second += ms;
+            return;
+        }
+    }
+    current_.stage_ms.emplace_back(name, ms);
+}
+
+//******************************************************************************
+// merge_stages
+//
+// The same name may have different addresses in different files, therefore
+// the stages are merged by their names
+//******************************************************************************
+
+void Profiler::merge_stages(bool keep)
+{
+    for(auto& stages : thread_stages_)
+    {
+        const size_t num_slots =
+            stages->num_slots.load(std::memory_order_acquire);
+        for(size_t i = 0; i < num_slots; ++i)
+        {
+            auto& slot = stages->slots[i];
+            const std::int64_t duration_ns =
+                slot.duration_ns.exchange(0, std::memory_order_relaxed);
+            if(keep && duration_ns > 0)
+                add_stage(slot.name, 1e-6f * duration_ns);
+        }
+    }
+}
+
+//******************************************************************************
+// thread_stages
+//
+// The slots of a thread are created when it measures its first stage
+//******************************************************************************
+
+Profiler::Thread_stages& Profiler::thread_stages()
+{
+    thread_local Thread_stages* stages = nullptr;
+    if(stages == nullptr)
+    {
+        auto new_stages = std::make_unique<Thread_stages>();
+        new_stages->num_slots = 0;
+        stages = new_stages.get();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        thread_stages_.push_back(std::move(new_stages));
+    }
+    return *stages;
+}
+
+//******************************************************************************
+// to_us
+//******************************************************************************
+
+std::int64_t Profiler::to_us(std::chrono::steady_clock::time_point t) const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        t - origin_).count();
+}
+
+//******************************************************************************
+// thread_index
+//
+// Small sequential numbers of the threads, the first thread gets zero
+//******************************************************************************
+
+unsigned int Profiler::thread_index()
+{
+    thread_local unsigned int index = Thread_counter.fetch_add(1);
+    return index;
+}
+
+//******************************************************************************
+// thread_depth
+//******************************************************************************
+
+int& Profiler::thread_depth()
+{
+    thread_local int depth = 0;
+    return depth;
+}
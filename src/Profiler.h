@@ -0,0 +1,154 @@
+#pragma once
+
+// std
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+//******************************************************************************
+// Profiler
+//
+// Collects the CPU time of the frame stages and per-frame counters. Stages are
+// measured with scoped timers that may be nested and may run on any thread.
+// The last frames are kept for the ImGui overlay, which shows rolling
+// percentiles, and for the export to the Chrome trace format (chrome://tracing
+// or https://ui.perfetto.dev).
+//******************************************************************************
+
+class Profiler
+{
+public:
+    enum Counter
+    {
+        Vertices,
+        Triangles,
+        Uploaded_bytes,
+        Allocations,
+        Num_counters
+    };
+
+    // Measures the time between its construction and destruction. Stages that
+    // are entered many times per frame should be 'accumulated': only their
+    // total time is kept, without separate trace events
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name, bool accumulate = false);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name_;
+        bool accumulate_;
+        bool is_active_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    static Profiler& instance();
+
+    void begin_frame();
+    void end_frame();
+
+    void set_enabled(bool enabled);
+    bool is_enabled() const;
+
+    void add(Counter counter, std::uint64_t value);
+
+    void draw_overlay(bool* is_open);
+    bool export_chrome_trace(const std::string& fname) const;
+
+    // Number of heap allocations since the start of the application. They are
+    // only counted if the MANYLANDS_COUNT_ALLOCATIONS option links the
+    // replaced operator new of Allocation_counter.cpp, otherwise it is zero
+    static bool counts_allocations();
+    static std::uint64_t allocation_count();
+
+private:
+    Profiler();
+
+    struct Event
+    {
+        const char* name;
+        std::int64_t start_us, duration_us;
+        int depth;
+        unsigned int thread;
+    };
+
+    struct Frame
+    {
+        std::int64_t start_us, duration_us;
+        std::vector<Event> events;
+        // Total time of the stages. The arrays keep their memory between
+        // frames, so the profiler itself does not allocate in a frame
+        std::vector<std::pair<const char*, float>> stage_ms;
+        std::array<std::uint64_t, Num_counters> counters;
+    };
+
+    // Total time of the stages measured on one thread. Only the thread adds to
+    // its slots, it finds a stage by the address of the name and does not
+    // lock. The slots are moved to the frame by 'merge_stages'
+    struct Thread_stages
+    {
+        struct Slot
+        {
+            const char* name;
+            std::atomic<std::int64_t> duration_ns;
+        };
+
+        static const size_t Num_slots = 64;
+        std::array<Slot, Num_slots> slots;
+        std::atomic<size_t> num_slots;
+    };
+
+    void record(
+        const char* name,
+        bool accumulate,
+        std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point end,
+        int depth);
+    void add_stage(const char* name, float ms);
+    // Adds the times of the threads to the current frame, or drops them if
+    // 'keep' is false. Requires 'mutex_'
+    void merge_stages(bool keep);
+    Thread_stages& thread_stages();
+
+    std::int64_t to_us(std::chrono::steady_clock::time_point t) const;
+
+    static unsigned int thread_index();
+    static int& thread_depth();
+
+    std::chrono::steady_clock::time_point origin_;
+    std::atomic<bool> is_enabled_, is_frame_active_;
+
+    mutable std::mutex mutex_;
+    Frame current_;
+    std::chrono::steady_clock::time_point frame_start_;
+    std::uint64_t frame_allocations_;
+    std::array<std::atomic<std::uint64_t>, Num_counters> counters_;
+
+    // Ring of the finished frames
+    std::vector<Frame> history_;
+    size_t history_next_;
+
+    // Slots of every thread that measured a stage. They are kept until the
+    // end, so a thread may exit in the middle of a frame
+    std::vector<std::unique_ptr<Thread_stages>> thread_stages_;
+};
+
+#define PROFILER_CONCAT_IMPL(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_IMPL(a, b)
+
+// Times the rest of the enclosing block
+#define PROFILE_SCOPE(name) \
+    Profiler::Scope PROFILER_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_ACCUMULATE(name) \
+    Profiler::Scope PROFILER_CONCAT(profile_scope_, __LINE__)(name, true)
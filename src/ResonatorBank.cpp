@@ -0,0 +1,112 @@
+//
+// Modal resonators for the dimensionality switches.
+//
+
+#include "ResonatorBank.h"
+
+#include <cmath>
+
+
+namespace {
+// Modes of x, y, z and w
+const stk::StkFloat MODE_FREQUENCIES[ResonatorBank::NO_OF_MODES] =
+        {400.0, 800.0, 1153.0, 200.0};
+const stk::StkFloat MODE_LEVEL = 0.2;
+}
+
+ResonatorBank::ResonatorBank() : noOfStrikes(0), ringingFrames() {
+    const stk::StkFloat radius =
+            std::pow(0.001, 1.0 / (RING_SECONDS * stk::Stk::sampleRate()));
+    for (int i = 0; i < NO_OF_MODES; i++) {
+        modes[i].setResonance(MODE_FREQUENCIES[i], radius);
+        // Without normalization the impulse response of a mode peaks at
+        // 1 / sin(omega)
+        strikeGains[i] = MODE_LEVEL * std::sin(
+                stk::TWO_PI * MODE_FREQUENCIES[i] / stk::Stk::sampleRate());
+    }
+}
+
+void ResonatorBank::strike(unsigned int offset, unsigned int axes) {
+    if (noOfStrikes == MAX_STRIKES || axes == 0) {
+        return;
+    }
+
+    // Kept in order of the offsets
+    unsigned int i = noOfStrikes++;
+    for (; i > 0 && strikes[i - 1].offset > offset; i--) {
+        strikes[i] = strikes[i - 1];
+    }
+    strikes[i] = {offset, axes};
+}
+
+void ResonatorBank::render(stk::StkFloat* out, unsigned int nFrames) {
+    process(out, nFrames);
+}
+
+void ResonatorBank::advance(unsigned int nFrames) {
+    process(nullptr, nFrames);
+}
+
+bool ResonatorBank::isRinging() const {
+    if (noOfStrikes > 0) {
+        return true;
+    }
+    for (unsigned long frames : ringingFrames) {
+        if (frames > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned int ResonatorBank::axesOf(const std::string& dimensionality) {
+    unsigned int axes = 0;
+    axes |= dimensionality.find('x') != std::string::npos ? X : 0;
+    axes |= dimensionality.find('y') != std::string::npos ? Y : 0;
+    axes |= dimensionality.find('z') != std::string::npos ? Z : 0;
+    axes |= dimensionality.find('w') != std::string::npos ? W : 0;
+    return axes;
+}
+
+void ResonatorBank::process(stk::StkFloat* out, unsigned int nFrames) {
+    // The modes have decayed by 120 dB after twice the ring time
+    const unsigned long decayFrames =
+            (unsigned long) (2.0 * RING_SECONDS * stk::Stk::sampleRate());
+
+    // Mode by mode, the strikes are the impulses at their offsets
+    for (int mode = 0; mode < NO_OF_MODES; mode++) {
+        const unsigned int bit = 1u << mode;
+        bool isStruck = false;
+        for (unsigned int i = 0; i < noOfStrikes; i++) {
+            isStruck = isStruck || (strikes[i].axes & bit);
+        }
+        if (!isStruck && ringingFrames[mode] == 0) {
+            continue;
+        }
+
+        unsigned int next = 0;
+        for (unsigned int i = 0; i < nFrames; i++) {
+            stk::StkFloat input = 0.0;
+            for (; next < noOfStrikes && strikes[next].offset <= i; next++) {
+                if (strikes[next].axes & bit) {
+                    input += strikeGains[mode];
+                }
+            }
+            const stk::StkFloat sample = modes[mode].tick(input);
+            if (out) {
+                out[i] += sample;
+            }
+        }
+
+        // A decayed mode starts from rest again
+        if (isStruck) {
+            ringingFrames[mode] = decayFrames;
+        } else if (ringingFrames[mode] > nFrames) {
+            ringingFrames[mode] -= nFrames;
+        } else {
+            ringingFrames[mode] = 0;
+            modes[mode].clear();
+        }
+    }
+    noOfStrikes = 0;
+}
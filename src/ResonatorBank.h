@@ -0,0 +1,67 @@
+//
+// Modal resonators for the dimensionality switches.
+//
+
+#ifndef MANYLANDS_RESONATORBANK_H
+#define MANYLANDS_RESONATORBANK_H
+
+#include "BiQuad.h"
+
+#include <string>
+
+// One resonator per axis, struck when the dimensionality of the curve changes.
+// The modes and their levels are the ones of the DynKlank in oscp-server.scd:
+// the axes of the new dimensionality ring.
+//
+// The filters are created with the bank and never reallocated. The strikes of
+// a block are queued with their frame offset and rendered sample-accurately by
+// the next render(). Only the modes that ring are computed.
+class ResonatorBank {
+public:
+    static const int NO_OF_MODES = 4;
+    // Strikes per block, further strikes of the block are dropped
+    static const int MAX_STRIKES = 16;
+    // Decay of the modes by 60 dB
+    static constexpr double RING_SECONDS = 0.5;
+
+    // Bit of each axis in the masks of strike()
+    enum Axis { X = 1, Y = 2, Z = 4, W = 8 };
+
+    ResonatorBank();
+
+    // Strikes the modes of the axes in 'axes' at frame 'offset' of the next
+    // rendered block
+    void strike(unsigned int offset, unsigned int axes);
+
+    // Adds the ringing modes to 'out'. Does not allocate or lock
+    void render(stk::StkFloat* out, unsigned int nFrames);
+
+    // Moves on by nFrames without rendering, the state is the same as after
+    // render()
+    void advance(unsigned int nFrames);
+
+    bool isRinging() const;
+
+    // Mask of the axes in a dimensionality like "xz"
+    static unsigned int axesOf(const std::string& dimensionality);
+
+private:
+    struct Strike {
+        unsigned int offset;
+        unsigned int axes;
+    };
+
+    // Renders if 'out' is not null
+    void process(stk::StkFloat* out, unsigned int nFrames);
+
+    stk::BiQuad modes[NO_OF_MODES];
+    // Impulse that makes a mode ring with its level
+    stk::StkFloat strikeGains[NO_OF_MODES];
+    Strike strikes[MAX_STRIKES];
+    unsigned int noOfStrikes;
+    // Frames until the last strike of a mode has decayed
+    unsigned long ringingFrames[NO_OF_MODES];
+};
+
+
+#endif //MANYLANDS_RESONATORBANK_H
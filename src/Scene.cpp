@@ -116,6 +116,8 @@ void Scene::load_ode(
         state_->curve_selection->t_start = first_curve->t_min();
         state_->curve_selection->t_end = first_curve->t_max();
     }
+
+    state_->mark_dirty(Scene_state::Dirty_curves);
 }
 
 //******************************************************************************
@@ -13,8 +13,9 @@ public:
         float cuve_min_rad,
         float tesseract_size = 200.f);
 
-private:
     std::shared_ptr<Curve> load_curve(std::string fname);
+
+private:
     void normalize_curve(Curve& curve);
     void create_tesseract();
 
@@ -1,11 +1,13 @@
 #include "Scene_renderer.h"
 // local
 #include "Consts.h"
-#include "Mesh_generator.h"
 #include "Matrix_lib.h"
+#include "Mesh_emitter.h"
+#include "Profiler.h"
 // boost
 #include <boost/numeric/ublas/assignment.hpp>
 // std
+#include <deque>
 #include <stdexcept>
 // glm
 #include <glm/glm.hpp>
@@ -26,11 +28,15 @@ Scene_renderer::Scene_renderer(std::shared_ptr<Scene_state> state)
     , tesseract_thickness_(1.f)
     , curve_thickness_(1.f)
     , sphere_diameter_(1.f)
+    , pixels_per_unit_(1.f)
+    , thread_pool_(std::make_unique<Thread_pool>())
     , number_of_animations_(6)
     , visibility_mask_(0)
     , track_mouse_(false)
     , filter_arrow_annotations_(true)
     , show_labels_(true)
+    , gpu_projection_(true)
+    , is_hyper_dirty_(true)
 {
     set_state(state);
 }
@@ -71,14 +77,41 @@ void Scene_renderer::render()
        state_->tesseract == nullptr ||
        state_->curves.empty())
     {
+        text_renderer_->clear();
         return;
     }
 
-    back_geometry_  = std::make_unique<Diffuse_shader::Mesh_geometry>();
-    front_geometry_ = std::make_unique<Diffuse_shader::Mesh_geometry>();
-    screen_geometry_ = std::make_unique<Screen_shader::Screen_geometry>();
+    PROFILE_SCOPE("Scene");
+
+    // The meshes are only rebuilt if a part of the state they depend on has
+    // changed, otherwise the buffers of the previous frame are drawn again.
+    // The time markers have their own geometry, so the playback only rebuilds
+    // them
+    const std::uint32_t scene_flags =
+        Scene_state::Dirty_all &
+        ~(Scene_state::Dirty_timeplayer | Scene_state::Dirty_timeline);
+    const bool rebuild =
+        state_->is_dirty(scene_flags) || back_geometry_ == nullptr;
+    const bool rebuild_markers =
+        rebuild || state_->is_dirty(Scene_state::Dirty_timeplayer);
+
+    // The tubes of the 4D curves do not depend on the view
+    if(state_->is_dirty(Scene_state::Dirty_curves    |
+                        Scene_state::Dirty_selection |
+                        Scene_state::Dirty_colors    |
+                        Scene_state::Dirty_options))
+    {
+        is_hyper_dirty_ = true;
+    }
 
-    label_points_.clear();
+    if(back_geometry_ == nullptr)
+    {
+        back_geometry_  = std::make_unique<Diffuse_shader::Mesh_geometry>();
+        front_geometry_ = std::make_unique<Diffuse_shader::Mesh_geometry>();
+        marker_geometry_ = std::make_unique<Diffuse_shader::Mesh_geometry>();
+        screen_geometry_ = std::make_unique<Screen_shader::Screen_geometry>();
+        hyper_geometry_ = std::make_unique<Diffuse_shader::Hyper_geometry>();
+    }
 
     glUseProgram(diffuse_shader_->program_id);
 
@@ -89,12 +122,7 @@ void Scene_renderer::render()
 
     std::vector<float> anims =
         split_animation(state_->unfolding_anim, number_of_animations_);
-    float hide_4D = anims[0],
-          project_curve_4D = anims[1],
-          unfold_4D = anims[2],
-          hide_3D = anims[3],
-          project_curve_3D = anims[4],
-          unfold_3D = anims[5];
+    const float unfold_3D = anims[5];
 
     glm::mat4 proj_mat = glm::perspective(
         state_->fov_y,
@@ -111,6 +139,11 @@ void Scene_renderer::render()
     // Cache the Model-view-projection matrix for arrow drawing
     auto mvp_mat = proj_mat * camera_mat * world_mat;
 
+    // The tessellation of tubes and spheres depends on their size on screen
+    mvp_mat_ = mvp_mat;
+    viewport_scale_ = 0.5f * glm::vec2(region_.width(), region_.height());
+    pixels_per_unit_ = proj_mat[1][1] * viewport_scale_.y;
+
     glUniformMatrix4fv(diffuse_shader_->proj_mat_id,
                        1,
                        GL_FALSE,
@@ -130,6 +163,140 @@ void Scene_renderer::render()
                  1,
                  glm::value_ptr(fog_range_));
 
+    if(rebuild)
+    {
+        for(auto geom : {back_geometry_.get(), front_geometry_.get()})
+        {
+            geom->data_array.clear();
+            geom->indices.clear();
+        }
+        text_renderer_->clear();
+
+        build_meshes(anims, mvp_mat);
+
+        back_geometry_->update_buffers();
+        front_geometry_->update_buffers();
+    }
+
+    if(rebuild_markers)
+    {
+        marker_geometry_->data_array.clear();
+        marker_geometry_->indices.clear();
+
+        build_time_markers();
+
+        marker_geometry_->update_buffers();
+    }
+
+    for(auto geom : {back_geometry_.get(),
+                     marker_geometry_.get(),
+                     front_geometry_.get()})
+    {
+        Profiler::instance().add(Profiler::Vertices, geom->data_array.size());
+        Profiler::instance().add(Profiler::Triangles, geom->indices.size() / 3);
+    }
+    for(size_t i = 0; i < hyper_draws_.size(); ++i)
+    {
+        Profiler::instance().add(
+            Profiler::Vertices, hyper_geometry_->data_array.size());
+        Profiler::instance().add(
+            Profiler::Triangles, hyper_geometry_->indices.size() / 3);
+    }
+
+    // The translucent tubes are drawn over the translucent meshes, as they
+    // are added after the plots. The tubes are pushed back in depth: a curve
+    // lying on a plot edge has its 8 sides poking out of the tube of the edge,
+    // the edge has to stay on top as it does with the tubes of the CPU
+    auto draw_hyper = [this](bool is_translucent) {
+        if(hyper_geometry_->data_array.empty())
+            return;
+
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(1.f, 1.f);
+        for(const auto& draw : hyper_draws_)
+        {
+            if((draw.opacity < 1.f) != is_translucent)
+                continue;
+
+            set_hyper_uniforms(draw);
+            diffuse_shader_->draw_hyper_geometry(hyper_geometry_);
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
+    };
+
+    {
+        PROFILE_SCOPE("Draw");
+        if(back_geometry_->data_array.size() > 0)
+            diffuse_shader_->draw_geometry(back_geometry_);
+        if(marker_geometry_->data_array.size() > 0)
+            diffuse_shader_->draw_geometry(marker_geometry_);
+        draw_hyper(false);
+        if(front_geometry_->data_array.size() > 0)
+            diffuse_shader_->draw_geometry(front_geometry_);
+        draw_hyper(true);
+    }
+
+    // On screen rendering -----------------------------------------------------
+
+    glUseProgram(screen_shader_->program_id);
+
+    glViewport(static_cast<GLint>(  display_scale_x_ * region_.left()   ),
+               static_cast<GLint>(  display_scale_y_ * region_.bottom() ),
+               static_cast<GLsizei>(display_scale_x_ * region_.width()  ),
+               static_cast<GLsizei>(display_scale_y_ * region_.height()));
+
+    glm::mat4 proj_ortho = glm::ortho(0.f,
+                                      static_cast<float>(region_.width()),
+                                      0.f,
+                                      static_cast<float>(region_.height()));
+    glUniformMatrix4fv(screen_shader_->proj_mat_id,
+                       1,
+                       GL_FALSE,
+                       glm::value_ptr(proj_ortho));
+
+    if(rebuild)
+    {
+        screen_geometry_->data_array.clear();
+        screen_geometry_->indices.clear();
+
+        if(state_->show_legend)
+            draw_legend(region_);
+
+        if(show_labels_ && unfold_3D > 0.66f)
+            draw_labels_in_2D(mvp_mat);
+
+        screen_geometry_->update_buffers();
+    }
+
+    if(screen_geometry_->data_array.size() > 0)
+    {
+        PROFILE_SCOPE("Draw");
+        screen_shader_->draw_geometry(*screen_geometry_.get());
+    }
+}
+
+//******************************************************************************
+// build_meshes
+//
+// Generates the meshes of the tesseract, the plots and the curves for the
+// current animation stage
+//******************************************************************************
+
+void Scene_renderer::build_meshes(
+    const std::vector<float>& anims,
+    const glm::mat4& mvp_mat)
+{
+    float hide_4D = anims[0],
+          project_curve_4D = anims[1],
+          unfold_4D = anims[2],
+          hide_3D = anims[3],
+          project_curve_3D = anims[4],
+          unfold_3D = anims[5];
+
+    label_points_.clear();
+    time_markers_.clear();
+    hyper_draws_.clear();
+
     //gui_.Renderer->remove_all_meshes();
     //gui_.distanceWarning->hide();
     //gui_.Renderer->show_labels(false);
@@ -141,25 +308,37 @@ void Scene_renderer::render()
     Scene_wireframe_object projected_t = *state_->tesseract.get();
     project_to_3D(projected_t.get_vertices(), rot_m);
 
-    // Choosing the high-resolution or the low-resolution curve
-    std::vector<Curve> projected_c;
+    // The copies are only needed for the projection on the CPU
+    if(gpu_projection_)
+        curve_copies_.clear();
+    else
+        update_curve_copies();
 
-    // Array of curves used to project into 3D spaces
-    typedef std::vector<Curve> curves_3d_t;
-    std::vector<curves_3d_t> curves_3d;
+    const glm::mat4 no_post_map(1.f);
 
-    for(size_t ci = 0; ci < state_->curves.size(); ++ci)
+    // Moves the copy of the curve 'ci' with the map and draws its tubes
+    auto draw_curve_copy = [&](
+        Curve& c,
+        size_t ci,
+        const Affine_map& map,
+        const glm::mat4* post_map,
+        float opacity)
     {
-        projected_c.push_back(*state_->curves[ci].get());
-    
-        curves_3d_t curves;
-        for(int i = 0; i < 8; ++i)
-            curves.push_back(*state_->curves[ci].get());
-        curves_3d.push_back(curves);
+        transform_curve(*state_->curves[ci], map, post_map, c);
 
-        // Project curves from 4D to 3D
-        project_to_3D(projected_c[ci].get_vertices(), rot_m);
-    }
+        if(state_->use_unique_curve_colors)
+        {
+            draw_curve(c, opacity, state_->get_curve_color(ci));
+        }
+        else
+        {
+            draw_curve(
+                c,
+                opacity,
+                state_->get_color(Curve_low_speed),
+                state_->get_color(Curve_high_speed));
+        }
+    };
 
     // Animation unfolding the tesseract to the Dali-cross
     if(state_->unfolding_anim == 0)
@@ -171,24 +350,23 @@ void Scene_renderer::render()
         // Draw 4D curve
         if(state_->show_curve)
         {
-            for(size_t ci = 0; ci < projected_c.size(); ++ci)
+            const auto projection = get_projection_map(rot_m);
+            if(gpu_projection_)
+                hyper_draws_.push_back({projection, no_post_map, 1.f});
+
+            for(size_t ci = 0; ci < state_->curves.size(); ++ci)
             {
-                if(state_->use_unique_curve_colors)
+                if(!gpu_projection_)
                 {
-                    draw_curve(
-                        projected_c[ci],
-                        1.,
-                        state_->get_curve_color(ci));
+                    draw_curve_copy(
+                        curve_copies_[ci].projected,
+                        ci,
+                        projection,
+                        nullptr,
+                        1.f);
                 }
-                else
-                {
-                    draw_curve(
-                        projected_c[ci],
-                        1.,
-                        state_->get_color(Curve_low_speed),
-                        state_->get_color(Curve_high_speed));
-                }
-                draw_annotations(projected_c[ci], mvp_mat);
+                draw_time_marker(ci, projection, no_post_map);
+                draw_annotations(ci, projection, no_post_map, mvp_mat);
             }
         }
     }
@@ -196,16 +374,20 @@ void Scene_renderer::render()
     {
         std::vector<Cube> plots_3D = state_->tesseract->split();
 
-        for(auto& c: curves_3d)
-            move_curves_to_3D_plots(project_curve_4D, c);
-
-        if(unfold_4D > 0)
-            tesseract_unfolding(unfold_4D, plots_3D, curves_3d);
+        // Maps of the curves to the 3D plots, unfolded with the plots
+        auto unfolding_maps = tesseract_unfolding(unfold_4D, plots_3D);
+        std::vector<Affine_map> maps_3D(plots_3D.size());
+        for(size_t i = 0; i < plots_3D.size(); ++i)
+        {
+            maps_3D[i] = prod(
+                move_to_3D_plot(i, project_curve_4D), unfolding_maps[i]);
+        }
 
         // Project 3D plots from 4D to 3D
         auto rot = get_rotation_matrix(unfold_4D);
         for(auto& p : plots_3D)
             project_to_3D(p.get_vertices(), rot);
+        const auto projection = get_projection_map(rot);
 
         auto visibility_coeff = [this](size_t i) {
             if(visibility_mask_ == 0 || visibility_mask_ & 1 << i)
@@ -242,39 +424,51 @@ void Scene_renderer::render()
                 }
             }
 
-            for(size_t ci = 0; ci < curves_3d.size(); ++ci)
+            // Draw curves. The tubes of all curves are moved to a plot by its
+            // map, on the GPU it is one draw per plot
+            if(state_->show_curve)
             {
-                // Draw curves
-                if(state_->show_curve)
+                std::vector<Affine_map> maps(maps_3D.size());
+                std::vector<bool> is_drawn(maps_3D.size());
+                for(size_t i = 0; i < maps_3D.size(); ++i)
                 {
-                    for(size_t i = 0; i < curves_3d[ci].size(); ++i)
+                    is_drawn[i] = !state_->use_simple_dali_cross || i == 1 ||
+                                  i == 2 || i == 5 || i == 7;
+                    if(!is_drawn[i])
+                        continue;
+
+                    maps[i] = prod(maps_3D[i], projection);
+                    if(gpu_projection_)
                     {
-                        if(state_->use_simple_dali_cross && i != 1 &&
-                           i != 2 && i != 5 && i != 7)
-                        {
-                            continue;
-                        }
+                        hyper_draws_.push_back(
+                            {maps[i],
+                             no_post_map,
+                             visibility_coeff(i) * (1.f - hide_3D)});
+                    }
+                }
 
-                        auto c = curves_3d[ci][i];
-                        project_to_3D(c.get_vertices(), rot);
+                for(size_t ci = 0; ci < state_->curves.size(); ++ci)
+                {
+                    for(size_t i = 0; i < maps.size(); ++i)
+                    {
+                        if(!is_drawn[i])
+                            continue;
 
-                        if(state_->use_unique_curve_colors)
+                        if(!gpu_projection_)
                         {
-                            draw_curve(
-                                c,
-                                visibility_coeff(i) * (1.f - hide_3D),
-                                state_->get_curve_color(ci));
+                            draw_curve_copy(
+                                curve_copies_[ci].plots_3D[i],
+                                ci,
+                                maps[i],
+                                nullptr,
+                                visibility_coeff(i) * (1.f - hide_3D));
                         }
-                        else
+                        draw_time_marker(ci, maps[i], no_post_map);
+                        if(visibility_coeff(i) == 1. && hide_3D < 0.5)
                         {
-                            draw_curve(
-                                c,
-                                visibility_coeff(i) * (1.f - hide_3D),
-                                state_->get_color(Curve_low_speed),
-                                state_->get_color(Curve_high_speed));
+                            draw_annotations(
+                                ci, maps[i], no_post_map, mvp_mat);
                         }
-                        if(visibility_coeff(i) == 1. && hide_3D < 0.5)
-                            draw_annotations(c, mvp_mat);
                     }
                 }
             }
@@ -285,32 +479,7 @@ void Scene_renderer::render()
         {
             // Get the source plots
             std::vector<Square> plots_2D = Cube::split(plots_3D);
-
-            typedef std::vector<Curve> curvs_2d_t;
-            std::vector<curvs_2d_t> curves_2d;
-
-            for(auto& c3d : curves_3d)
-            {
-                std::vector<Curve> curves;
-                curves.push_back(c3d[5]);
-                curves.push_back(c3d[1]);
-                curves.push_back(c3d[7]);
-                curves.push_back(c3d[1]);
-                curves.push_back(c3d[7]);
-                curves.push_back(c3d[7]);
-
-                move_curves_to_2D_plots(project_curve_3D, curves);
-                curves_2d.push_back(curves);
-            }
-
-            for(auto& c2d : curves_2d)
-            {
-                for(auto& c : c2d)
-                {
-                    project_to_3D(c.get_vertices(), rot);
-                }
-            }
-            plots_unfolding(unfold_3D, plots_2D, curves_2d);
+            const auto post_maps = plots_unfolding(unfold_3D, plots_2D);
 
             // Draw 2D plots
             if(state_->show_tesseract)
@@ -323,70 +492,53 @@ void Scene_renderer::render()
             label_points_.push_back(plots_2D[3].get_vertices()[0]);
             label_points_.push_back(plots_2D[5].get_vertices()[1]);
 
-            // Draw 2D curves
+            // Draw 2D curves. They are the curves of the 3D plots moved to
+            // the faces of the plots
             if(state_->show_curve)
             {
-                for(size_t ci = 0; ci < curves_2d.size(); ++ci)
+                const size_t source_plots[] = {5, 1, 7, 1, 7, 7};
+
+                std::vector<Affine_map> maps(post_maps.size());
+                for(size_t i = 0; i < post_maps.size(); ++i)
                 {
-                    for(auto& c : curves_2d[ci])
+                    const Affine_map map = prod(
+                        maps_3D[source_plots[i]],
+                        move_to_2D_plot(i, project_curve_3D));
+                    maps[i] = prod(map, projection);
+                    if(gpu_projection_)
+                        hyper_draws_.push_back({maps[i], post_maps[i], 1.f});
+                }
+
+                for(size_t ci = 0; ci < state_->curves.size(); ++ci)
+                {
+                    for(size_t i = 0; i < post_maps.size(); ++i)
                     {
-                        if(state_->use_unique_curve_colors)
-                        {
-                            draw_curve(c, 1., state_->get_curve_color(ci));
-                        }
-                        else
+                        if(!gpu_projection_)
                         {
-                            draw_curve(
-                                c,
-                                1.,
-                                state_->get_color(Curve_low_speed),
-                                state_->get_color(Curve_high_speed));
+                            draw_curve_copy(
+                                curve_copies_[ci].plots_2D[i],
+                                ci,
+                                maps[i],
+                                &post_maps[i],
+                                1.f);
                         }
-
-                        draw_annotations(c, mvp_mat);
+                        draw_time_marker(ci, maps[i], post_maps[i]);
+                        draw_annotations(ci, maps[i], post_maps[i], mvp_mat);
                     }
                 }
             }
         }
     }
 
-    if(back_geometry_->data_array.size() > 0)
-    {
-        back_geometry_->init_buffers();
-        diffuse_shader_->draw_geometry(back_geometry_);
-    }
-    if(front_geometry_->data_array.size() > 0)
-    {
-        front_geometry_->init_buffers();
-        diffuse_shader_->draw_geometry(front_geometry_);
-    }
-
-    // On screen rendering -----------------------------------------------------
-
-    glUseProgram(screen_shader_->program_id);
-
-    glViewport(static_cast<GLint>(  display_scale_x_ * region_.left()   ),
-               static_cast<GLint>(  display_scale_y_ * region_.bottom() ),
-               static_cast<GLsizei>(display_scale_x_ * region_.width()  ),
-               static_cast<GLsizei>(display_scale_y_ * region_.height()));
-
-    glm::mat4 proj_ortho = glm::ortho(0.f,
-                                      static_cast<float>(region_.width()),
-                                      0.f,
-                                      static_cast<float>(region_.height()));
-    glUniformMatrix4fv(screen_shader_->proj_mat_id,
-                       1,
-                       GL_FALSE,
-                       glm::value_ptr(proj_ortho));
-
-    if(state_->show_legend)
-        draw_legend(region_);
+    // The tubes are built around the unprojected curves once and moved by the
+    // maps of the draws in the vertex shader
+    if(!hyper_draws_.empty() && is_hyper_dirty_)
+        build_hyper_curves();
 
-    if(show_labels_ && unfold_3D > 0.66f)
-        draw_labels_in_2D(mvp_mat);
-
-    screen_geometry_->init_buffers();
-    screen_shader_->draw_geometry(*screen_geometry_.get());
+    back_batch_.build(*back_geometry_.get(), *thread_pool_.get());
+    front_batch_.build(*front_geometry_.get(), *thread_pool_.get());
+    back_batch_.clear();
+    front_batch_.clear();
 }
 
 //******************************************************************************
@@ -417,6 +569,8 @@ void Scene_renderer::process_input(const Base_renderer::Renderer_io& io)
 
     if(io.key_pressed)
     {
+        state_->mark_dirty(Scene_state::Dirty_view);
+
         switch(io.key)
         {
         case Base_renderer::Renderer_io::Key_0:
@@ -508,6 +662,8 @@ void Scene_renderer::project_to_3D(
     std::vector<Scene_vertex_t>& verts,
     const boost::numeric::ublas::matrix<float>& rot_mat)
 {
+    PROFILE_ACCUMULATE("Projection");
+
     auto project = [&](Scene_vertex_t& v)
     {
         project_to_3D(v, rot_mat);
@@ -525,59 +681,102 @@ glm::vec4 ColorToGlm(const Color& c, const float alpha)
 {
     return glm::vec4(c.r_norm(), c.g_norm(), c.b_norm(), alpha);
 }
-} // namespace
+
+// Tessellation parameters
+const unsigned int Min_tube_sides = 3,
+                   Max_tube_sides = 16;
+// Maximum distance in pixels between a tube and its polygonal approximation
+const float Max_chord_error = 0.5f;
+// Neighbouring curve segments are merged into one tube if the angle between
+// them is below 1.5 degrees or if they are shorter than a pixel on screen
+const float Min_merge_cos = 0.99966f,
+            Min_segment_length = 1.f;
+const float Max_merge_color_diff = 1.f / 255.f;
+
+// The tubes of the 4D curves are projected on the GPU, their tessellation does
+// not follow the size on screen
+const unsigned int Hyper_tube_sides = 8;
 
 //******************************************************************************
-// draw_tesseract
+// similar_colors
 //******************************************************************************
 
-void Scene_renderer::draw_tesseract(Scene_wireframe_object& t)
+bool similar_colors(const glm::vec4& a, const glm::vec4& b)
 {
-    Mesh t_mesh;
-    for(auto const& e : t.edges())
-    {
-        auto& current = t.get_vertices()[e.vert1];
-        auto& next = t.get_vertices()[e.vert2];
-        const glm::vec4 col = ColorToGlm(e.color, 1.f);
-
-        Mesh_generator::cylinder(
-            5,
-            tesseract_thickness_ / current(3),
-            tesseract_thickness_ / next(3),
-            glm::vec3(current(0), current(1), current(2)),
-            glm::vec3(next(0), next(1), next(2)),
-            col,
-            t_mesh);
+    const glm::vec4 d = glm::abs(a - b);
+    return std::max(std::max(d.r, d.g), std::max(d.b, d.a)) <=
+           Max_merge_color_diff;
+}
 
-    }
+//******************************************************************************
+// speed_color
+//
+// Color of the curve edge 'i' on the logarithmic scale of the speeds
+//******************************************************************************
 
-    for(unsigned int i = 0; i < t.get_vertices().size(); ++i)
-    {
-        float size_coef = 1.f;
+glm::vec4 speed_color(
+    const Curve_stats& stats,
+    size_t i,
+    float opacity,
+    const Color& slow_c,
+    const Color& fast_c)
+{
+    const float normalized_speed = (stats.speed[i] - stats.min_speed) /
+                                   (stats.max_speed - stats.min_speed);
+    const float speed = std::log2(3 * normalized_speed + 1) / 2;
+
+    return glm::vec4(
+        (1 - speed) * slow_c.r_norm() + speed * fast_c.r_norm(),
+        (1 - speed) * slow_c.g_norm() + speed * fast_c.g_norm(),
+        (1 - speed) * slow_c.b_norm() + speed * fast_c.b_norm(),
+        opacity);
+}
+} // namespace
 
-        auto const& v = t.get_vertices()[i];
-        glm::vec3 pos(v(0), v(1), v(2));
+//******************************************************************************
+// draw_tesseract
+//******************************************************************************
 
-        if(i == 0)
-            Mesh_generator::sphere(
-                6,
-                6,
-                size_coef * sphere_diameter_ / v(3),
-                pos,
-                glm::vec4(1.f, 0.f, 0.f, 1.f),
-                t_mesh);
-        else
-            Mesh_generator::sphere(
-                6,
-                6,
-                size_coef * sphere_diameter_ / v(3),
-                pos,
-                glm::vec4(0.59f, 0.59f, 0.59f, 1.f),
-                t_mesh);
+void Scene_renderer::draw_tesseract(Scene_wireframe_object& t)
+{
+    // The projected tesseract is small, therefore the task keeps a copy of it
+    back_batch_.add([this, t](Mesh_emitter& emitter) {
+        for(auto const& e : t.edges())
+        {
+            auto& current = t.vertices()[e.vert1];
+            auto& next = t.vertices()[e.vert2];
+            const glm::vec4 col = ColorToGlm(e.color, 1.f);
+
+            emit_tube(
+                emitter,
+                tesseract_thickness_ / current(3),
+                tesseract_thickness_ / next(3),
+                glm::vec3(current(0), current(1), current(2)),
+                glm::vec3(next(0), next(1), next(2)),
+                col);
+        }
 
-    }
+        for(unsigned int i = 0; i < t.vertices().size(); ++i)
+        {
+            float size_coef = 1.f;
+
+            auto const& v = t.vertices()[i];
+            glm::vec3 pos(v(0), v(1), v(2));
 
-    diffuse_shader_->append_to_geometry(*back_geometry_.get(), t_mesh);
+            if(i == 0)
+                emit_sphere(
+                    emitter,
+                    size_coef * sphere_diameter_ / v(3),
+                    pos,
+                    glm::vec4(1.f, 0.f, 0.f, 1.f));
+            else
+                emit_sphere(
+                    emitter,
+                    size_coef * sphere_diameter_ / v(3),
+                    pos,
+                    glm::vec4(0.59f, 0.59f, 0.59f, 1.f));
+        }
+    });
 }
 
 //******************************************************************************
@@ -599,104 +798,138 @@ void Scene_renderer::draw_curve(
     const Color& slow_c,
     const Color& fast_c)
 {
-    const float marker_size = 8.f; //gui_.markerSize->value();
-
-    auto log_speed = [](float speed) {
-        return std::log2(3 * speed + 1) / 2;
-    };
+    // Only the edges in the selected time range are visited
+    std::pair<size_t, size_t> edges(0, c.edges().size());
+    if(state_->curve_selection)
+        edges = c.get_index_range(*state_->curve_selection.get());
+
+    // Curve. The curve must stay alive until the meshes are built
+    auto curve_task = [&c, edges, opacity, slow_c, fast_c, this](
+                          Mesh_emitter& emitter) {
+        auto point = [&c](size_t i) {
+            const auto& p = c.vertices()[i];
+            return glm::vec3(p(0), p(1), p(2));
+        };
 
-    auto get_speed_color =
-        [&opacity, &log_speed, &slow_c, &fast_c, this](float normalized_speed) {
-            float speed = log_speed(normalized_speed);
-            return glm::vec4(
-                (1 - speed) * slow_c.r_norm() +
-                    speed * fast_c.r_norm(),
-                (1 - speed) * slow_c.g_norm() +
-                    speed * fast_c.g_norm(),
-                (1 - speed) * slow_c.b_norm() +
-                    speed * fast_c.b_norm(),
-                opacity);
+        // Direction of the curve at a point, the tube ends are cut by the
+        // planes orthogonal to it
+        const size_t num_points = c.vertices().size();
+        auto point_direction = [&point, num_points](size_t i) {
+            if(i == 0)
+                return glm::normalize(point(1) - point(0));
+            if(i == num_points - 1)
+                return glm::normalize(point(i) - point(i - 1));
+
+            const glm::vec3 dir1 = glm::normalize(point(i) - point(i - 1));
+            const glm::vec3 dir2 = glm::normalize(point(i + 1) - point(i));
+            return glm::normalize(dir1 + dir2);
         };
 
-    // Curve
-    Mesh curve_mesh;
-    std::vector<glm::vec3> point_directions(c.vertices().size());
-    { // first
-        const auto& a = c.get_vertices()[0];
-        const auto& b = c.get_vertices()[1];
-        point_directions.front() = glm::normalize(
-            glm::vec3(b[0], b[1], b[2]) - glm::vec3(a[0], a[1], a[2]));
-    }
-    for(size_t i = 1; i < c.vertices().size() - 1; ++i)
-    {
-        const auto& p1 = c.vertices()[i - 1];
-        const auto& p2 = c.vertices()[i];
-        const auto& p3 = c.vertices()[i + 1];
-        const glm::vec3 dir1 = glm::normalize(
-            glm::vec3(p2[0], p2[1], p2[2]) - glm::vec3(p1[0], p1[1], p1[2]));
-        const glm::vec3 dir2 = glm::normalize(
-            glm::vec3(p3[0], p3[1], p3[2]) - glm::vec3(p2[0], p2[1], p2[2]));
-        point_directions[i] = glm::normalize(dir1 + dir2);
-    }
-    { // last
-        const auto& a = c.vertices()[c.vertices().size() - 2];
-        const auto& b = c.vertices()[c.vertices().size() - 1];
-        point_directions.back() = glm::normalize(
-            glm::vec3(b[0], b[1], b[2]) - glm::vec3(a[0], a[1], a[2]));
-    }
+        auto& stats = c.get_stats();
 
-    for(size_t i = 0; i < c.edges().size(); ++i)
-    {
-        const auto& e = c.edges()[i];
+        auto edge_color = [&](size_t i) {
+            return speed_color(stats, i, opacity, slow_c, fast_c);
+        };
 
-        auto& current = c.get_vertices()[e.vert1];
-        auto& next = c.get_vertices()[e.vert2];
+        // Edge 'i' connects the points 'i' and 'i + 1', the edge is visible if
+        // its first point is in the selected range
+        const size_t end_edge = std::min(edges.second, c.edges().size());
 
-        // We are interested only in some interval of the curve
-        if(state_->curve_selection &&
-           !state_->curve_selection->in_range(c.time_stamp()[e.vert1]))
+        for(size_t i = edges.first; i < end_edge;)
         {
-            continue;
+            const auto& first = c.edges()[i];
+            const glm::vec4 color = edge_color(i);
+            const glm::vec3 start = point(first.vert1);
+            const glm::vec3 run_dir =
+                glm::normalize(point(first.vert2) - start);
+
+            // Merge the following segments that are nearly collinear or too
+            // short to be seen, and have nearly the same color
+            size_t last = i;
+            while(last + 1 < end_edge)
+            {
+                const auto& e = c.edges()[last + 1];
+                if(!similar_colors(edge_color(last + 1), color))
+                    break;
+
+                const glm::vec3 a = point(e.vert1), b = point(e.vert2);
+                const bool collinear =
+                    glm::dot(glm::normalize(b - a), run_dir) > Min_merge_cos;
+                const bool tiny = glm::distance(to_screen(a), to_screen(b)) <
+                                  Min_segment_length;
+                if(!collinear && !tiny)
+                    break;
+
+                ++last;
+            }
+
+            const auto& current = c.vertices()[first.vert1];
+            const auto& next = c.vertices()[c.edges()[last].vert2];
+            const float start_diameter = curve_thickness_ / current(3),
+                        end_diameter = curve_thickness_ / next(3);
+            const glm::vec3 end = point(c.edges()[last].vert2);
+
+            emitter.cylinder_v2(
+                std::max(
+                    tessellation_level(start, start_diameter),
+                    tessellation_level(end, end_diameter)),
+                start_diameter,
+                end_diameter,
+                start,
+                end,
+                point_direction(first.vert1),
+                point_direction(c.edges()[last].vert2),
+                color);
+
+            i = last + 1;
         }
+    };
 
-        auto& stats = c.get_stats();
-        float speed_coeff = (stats.speed[i] - stats.min_speed) /
-                            (stats.max_speed - stats.min_speed);
-
-        Mesh_generator::cylinder_v2(
-            5,
-            curve_thickness_ / current(3),
-            curve_thickness_ / next(3),
-            glm::vec3(current(0), current(1), current(2)),
-            glm::vec3(next(0), next(1), next(2)),
-            point_directions[i],
-            point_directions[i + 1],
-            get_speed_color(speed_coeff),
-            curve_mesh);
+    if(edges.first < edges.second)
+    {
+        auto& batch = opacity < 1.f ? front_batch_ : back_batch_;
+        batch.add(curve_task);
     }
-    // TODO: fix the line below
-    //gui_.Renderer->add_mesh(curve_mesh, opacity < 1.);
-    if(opacity < 1.f)
-        diffuse_shader_->append_to_geometry(*front_geometry_.get(), curve_mesh);
-    else
-        diffuse_shader_->append_to_geometry(*back_geometry_.get(), curve_mesh);
+}
 
+//******************************************************************************
+// draw_time_marker
+//
+// The marker is built by 'build_time_markers', so moving it does not rebuild
+// the other meshes
+//******************************************************************************
+
+void Scene_renderer::draw_time_marker(
+    size_t curve,
+    const Affine_map& map,
+    const glm::mat4& post_map)
+{
+    time_markers_.push_back({curve, map, post_map});
+}
+
+//******************************************************************************
+// build_time_markers
+//******************************************************************************
+
+void Scene_renderer::build_time_markers()
+{
+    const float marker_size = 8.f; //gui_.markerSize->value();
 
-    if(state_->is_timeplayer_active)
+    if(!state_->is_timeplayer_active)
+        return;
+
+    Mesh_emitter emitter(*marker_geometry_.get());
+    for(const auto& m : time_markers_)
     {
-        auto marker =
-            c.get_point(c.t_min() + state_->timeplayer_pos * c.t_duration());
-
-        Mesh marker_mesh;
-        Mesh_generator::sphere(
-            5,
-            5,
-            marker_size / marker(3),
-            glm::vec3(marker(0), marker(1), marker(2)),
-            glm::vec4(1, 0, 0, 1),
-            marker_mesh);
-
-        diffuse_shader_->append_to_geometry(*back_geometry_.get(), marker_mesh);
+        auto& c = *state_->curves[m.curve];
+        const auto marker = transform_point(
+            c.get_point(c.t_min() + state_->timeplayer_pos * c.t_duration()),
+            m.map,
+            m.post_map);
+        const glm::vec3 pos(marker(0), marker(1), marker(2));
+
+        emit_sphere(
+            emitter, marker_size / marker(3), pos, glm::vec4(1, 0, 0, 1));
     }
 }
 
@@ -706,16 +939,34 @@ void Scene_renderer::draw_curve(
 
 void Scene_renderer::set_line_thickness(float t_thickness, float c_thickness)
 {
+    if(tesseract_thickness_ != t_thickness || curve_thickness_ != c_thickness)
+        state_->mark_dirty(Scene_state::Dirty_view);
+
     tesseract_thickness_ = t_thickness;
     curve_thickness_ = c_thickness;
 }
 
+//******************************************************************************
+// set_gpu_projection
+//******************************************************************************
+
+void Scene_renderer::set_gpu_projection(bool enable)
+{
+    if(gpu_projection_ != enable)
+        state_->mark_dirty(Scene_state::Dirty_view);
+
+    gpu_projection_ = enable;
+}
+
 //******************************************************************************
 // set_sphere_diameter
 //******************************************************************************
 
 void Scene_renderer::set_sphere_diameter(float diameter)
 {
+    if(sphere_diameter_ != diameter)
+        state_->mark_dirty(Scene_state::Dirty_view);
+
     sphere_diameter_ = diameter;
 }
 
@@ -756,11 +1007,101 @@ std::vector<float> Scene_renderer::split_animation(float animation,
     return splited_animations;
 }
 
+//******************************************************************************
+// to_screen
+//******************************************************************************
+
+glm::vec2 Scene_renderer::to_screen(const glm::vec3& point) const
+{
+    const glm::vec4 clip = mvp_mat_ * glm::vec4(point, 1.f);
+    return glm::vec2(clip.x, clip.y) / clip.w * viewport_scale_;
+}
+
+//******************************************************************************
+// tessellation_level
+//
+// The number of sides of a tube (or rings of a sphere) for which the polygonal
+// approximation does not deviate from the true surface more than
+// Max_chord_error pixels
+//******************************************************************************
+
+unsigned int Scene_renderer::tessellation_level(
+    const glm::vec3& point,
+    float diameter) const
+{
+    const float w = (mvp_mat_ * glm::vec4(point, 1.f)).w;
+    // Behind the camera
+    if(w <= 0.f)
+        return Min_tube_sides;
+
+    const float radius_px = 0.5f * diameter * pixels_per_unit_ / w;
+    if(radius_px <= Max_chord_error)
+        return Min_tube_sides;
+
+    // The chord error of a regular n-gon is r * (1 - cos(pi / n))
+    const float sides = static_cast<float>(
+        PI_ / std::acos(1.f - Max_chord_error / radius_px));
+
+    return glm::clamp(
+        static_cast<unsigned int>(std::ceil(sides)),
+        Min_tube_sides,
+        Max_tube_sides);
+}
+
+//******************************************************************************
+// emit_tube
+//******************************************************************************
+
+void Scene_renderer::emit_tube(
+    Mesh_emitter& emitter,
+    float start_diameter,
+    float end_diameter,
+    const glm::vec3& start_point,
+    const glm::vec3& end_point,
+    const glm::vec4& color) const
+{
+    const unsigned int sides = std::max(
+        tessellation_level(start_point, start_diameter),
+        tessellation_level(end_point, end_diameter));
+
+    emitter.cylinder(
+        sides,
+        start_diameter,
+        end_diameter,
+        start_point,
+        end_point,
+        color);
+}
+
+//******************************************************************************
+// emit_sphere
+//******************************************************************************
+
+void Scene_renderer::emit_sphere(
+    Mesh_emitter& emitter,
+    float diameter,
+    const glm::vec3& position,
+    const glm::vec4& color) const
+{
+    // Mesh_emitter::sphere treats the diameter as the radius
+    const unsigned int rings = tessellation_level(position, 2.f * diameter);
+    // Segments cover a half circle
+    const unsigned int segments = std::max(2u, (rings + 1) / 2);
+
+    emitter.sphere(segments, rings, diameter, position, color);
+}
+
 //******************************************************************************
 // draw_annotations
+//
+// The annotations of the curve 'curve' are moved by the maps of its tubes
 //******************************************************************************
 
-void Scene_renderer::draw_annotations(Curve& c, const glm::mat4& projection)
+void Scene_renderer::draw_annotations(
+    size_t curve,
+    const Affine_map& map,
+    const glm::mat4& post_map,
+    const glm::mat4& projection)
 {
     // Parameters
     const float min_arrow_dist(0.1f),
@@ -771,8 +1112,16 @@ void Scene_renderer::draw_annotations(Curve& c, const glm::mat4& projection)
     const glm::vec4 arrow_color(0.f, 0.f, 0.f, 1.f),
                     sphere_color(0.f, 0.f, 0.f, 1.f);
 
+    auto& c = *state_->curves[curve];
     auto annot_arrows = c.get_arrows(*state_->curve_selection.get());
     auto annot_dots = c.get_markers(*state_->curve_selection.get());
+    for(auto& a : annot_arrows)
+    {
+        a.point = transform_point(a.point, map, post_map);
+        a.dir = transform_point(a.dir, map, post_map);
+    }
+    for(auto& d : annot_dots)
+        d = transform_point(d, map, post_map);
 
     // This variable points either to the filtered or original arrows
     std::vector<Curve_annotations>* annot_ptr;
@@ -873,18 +1222,18 @@ void Scene_renderer::draw_annotations(Curve& c, const glm::mat4& projection)
 
     // Draw switch points
 
-    for(auto& a : annot_dots)
-    {
-        Mesh mesh;
-        Mesh_generator::sphere(
-            5,
-            5,
-            sphere_diam / a(3),
-            glm::vec3(a(0), a(1), a(2)),
-            sphere_color,
-            mesh);
-        diffuse_shader_->append_to_geometry(*back_geometry_.get(), mesh);
-    }
+    back_batch_.add(
+        [this, dots = std::move(annot_dots), sphere_diam, sphere_color](
+            Mesh_emitter& emitter) {
+            for(auto& a : dots)
+            {
+                emit_sphere(
+                    emitter,
+                    sphere_diam / a(3),
+                    glm::vec3(a(0), a(1), a(2)),
+                    sphere_color);
+            }
+        });
 }
 
 //******************************************************************************
@@ -959,95 +1308,463 @@ void Scene_renderer::draw_legend(const Region& region)
         color_to_vec4(state_->get_color(W_axis)));
 }
 
+namespace
+{
+typedef boost::numeric::ublas::matrix<float> Matrix;
+
 //******************************************************************************
-// move_curves_to_3D_plots
+// identity_map
 //******************************************************************************
 
-void Scene_renderer::move_curves_to_3D_plots(float coeff,
-                                             std::vector<Curve>& curves)
+Matrix identity_map()
 {
-    // Curve 1
-    for(auto& v : curves[0].get_vertices())
-        v(3) = v(3) + coeff * (state_->tesseract_size[3] / 2 - v(3));
-    // Curve 2
-    for(auto& v : curves[1].get_vertices())
-        v(3) = v(3) + coeff * (-state_->tesseract_size[3] / 2 - v(3));
-    // Curve 3
-    for(auto& v : curves[2].get_vertices())
-        v(2) = v(2) + coeff * (state_->tesseract_size[2] / 2 - v(2));
-    // Curve 4
-    for(auto& v : curves[3].get_vertices())
-        v(2) = v(2) + coeff * (-state_->tesseract_size[2] / 2 - v(2));
-    // Curve 5
-    for(auto& v : curves[4].get_vertices())
-        v(1) = v(1) + coeff * (-state_->tesseract_size[1] / 2 - v(1));
-    // Curve 6
-    for(auto& v : curves[5].get_vertices())
-        v(1) = v(1) + coeff * (state_->tesseract_size[1] / 2 - v(1));
-    // Curve 7
-    for(auto& v : curves[6].get_vertices())
-        v(0) = v(0) + coeff * (-state_->tesseract_size[0] / 2 - v(0));
-    // Curve 8
-    for(auto& v : curves[7].get_vertices())
-        v(0) = v(0) + coeff * (state_->tesseract_size[0] / 2 - v(0));
+    return boost::numeric::ublas::identity_matrix<float>(5);
 }
 
 //******************************************************************************
-// move_curves_to_2D_plots
+// translation_map
 //******************************************************************************
 
-void Scene_renderer::move_curves_to_2D_plots(
-    float coeff,
-    std::vector<Curve>& curves)
+Matrix translation_map(const Scene_vertex_t& disp)
 {
-    // Curve 1
-    for(auto& v : curves[0].get_vertices())
-        v(2) = v(2) + coeff * (-state_->tesseract_size[2] / 2 - v(2));
-    // Curve 2
-    for(auto& v : curves[1].get_vertices())
-        v(2) = v(2) + coeff * (-state_->tesseract_size[2] / 2 - v(2));
-    // Curve 3
-    for(auto& v : curves[2].get_vertices())
-        v(2) = v(2) + coeff * (-state_->tesseract_size[2] / 2 - v(2));
-    // Curve 4
-    for(auto& v : curves[3].get_vertices())
-        v(1) = v(1) + coeff * (-state_->tesseract_size[1] / 2 - v(1));
-    // Curve 5
-    for(auto& v : curves[4].get_vertices())
-        v(1) = v(1) + coeff * (-state_->tesseract_size[1] / 2 - v(1));
-    // Curve 6
-    for(auto& v : curves[5].get_vertices())
-        v(0) = v(0) + coeff *
-        (0.5f * state_->tesseract_size[0] + state_->tesseract_size[3] - v(0));
+    auto m = identity_map();
+    for(int i = 0; i < 4; ++i)
+        m(4, i) = disp(i);
+    return m;
 }
 
 //******************************************************************************
-// tesseract_unfolding
+// rotation_about
+//
+// Rotation of the points displaced by 'disp', i.e. (v + disp) * rot - disp
 //******************************************************************************
 
-void Scene_renderer::tesseract_unfolding(
-    float coeff,
-    std::vector<Cube>& plots_3D,
-    std::vector<std::vector<Curve>>& curves_3D)
+Matrix rotation_about(const Matrix& rot, const Scene_vertex_t& disp)
+{
+    Matrix m = prod(translation_map(disp), rot);
+    return prod(m, translation_map(-disp));
+}
+
+//******************************************************************************
+// rotation_about
+//
+// 3D rotation of the displaced points as a column-major glm matrix
+//******************************************************************************
+
+glm::mat4 rotation_about(const Matrix& rot, const glm::vec3& disp)
 {
-    auto transform_3D_plot =
-        [](Scene_wireframe_object& c,
-           boost::numeric::ublas::matrix<float>& rot,
-           Scene_vertex_t disp)
+    glm::mat4 m(1.f);
+    for(int i = 0; i < 3; ++i)
     {
-        for(auto& v : c.get_vertices())
-        {
-            for(int i = 0; i < 5; ++i)
-                v(i) += disp(i);
+        for(int j = 0; j < 3; ++j)
+            m[i][j] = rot(i, j);
+    }
+
+    return glm::translate(glm::mat4(1.f), -disp) * m *
+           glm::translate(glm::mat4(1.f), disp);
+}
+
+//******************************************************************************
+// transform_vertex
+//******************************************************************************
+
+void transform_vertex(Scene_vertex_t& v, const glm::mat4& m)
+{
+    const glm::vec4 p = m * glm::vec4(v(0), v(1), v(2), 1.f);
+    v(0) = p.x;
+    v(1) = p.y;
+    v(2) = p.z;
+    v(4) = 0.f;
+}
+
+//******************************************************************************
+// map_point
+//
+// Maps a point with the 5x5 matrix 'm', 'p' is the row of the 4D projection
+// the fifth coordinate of the point is weighted by
+//******************************************************************************
+
+void map_point(
+    const float (&m)[5][5],
+    const float (&p)[5],
+    const Scene_vertex_t& v,
+    Scene_vertex_t& t)
+{
+    const float in[4] = {v(0), v(1), v(2), v(3)};
+    const float w = v(4);
+
+    float out[5];
+    for(int j = 0; j < 5; ++j)
+    {
+        out[j] = in[0] * m[0][j] + in[1] * m[1][j] + in[2] * m[2][j] +
+                 in[3] * m[3][j] + m[4][j] + w * p[j];
+    }
 
-            v = prod(v, rot);
+    // Original coordinates in out[3] and out[4] are kept, they are
+    // required for the 4D perspective
+    t(0) = out[0] / out[4];
+    t(1) = out[1] / out[4];
+    t(2) = out[2] / out[4];
+    t(3) = out[3];
+    t(4) = out[4];
+}
+
+} // namespace
+
+//******************************************************************************
+// move_to_3D_plot
+//
+// Moves the points towards the 3D plot along the axis orthogonal to it
+//******************************************************************************
+
+Scene_renderer::Affine_map Scene_renderer::move_to_3D_plot(
+    size_t plot,
+    float coeff) const
+{
+    // Axis and side of the plots
+    const int axes[]    = { 3,  3,  2,  2,  1,  1,  0,  0};
+    const float sides[] = { 1, -1,  1, -1, -1,  1, -1,  1};
+
+    const int a = axes[plot];
+    const float target = sides[plot] * state_->tesseract_size[a] / 2;
+
+    auto m = identity_map();
+    m(a, a) = 1 - coeff;
+    m(4, a) = coeff * target;
+    return m;
+}
+
+//******************************************************************************
+// move_to_2D_plot
+//******************************************************************************
+
+Scene_renderer::Affine_map Scene_renderer::move_to_2D_plot(
+    size_t plot,
+    float coeff) const
+{
+    const int axes[] = {2, 2, 2, 1, 1, 0};
+    const float targets[] = {
+        -state_->tesseract_size[2] / 2,
+        -state_->tesseract_size[2] / 2,
+        -state_->tesseract_size[2] / 2,
+        -state_->tesseract_size[1] / 2,
+        -state_->tesseract_size[1] / 2,
+        0.5f * state_->tesseract_size[0] + state_->tesseract_size[3]};
+
+    const int a = axes[plot];
+
+    auto m = identity_map();
+    m(a, a) = 1 - coeff;
+    m(4, a) = coeff * targets[plot];
+    return m;
+}
+
+//******************************************************************************
+// get_projection_map
+//
+// The 4D rotation, the camera and the 4D projection. The contribution of the
+// fifth coordinate of the points and the perspective division are added by
+// 'transform_curve'
+//******************************************************************************
+
+Scene_renderer::Affine_map Scene_renderer::get_projection_map(
+    const boost::numeric::ublas::matrix<float>& rot_mat) const
+{
+    Matrix projection = state_->projection_4D;
+    for(int j = 0; j < 5; ++j)
+        projection(4, j) = 0.f;
+
+    Affine_map m = prod(rot_mat, translation_map(-state_->camera_4D));
+    return prod(m, projection);
+}
+
+//******************************************************************************
+// transform_curve
+//
+// Maps the points of 'source' with 'map', divides them by the perspective and
+// applies the 3D 'post_map' if it is given. 'target' must be a copy of
+// 'source'. The maps work on the 4D points in homogeneous coordinates, the
+// fifth coordinate of the points is only used by the 4D projection
+//******************************************************************************
+
+void Scene_renderer::transform_curve(
+    const Curve& source,
+    const Affine_map& map,
+    const glm::mat4* post_map,
+    Curve& target)
+{
+    PROFILE_ACCUMULATE("Unfolding");
+
+    float m[5][5], p[5];
+    for(int i = 0; i < 5; ++i)
+    {
+        for(int j = 0; j < 5; ++j)
+            m[i][j] = map(i, j);
+    }
+    for(int j = 0; j < 5; ++j)
+        p[j] = state_->projection_4D(4, j);
+
+    const auto& src = source.vertices();
+    auto& dst = target.get_vertices();
+    assert(src.size() == dst.size());
+
+    for(size_t k = 0; k < src.size(); ++k)
+    {
+        map_point(m, p, src[k], dst[k]);
+
+        if(post_map)
+            transform_vertex(dst[k], *post_map);
+    }
+}
+
+//******************************************************************************
+// transform_point
+//
+// Maps a single point like 'transform_curve'
+//******************************************************************************
+
+Scene_vertex_t Scene_renderer::transform_point(
+    const Scene_vertex_t& point,
+    const Affine_map& map,
+    const glm::mat4& post_map) const
+{
+    float m[5][5], p[5];
+    for(int i = 0; i < 5; ++i)
+    {
+        for(int j = 0; j < 5; ++j)
+            m[i][j] = map(i, j);
+    }
+    for(int j = 0; j < 5; ++j)
+        p[j] = state_->projection_4D(4, j);
+
+    Scene_vertex_t t(5);
+    map_point(m, p, point, t);
+    transform_vertex(t, post_map);
+    return t;
+}
+
+//******************************************************************************
+// update_curve_copies
+//******************************************************************************
+
+void Scene_renderer::update_curve_copies()
+{
+    bool is_valid = curve_copies_.size() == state_->curves.size() &&
+                    !state_->is_dirty(Scene_state::Dirty_curves);
+    for(size_t i = 0; is_valid && i < curve_copies_.size(); ++i)
+        is_valid = curve_copies_[i].source.lock() == state_->curves[i];
+
+    if(is_valid)
+        return;
 
-            for(int i = 0; i < 5; ++i)
-                v(i) -= disp(i);
+    curve_copies_.clear();
+    for(const auto& c : state_->curves)
+    {
+        Curve_copies copies;
+        copies.source = c;
+        copies.projected = *c;
+        copies.plots_3D.assign(8, *c);
+        copies.plots_2D.assign(6, *c);
+        curve_copies_.push_back(std::move(copies));
+    }
+}
+
+//******************************************************************************
+// build_hyper_curves
+//******************************************************************************
+
+void Scene_renderer::build_hyper_curves()
+{
+    PROFILE_SCOPE("Hyper curves");
+
+    hyper_geometry_->data_array.clear();
+    hyper_geometry_->indices.clear();
+
+    for(size_t ci = 0; ci < state_->curves.size(); ++ci)
+    {
+        if(state_->use_unique_curve_colors)
+        {
+            const Color& color = state_->get_curve_color(ci);
+            emit_hyper_curve(*state_->curves[ci], color, color);
+        }
+        else
+        {
+            emit_hyper_curve(
+                *state_->curves[ci],
+                state_->get_color(Curve_low_speed),
+                state_->get_color(Curve_high_speed));
         }
+    }
+
+    hyper_geometry_->update_buffers(GL_STATIC_DRAW);
+    is_hyper_dirty_ = false;
+}
+
+//******************************************************************************
+// emit_hyper_curve
+//
+// The tubes of 'draw_curve' around the unprojected curve. Collinear segments
+// stay collinear in the projection, therefore they are merged in 4D. Short
+// segments are not merged because their length on screen changes with the
+// projection
+//******************************************************************************
+
+void Scene_renderer::emit_hyper_curve(
+    const Curve& c,
+    const Color& slow_c,
+    const Color& fast_c)
+{
+    std::pair<size_t, size_t> edges(0, c.edges().size());
+    if(state_->curve_selection)
+        edges = c.get_index_range(*state_->curve_selection.get());
+
+    auto point = [&c](size_t i) {
+        const auto& p = c.vertices()[i];
+        return glm::vec4(p(0), p(1), p(2), p(3));
+    };
+
+    const size_t num_points = c.vertices().size();
+    auto point_direction = [&point, num_points](size_t i) {
+        if(i == 0)
+            return glm::normalize(point(1) - point(0));
+        if(i == num_points - 1)
+            return glm::normalize(point(i) - point(i - 1));
+
+        const glm::vec4 dir1 = glm::normalize(point(i) - point(i - 1));
+        const glm::vec4 dir2 = glm::normalize(point(i + 1) - point(i));
+        return glm::normalize(dir1 + dir2);
     };
 
-    // Cube and curve 1 and 5
+    auto& stats = c.get_stats();
+    auto edge_color = [&](size_t i) {
+        return speed_color(stats, i, 1.f, slow_c, fast_c);
+    };
+
+    float ring_cos[Hyper_tube_sides + 1], ring_sin[Hyper_tube_sides + 1];
+    for(unsigned int k = 0; k <= Hyper_tube_sides; ++k)
+    {
+        const double angle = 2 * PI_ * k / Hyper_tube_sides;
+        ring_cos[k] = static_cast<float>(std::cos(angle));
+        ring_sin[k] = static_cast<float>(std::sin(angle));
+    }
+
+    auto& verts = hyper_geometry_->data_array;
+    auto& indices = hyper_geometry_->indices;
+
+    const size_t end_edge = std::min(edges.second, c.edges().size());
+    for(size_t i = edges.first; i < end_edge;)
+    {
+        const auto& first = c.edges()[i];
+        const glm::vec4 color = edge_color(i);
+        const glm::vec4 start = point(first.vert1);
+        const glm::vec4 run_dir = glm::normalize(point(first.vert2) - start);
+
+        size_t last = i;
+        while(last + 1 < end_edge)
+        {
+            const auto& e = c.edges()[last + 1];
+            if(!similar_colors(edge_color(last + 1), color))
+                break;
+
+            const glm::vec4 dir = point(e.vert2) - point(e.vert1);
+            if(glm::dot(glm::normalize(dir), run_dir) <= Min_merge_cos)
+                break;
+
+            ++last;
+        }
+
+        const size_t end_ind = c.edges()[last].vert2;
+        const glm::vec4 end = point(end_ind);
+        const auto start_joint =
+            Diffuse_shader::pack_direction(point_direction(first.vert1));
+        const auto end_joint =
+            Diffuse_shader::pack_direction(point_direction(end_ind));
+        const auto packed_color = Diffuse_shader::pack_color(color);
+        const float start_w = c.vertices()[first.vert1](4),
+                    end_w = c.vertices()[end_ind](4);
+
+        // The vertices of both rings alternate, as in Mesh_emitter
+        const GLuint ind = static_cast<GLuint>(verts.size());
+        for(unsigned int k = 0; k <= Hyper_tube_sides; ++k)
+        {
+            Diffuse_shader::Hyper_array v;
+            v.point = start;
+            v.other = end;
+            v.joint = start_joint;
+            v.ring  = glm::vec4(ring_cos[k], ring_sin[k], 0.f, start_w);
+            v.color = packed_color;
+            verts.push_back(v);
+
+            v.point = end;
+            v.other = start;
+            v.joint = end_joint;
+            v.ring  = glm::vec4(ring_cos[k], ring_sin[k], 1.f, end_w);
+            verts.push_back(v);
+        }
+
+        for(unsigned int k = 0; k < Hyper_tube_sides; ++k)
+        {
+            const GLuint shift = ind + 2 * k;
+            indices.insert(indices.end(), {shift,     shift + 2, shift + 1,
+                                           shift + 1, shift + 2, shift + 3});
+        }
+
+        i = last + 1;
+    }
+}
+
+//******************************************************************************
+// set_hyper_uniforms
+//******************************************************************************
+
+void Scene_renderer::set_hyper_uniforms(const Hyper_draw& draw)
+{
+    const auto& m = draw.map;
+    const auto& p = state_->projection_4D;
+
+    glm::mat4 matrix;
+    glm::vec4 column, offset, w_row;
+    for(int i = 0; i < 4; ++i)
+    {
+        for(int j = 0; j < 4; ++j)
+            matrix[i][j] = m(i, j);
+
+        column[i] = m(i, 4);
+        offset[i] = m(4, i);
+        w_row[i]  = p(4, i);
+    }
+
+    glUniformMatrix4fv(diffuse_shader_->hyper_matrix_id,
+                       1,
+                       GL_FALSE,
+                       glm::value_ptr(matrix));
+    glUniform4fv(diffuse_shader_->hyper_column_id, 1, glm::value_ptr(column));
+    glUniform4fv(diffuse_shader_->hyper_offset_id, 1, glm::value_ptr(offset));
+    glUniform4fv(diffuse_shader_->hyper_w_row_id, 1, glm::value_ptr(w_row));
+    glUniform2f(diffuse_shader_->hyper_corner_id, m(4, 4), p(4, 4));
+    glUniform1f(diffuse_shader_->hyper_thickness_id, curve_thickness_);
+    glUniformMatrix4fv(diffuse_shader_->hyper_post_matrix_id,
+                       1,
+                       GL_FALSE,
+                       glm::value_ptr(draw.post_map));
+    glUniform1f(diffuse_shader_->hyper_opacity_id, draw.opacity);
+}
+
+//******************************************************************************
+// tesseract_unfolding
+//
+// Unfolds the 3D plots and returns their maps
+//******************************************************************************
+
+std::vector<Scene_renderer::Affine_map> Scene_renderer::tesseract_unfolding(
+    float coeff,
+    std::vector<Cube>& plots_3D)
+{
+    PROFILE_SCOPE("Unfolding");
+
+    std::vector<Affine_map> maps(plots_3D.size(), identity_map());
+
+    // Cube 1 and 5
     {
         auto rot = Matrix_lib_f::getYWRotationMatrix(
             static_cast<float>(-coeff * PI_ / 2));
@@ -1058,24 +1775,17 @@ void Scene_renderer::tesseract_unfolding(
                   state_->tesseract_size[3] / 2,
                   0;
 
-        transform_3D_plot(plots_3D[0], rot, disp1);
-        transform_3D_plot(plots_3D[4], rot, disp1);
+        maps[4] = rotation_about(rot, disp1);
 
-        const auto vert = plots_3D[4].get_vertices()[0];
+        // Cube 1 is attached to the unfolded cube 5
+        const Scene_vertex_t vert =
+            prod(plots_3D[4].get_vertices()[0], maps[4]);
         Scene_vertex_t disp2(5);
         disp2 <<= 0, -vert(1), 0, -vert(3), 0;
 
-        transform_3D_plot(plots_3D[0], rot, disp2);
-
-        for(auto& c: curves_3D)
-        {
-            transform_3D_plot(c[4], rot, disp1);
-
-            transform_3D_plot(c[0], rot, disp1);
-            transform_3D_plot(c[0], rot, disp2);
-        }
+        maps[0] = prod(maps[4], rotation_about(rot, disp2));
     }
-    // Cube and curve 3
+    // Cube 3
     {
         auto rot = Matrix_lib_f::getZWRotationMatrix(
             static_cast<float>(coeff * PI_ / 2));
@@ -1086,12 +1796,9 @@ void Scene_renderer::tesseract_unfolding(
                  state_->tesseract_size[3] / 2,
                  0;
 
-        transform_3D_plot(plots_3D[2], rot, disp);
-        
-        for(auto& c: curves_3D)
-            transform_3D_plot(c[2], rot, disp);
+        maps[2] = rotation_about(rot, disp);
     }
-    // Cube and curve 4
+    // Cube 4
     {
         auto rot = Matrix_lib_f::getZWRotationMatrix(
             static_cast<float>(-coeff * PI_ / 2));
@@ -1102,12 +1809,9 @@ void Scene_renderer::tesseract_unfolding(
                  state_->tesseract_size[3] / 2,
                  0;
 
-        transform_3D_plot(plots_3D[3], rot, disp);
-
-        for(auto& c: curves_3D)
-            transform_3D_plot(c[3], rot, disp);
+        maps[3] = rotation_about(rot, disp);
     }
-    // Cube and curve 6
+    // Cube 6
     {
         auto rot = Matrix_lib_f::getYWRotationMatrix(
             static_cast<float>(coeff * PI_ / 2));
@@ -1118,12 +1822,9 @@ void Scene_renderer::tesseract_unfolding(
                  state_->tesseract_size[3] / 2,
                  0;
 
-        transform_3D_plot(plots_3D[5], rot, disp);
-
-        for(auto& c: curves_3D)
-            transform_3D_plot(c[5], rot, disp);
+        maps[5] = rotation_about(rot, disp);
     }
-    // Cube and curve 7
+    // Cube 7
     {
         auto rot = Matrix_lib_f::getXWRotationMatrix(
             static_cast<float>(coeff * PI_ / 2));
@@ -1134,12 +1835,9 @@ void Scene_renderer::tesseract_unfolding(
                  state_->tesseract_size[3] / 2,
                  0;
 
-        transform_3D_plot(plots_3D[6], rot, disp);
-
-        for(auto& c: curves_3D)
-            transform_3D_plot(c[6], rot, disp);
+        maps[6] = rotation_about(rot, disp);
     }
-    // Cube and curve 8
+    // Cube 8
     {
         auto rot = Matrix_lib_f::getXWRotationMatrix(
             static_cast<float>(-coeff * PI_ / 2));
@@ -1150,11 +1848,16 @@ void Scene_renderer::tesseract_unfolding(
                   state_->tesseract_size[3] / 2,
                   0;
 
-        transform_3D_plot(plots_3D[7], rot, disp);
+        maps[7] = rotation_about(rot, disp);
+    }
 
-        for(auto& c: curves_3D)
-            transform_3D_plot(c[7], rot, disp);
+    for(size_t i = 0; i < plots_3D.size(); ++i)
+    {
+        for(auto& v : plots_3D[i].get_vertices())
+            v = prod(v, maps[i]);
     }
+
+    return maps;
 }
 
 //******************************************************************************
@@ -1203,30 +1906,25 @@ Scene_renderer::get_rotation_matrix(float view_straightening)
 
 void Scene_renderer::draw_3D_plot(Cube& cube, float opacity)
 {
-    for(size_t i = 0; i < cube.edges().size(); ++i)
-    {
-        auto const& e = cube.edges()[i];
-
-        Mesh t_mesh;
-
-        auto& current = cube.get_vertices()[e.vert1];
-        auto& next = cube.get_vertices()[e.vert2];
-        const glm::vec4 col = ColorToGlm(e.color, opacity);
-
-        Mesh_generator::cylinder(
-            5,
-            tesseract_thickness_ / current(3),
-            tesseract_thickness_ / next(3),
-            glm::vec3(current(0), current(1), current(2)),
-            glm::vec3(next(0), next(1), next(2)),
-            col,
-            t_mesh);
-
-        opacity < 1.0 ? diffuse_shader_->append_to_geometry(
-                            *front_geometry_.get(), t_mesh)
-                      : diffuse_shader_->append_to_geometry(
-                            *back_geometry_.get(), t_mesh);
-    }
+    auto& batch = opacity < 1.0 ? front_batch_ : back_batch_;
+    batch.add([this, cube, opacity](Mesh_emitter& emitter) {
+        for(size_t i = 0; i < cube.edges().size(); ++i)
+        {
+            auto const& e = cube.edges()[i];
+
+            auto& current = cube.vertices()[e.vert1];
+            auto& next = cube.vertices()[e.vert2];
+            const glm::vec4 col = ColorToGlm(e.color, opacity);
+
+            emit_tube(
+                emitter,
+                tesseract_thickness_ / current(3),
+                tesseract_thickness_ / next(3),
+                glm::vec3(current(0), current(1), current(2)),
+                glm::vec3(next(0), next(1), next(2)),
+                col);
+        }
+    });
 }
 
 //******************************************************************************
@@ -1235,100 +1933,76 @@ void Scene_renderer::draw_3D_plot(Cube& cube, float opacity)
 
 void Scene_renderer::draw_2D_plot(Scene_wireframe_object& plot)
 {
-    for(auto const& e : plot.edges())
-    {
-        Mesh t_mesh;
-
-        auto& current = plot.get_vertices()[e.vert1];
-        auto& next = plot.get_vertices()[e.vert2];
-        const glm::vec4 col = ColorToGlm(e.color, 1.f);
-
-        Mesh_generator::cylinder(
-            5,
-            tesseract_thickness_ / current(3),
-            tesseract_thickness_ / next(3),
-            glm::vec3(current(0), current(1), current(2)),
-            glm::vec3(next(0), next(1), next(2)),
-            col,
-            t_mesh);
-
-        diffuse_shader_->append_to_geometry(*back_geometry_.get(), t_mesh);
-    }
+    back_batch_.add([this, plot](Mesh_emitter& emitter) {
+        for(auto const& e : plot.edges())
+        {
+            auto& current = plot.vertices()[e.vert1];
+            auto& next = plot.vertices()[e.vert2];
+            const glm::vec4 col = ColorToGlm(e.color, 1.f);
+
+            emit_tube(
+                emitter,
+                tesseract_thickness_ / current(3),
+                tesseract_thickness_ / next(3),
+                glm::vec3(current(0), current(1), current(2)),
+                glm::vec3(next(0), next(1), next(2)),
+                col);
+        }
+    });
 }
 
 //******************************************************************************
 // plots_unfolding
+//
+// Unfolds the projected 2D plots and returns their 3D maps
 //******************************************************************************
 
-void Scene_renderer::plots_unfolding(
+std::vector<glm::mat4> Scene_renderer::plots_unfolding(
     float coeff,
-    std::vector<Square>& plots_2D,
-    std::vector<std::vector<Curve>>& curves_2D)
+    std::vector<Square>& plots_2D)
 {
-    auto transform_3D_plot =
-        [](Scene_wireframe_object& c,
-           boost::numeric::ublas::matrix<float>& rot,
-           Scene_vertex_t& disp)
-    {
-        for(auto& v : c.get_vertices())
-        {
-            // We have to create a copy vector of the size of four in order
-            // to multiype to the 4x4 rotation matrix
-            Scene_vertex_t copy_v(4);
-            copy_v <<= v(0), v(1), v(2), v(3);
-
-            for(int i = 0; i < 4; ++i)
-                copy_v(i) += disp(i);
-
-            copy_v = prod(copy_v, rot);
+    PROFILE_SCOPE("Unfolding");
 
-            for(int i = 0; i < 4; ++i)
-                copy_v(i) -= disp(i);
+    std::vector<glm::mat4> maps(plots_2D.size(), glm::mat4(1.f));
 
-            v <<= copy_v(0), copy_v(1), copy_v(2), copy_v(3), 0;
-        }
+    auto to_vec3 = [](const Scene_vertex_t& v) {
+        return glm::vec3(v(0), v(1), v(2));
     };
 
-    {
-        auto anchor = plots_2D[1].get_vertices()[0];
-        auto rot_axis =
-            plots_2D[1].get_vertices()[1] - plots_2D[1].get_vertices()[0];
+    auto rotation = [&](const Scene_vertex_t& anchor,
+                        const Scene_vertex_t& axis_start,
+                        const Scene_vertex_t& axis_end) {
+        const auto rot_axis = to_vec3(axis_end) - to_vec3(axis_start);
         auto rot = Matrix_lib_f::getRotationMatrix(
             static_cast<float>(coeff * PI_ / 2),
-            rot_axis(0),
-            rot_axis(1),
-            rot_axis(2));
-        Scene_vertex_t disp(5);
-        disp <<= -anchor(0), -anchor(1), -anchor(2), 0, 0;
+            rot_axis.x,
+            rot_axis.y,
+            rot_axis.z);
+        return rotation_about(rot, -to_vec3(anchor));
+    };
 
-        transform_3D_plot(plots_2D[3], rot, disp);
-        transform_3D_plot(plots_2D[4], rot, disp);
-        transform_3D_plot(plots_2D[5], rot, disp);
+    auto transform_plot = [&plots_2D, &maps](size_t i, const glm::mat4& m) {
+        for(auto& v : plots_2D[i].get_vertices())
+            transform_vertex(v, m);
+        maps[i] = m * maps[i];
+    };
 
-        for(auto& c: curves_2D)
-        {
-            transform_3D_plot(c[3], rot, disp);
-            transform_3D_plot(c[4], rot, disp);
-            transform_3D_plot(c[5], rot, disp);
-        }
+    {
+        const auto rot = rotation(plots_2D[1].get_vertices()[0],
+                                  plots_2D[1].get_vertices()[0],
+                                  plots_2D[1].get_vertices()[1]);
+        transform_plot(3, rot);
+        transform_plot(4, rot);
+        transform_plot(5, rot);
     }
     {
-        auto anchor = plots_2D[2].get_vertices()[1];
-        auto rot_axis =
-            plots_2D[4].get_vertices()[2] - plots_2D[4].get_vertices()[1];
-        auto rot = Matrix_lib_f::getRotationMatrix(
-            static_cast<float>(coeff * PI_ / 2),
-            rot_axis(0),
-            rot_axis(1),
-            rot_axis(2));
-        Scene_vertex_t disp(5);
-        disp <<= -anchor(0), -anchor(1), -anchor(2), 0, 0;
-
-        transform_3D_plot(plots_2D[5], rot, disp);
-
-        for(auto& c: curves_2D)
-            transform_3D_plot(c[5], rot, disp);
+        const auto rot = rotation(plots_2D[2].get_vertices()[1],
+                                  plots_2D[4].get_vertices()[1],
+                                  plots_2D[4].get_vertices()[2]);
+        transform_plot(5, rot);
     }
+
+    return maps;
 }
 
 //******************************************************************************
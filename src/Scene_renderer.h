@@ -3,10 +3,12 @@
 #include "Base_renderer.h"
 #include "Scene_state.h"
 #include "Mesh.h"
+#include "Mesh_batch.h"
 #include "Diffuse_shader.h"
 #include "Screen_shader.h"
 #include "Scene_wireframe_object.h"
 #include "Text_renderer.h"
+#include "Thread_pool.h"
 // std
 #include <memory.h>
 // boost
@@ -30,8 +32,12 @@ public:
     void set_line_thickness(float t_thickness, float c_thickness);
     void set_sphere_diameter(float diameter);
     void set_fog(float fog_dist, float fog_range); 
+    // The curves of the 4D view and of the plots of the unfolding are projected
+    // in the vertex shader, their tubes are only rebuilt when the curves
+    // change. The projection on the CPU is kept as the reference
+    void set_gpu_projection(bool enable);
 
-private:
+    // 4D perspective projection with the camera of the scene state
     void project_to_3D(
         Scene_vertex_t& point,
         const boost::numeric::ublas::matrix<float>& rot_mat);
@@ -39,6 +45,10 @@ private:
         std::vector<Scene_vertex_t>& verts,
         const boost::numeric::ublas::matrix<float>& rot_mat);
 
+private:
+
+    void build_meshes(const std::vector<float>& anims, const glm::mat4& mvp_mat);
+
     void draw_tesseract(Scene_wireframe_object& t);
     void draw_curve(Curve& c, float opacity, const Color& color);
     void draw_curve(
@@ -46,28 +56,90 @@ private:
         float opacity,
         const Color& slow_c,
         const Color& fast_c);
-    void draw_annotations(Curve& c, const glm::mat4& projection);
     void draw_legend(const Region& region);
 
-    void move_curves_to_3D_plots(float coeff, std::vector<Curve>& curves);
-    void move_curves_to_2D_plots(float coeff, std::vector<Curve>& curves);
-    void tesseract_unfolding(
+    // Unfolding to the Dali-cross. Every stage of the animation moves the
+    // points of a plot with an affine map. The maps are composed to a single
+    // 5x5 matrix per plot (homogeneous 4D row vectors, the translation in the
+    // last row), so a curve is moved and projected in one pass over its points
+    typedef boost::numeric::ublas::matrix<float> Affine_map;
+    Affine_map move_to_3D_plot(size_t plot, float coeff) const;
+    Affine_map move_to_2D_plot(size_t plot, float coeff) const;
+    Affine_map get_projection_map(
+        const boost::numeric::ublas::matrix<float>& rot_mat) const;
+    std::vector<Affine_map> tesseract_unfolding(
         float coeff,
-        std::vector<Cube>& plots_3D,
-        std::vector<std::vector<Curve>>& curves_3D);
+        std::vector<Cube>& plots_3D);
+    std::vector<glm::mat4> plots_unfolding(
+        float coeff,
+        std::vector<Square>& plots_2D);
+    void transform_curve(
+        const Curve& source,
+        const Affine_map& map,
+        const glm::mat4* post_map,
+        Curve& target);
+    Scene_vertex_t transform_point(
+        const Scene_vertex_t& point,
+        const Affine_map& map,
+        const glm::mat4& post_map) const;
+    void update_curve_copies();
+
+    // The time markers and the annotations of the curve 'curve' drawn with
+    // 'map' and the 3D 'post_map'. They are computed from the unprojected
+    // curve, so no copy of it is needed
+    void draw_time_marker(
+        size_t curve,
+        const Affine_map& map,
+        const glm::mat4& post_map);
+    void build_time_markers();
+    void draw_annotations(
+        size_t curve,
+        const Affine_map& map,
+        const glm::mat4& post_map,
+        const glm::mat4& projection);
+
+    // Tubes of the 4D curves projected on the GPU. They are drawn once with
+    // the map of the 4D view, or once per plot of the unfolding
+    struct Hyper_draw
+    {
+        Affine_map map;
+        glm::mat4 post_map;
+        float opacity;
+    };
+    void build_hyper_curves();
+    void emit_hyper_curve(
+        const Curve& c,
+        const Color& slow_c,
+        const Color& fast_c);
+    void set_hyper_uniforms(const Hyper_draw& draw);
+
     boost::numeric::ublas::matrix<float> get_rotation_matrix();
     boost::numeric::ublas::matrix<float>
     get_rotation_matrix(float view_straightening);
     void draw_3D_plot(Cube& cube, float opacity);
     void draw_2D_plot(Scene_wireframe_object& plot);
-    void plots_unfolding(
-        float coeff,
-        std::vector<Square>& plots_2D,
-        std::vector<std::vector<Curve>>& curves_2D);
     void draw_labels_in_2D(const glm::mat4& projection);
 
     std::vector<float> split_animation(float animation_pos, int sections);
 
+    // Screen-space tessellation
+    glm::vec2 to_screen(const glm::vec3& point) const;
+    unsigned int tessellation_level(
+        const glm::vec3& point,
+        float diameter) const;
+    void emit_tube(
+        Mesh_emitter& emitter,
+        float start_diameter,
+        float end_diameter,
+        const glm::vec3& start_point,
+        const glm::vec3& end_point,
+        const glm::vec4& color) const;
+    void emit_sphere(
+        Mesh_emitter& emitter,
+        float diameter,
+        const glm::vec3& position,
+        const glm::vec4& color) const;
+
     // Drawing parameters
     float tesseract_thickness_,
           curve_thickness_,
@@ -75,15 +147,28 @@ private:
 
     glm::vec2 fog_range_;
 
+    // Model-view-projection matrix of the current frame, the scale from the
+    // normalized device coordinates to pixels and the size in pixels of a unit
+    // length at the unit distance from the camera
+    glm::mat4 mvp_mat_;
+    glm::vec2 viewport_scale_;
+    float pixels_per_unit_;
+
     std::shared_ptr<Diffuse_shader> diffuse_shader_;
     std::shared_ptr<Screen_shader> screen_shader_;
 
     std::shared_ptr<Text_renderer> text_renderer_;
 
     std::unique_ptr<Diffuse_shader::Mesh_geometry> back_geometry_,
-                                                   front_geometry_;
+                                                   front_geometry_,
+                                                   marker_geometry_;
     std::unique_ptr<Screen_shader::Screen_geometry> screen_geometry_;
 
+    // The draw functions only record mesh generation tasks, the meshes are
+    // generated in parallel at the end of the frame
+    std::unique_ptr<Thread_pool> thread_pool_;
+    Mesh_batch back_batch_, front_batch_;
+
     int visibility_mask_;
     const int number_of_animations_;
 
@@ -91,6 +176,33 @@ private:
 
     bool filter_arrow_annotations_;
 
+    // Copies of the curves for the 4D view, the 3D plots and the 2D plots.
+    // They are made when the curves change, every frame only their points are
+    // overwritten. The meshes are built from them at the end of the frame
+    struct Curve_copies
+    {
+        std::weak_ptr<Curve> source;
+        Curve projected;
+        std::vector<Curve> plots_3D, plots_2D;
+    };
+    std::vector<Curve_copies> curve_copies_;
+
+    // Time markers of the frame, the curves index the curves of the state
+    struct Time_marker
+    {
+        size_t curve;
+        Affine_map map;
+        glm::mat4 post_map;
+    };
+    std::vector<Time_marker> time_markers_;
+
     std::vector<boost::numeric::ublas::vector<double>> label_points_;
     bool show_labels_;
+
+    // The tubes are built from the unprojected curves when they change, every
+    // frame only the maps of 'hyper_draws_' are updated
+    std::unique_ptr<Diffuse_shader::Hyper_geometry> hyper_geometry_;
+    std::vector<Hyper_draw> hyper_draws_;
+    bool gpu_projection_,
+         is_hyper_dirty_;
 };
@@ -32,6 +32,7 @@ Scene_state::Scene_state()
     , stat_kernel_size(0.01f)
     , stat_max_movement(0.01f)
     , stat_max_value(0.01f)
+    , dirty_(Dirty_all)
 {
     curve_colors_.emplace_back(Color(228,  26,  28));
     curve_colors_.emplace_back(Color( 55, 126, 184));
@@ -41,6 +42,8 @@ Scene_state::Scene_state()
     curve_colors_.emplace_back(Color(255, 255,  51));
     curve_colors_.emplace_back(Color(166,  86,  40));
     curve_colors_.emplace_back(Color(247, 129, 191));
+
+    snapshot_ = take_snapshot();
 }
 
 //******************************************************************************
@@ -68,7 +71,13 @@ const Color &Scene_state::get_curve_color(size_t curve_ind)
 
 void Scene_state::update_color(int color_id, const Color& color)
 {
-    colors_[color_id] = color;
+    Color& c = colors_[color_id];
+    if(c.r() != color.r() || c.g() != color.g() ||
+       c.b() != color.b() || c.a() != color.a())
+    {
+        c = color;
+        dirty_ |= Dirty_colors;
+    }
 }
 
 //******************************************************************************
@@ -82,3 +91,123 @@ std::shared_ptr<Curve> Scene_state::selected_curve()
     else
         return curves.front();
 }
+
+//******************************************************************************
+// mark_dirty
+//******************************************************************************
+
+void Scene_state::mark_dirty(std::uint32_t flags)
+{
+    dirty_ |= flags;
+}
+
+//******************************************************************************
+// update_dirty
+//
+// Marks the fields that differ from the snapshot of the last rendered frame
+//******************************************************************************
+
+std::uint32_t Scene_state::update_dirty()
+{
+    const Snapshot s = take_snapshot();
+    const Snapshot& p = snapshot_;
+
+    if(s.projection_3D != p.projection_3D ||
+       s.rotation_3D   != p.rotation_3D   ||
+       s.camera_3D     != p.camera_3D     ||
+       s.projection_4D != p.projection_4D ||
+       s.camera_4D     != p.camera_4D     ||
+       s.rotations     != p.rotations)
+    {
+        dirty_ |= Dirty_rotation;
+    }
+
+    if(s.curve_selection != p.curve_selection ||
+       s.selection_start != p.selection_start ||
+       s.selection_end   != p.selection_end)
+    {
+        dirty_ |= Dirty_selection;
+    }
+
+    if(s.unfolding_anim != p.unfolding_anim)
+        dirty_ |= Dirty_unfolding;
+
+    if(s.is_timeplayer_active != p.is_timeplayer_active ||
+       s.timeplayer_pos       != p.timeplayer_pos)
+    {
+        dirty_ |= Dirty_timeplayer;
+    }
+
+    if(s.curves         != p.curves    ||
+       s.tesseract      != p.tesseract ||
+       s.tesseract_size != p.tesseract_size ||
+       s.stats          != p.stats)
+    {
+        dirty_ |= Dirty_curves;
+    }
+
+    if(s.options != p.options)
+        dirty_ |= Dirty_options;
+
+    return dirty_;
+}
+
+//******************************************************************************
+// is_dirty
+//******************************************************************************
+
+bool Scene_state::is_dirty(std::uint32_t flags) const
+{
+    return (dirty_ & flags) != Dirty_none;
+}
+
+//******************************************************************************
+// clear_dirty
+//******************************************************************************
+
+void Scene_state::clear_dirty()
+{
+    snapshot_ = take_snapshot();
+    dirty_ = Dirty_none;
+}
+
+//******************************************************************************
+// take_snapshot
+//******************************************************************************
+
+Scene_state::Snapshot Scene_state::take_snapshot() const
+{
+    Snapshot s;
+
+    s.projection_3D = projection_3D;
+    s.rotation_3D = rotation_3D;
+    s.camera_3D = camera_3D;
+    s.projection_4D.assign(projection_4D.data().begin(),
+                           projection_4D.data().end());
+    s.camera_4D.assign(camera_4D.begin(), camera_4D.end());
+    s.rotations = {xy_rot, yz_rot, zx_rot, xw_rot, yw_rot, zw_rot, fov_y};
+
+    for(const auto& c : curves)
+        s.curves.push_back(c.get());
+
+    s.curve_selection = curve_selection.get();
+    s.selection_start = curve_selection ? curve_selection->t_start : 0.f;
+    s.selection_end = curve_selection ? curve_selection->t_end : 0.f;
+
+    s.tesseract = tesseract.get();
+    s.tesseract_size = tesseract_size;
+    s.stats = {stat_kernel_size, stat_max_movement, stat_max_value};
+
+    s.unfolding_anim = unfolding_anim;
+    s.is_timeplayer_active = is_timeplayer_active;
+    s.timeplayer_pos = timeplayer_pos;
+
+    s.options = {show_tesseract,
+                 show_curve,
+                 show_legend,
+                 use_simple_dali_cross,
+                 scale_tesseract,
+                 use_unique_curve_colors};
+
+    return s;
+}
@@ -11,7 +11,10 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 // std
+#include <array>
+#include <cstdint>
 #include <map>
+#include <vector>
 
 enum Scene_color : std::int32_t
 {
@@ -27,6 +30,22 @@ enum Scene_color : std::int32_t
 class Scene_state
 {
 public:
+    // Parts of the state that changed since the last rendered frame
+    enum Dirty_flag : std::uint32_t
+    {
+        Dirty_none       = 0,
+        Dirty_rotation   = 1 << 0, // Cameras, projections and rotations
+        Dirty_selection  = 1 << 1,
+        Dirty_colors     = 1 << 2,
+        Dirty_unfolding  = 1 << 3,
+        Dirty_timeplayer = 1 << 4,
+        Dirty_curves     = 1 << 5, // Curves, the tesseract and statistics
+        Dirty_options    = 1 << 6, // Show flags
+        Dirty_view       = 1 << 7, // Scene settings, region and input
+        Dirty_timeline   = 1 << 8, // Timeline settings, regions and input
+        Dirty_all        = 0xffffffff
+    };
+
     Scene_state();
     
     const Color& get_color(int color_id);
@@ -35,6 +54,13 @@ public:
 
     std::shared_ptr<Curve> selected_curve();
 
+    // Dirty tracking. The public fields are written directly, so they are
+    // compared with their values at the last 'clear_dirty' call
+    void mark_dirty(std::uint32_t flags);
+    std::uint32_t update_dirty();
+    bool is_dirty(std::uint32_t flags = Dirty_all) const;
+    void clear_dirty();
+
     glm::mat4 projection_3D;
     glm::quat rotation_3D;
     glm::vec3 camera_3D;
@@ -76,8 +102,46 @@ public:
     float min_freq = 200.0f;
     float max_freq = 700.0f;
     SonificationData active_sonification_data = SPEED;
+    // Mix of the voice of a curve
+    struct Curve_voice
+    {
+        bool is_sonified = true;
+        float gain = 1.0f;
+        float pan = 0.0f; // From -1 (left) to 1 (right)
+    };
+    // One voice per curve, indexed like 'curves'. Without 'sonify_all_curves'
+    // only the selected curve is sonified
+    bool sonify_all_curves = false;
+    std::vector<Curve_voice> curve_voices;
+    // Levels of the voices sent to the effects
+    float reverb_send = 0.2f;
+    float chorus_send = 0.0f;
 
 private:
+    struct Snapshot
+    {
+        glm::mat4 projection_3D;
+        glm::quat rotation_3D;
+        glm::vec3 camera_3D;
+        std::vector<float> projection_4D, camera_4D;
+        std::array<float, 7> rotations;
+        std::vector<const Curve*> curves;
+        const Curve_selection* curve_selection;
+        float selection_start, selection_end;
+        const Tesseract* tesseract;
+        std::array<float, 4> tesseract_size;
+        std::array<float, 3> stats;
+        float unfolding_anim;
+        bool is_timeplayer_active;
+        float timeplayer_pos;
+        std::array<bool, 6> options;
+    };
+
+    Snapshot take_snapshot() const;
+
     std::map<std::int32_t, Color> colors_;
     std::vector<Color> curve_colors_;
+
+    std::uint32_t dirty_;
+    Snapshot snapshot_;
 };
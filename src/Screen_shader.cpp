@@ -1,6 +1,7 @@
 #include "Screen_shader.h"
 // Local
 #include "Consts.h"
+#include "Profiler.h"
 // glm
 #include <glm/glm.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
@@ -12,7 +13,7 @@
 
 void Screen_shader::initialize()
 {
-#ifdef __EMSCRIPTEN__
+#if defined(__EMSCRIPTEN__) || defined(MANYLANDS_HEADLESS)
     program_id = load_shaders("assets/Diffuse_paint_ES.vert",
                               "assets/Diffuse_paint_ES.frag");
 #else
@@ -34,6 +35,8 @@ void Screen_shader::initialize()
 void Screen_shader::append_to_geometry(Screen_geometry& geom,
                                        const Line_strip& strip)
 {
+    PROFILE_ACCUMULATE("Append to geometry");
+
     auto ind_disp = geom.data_array.size();
 
     for(auto current = strip.begin(); current != strip.end(); ++current)
@@ -92,6 +95,8 @@ void Screen_shader::append_to_geometry(Screen_geometry& geom,
 void Screen_shader::append_to_geometry(Screen_geometry& geom,
                                        const Rectangle& rect)
 {
+    PROFILE_ACCUMULATE("Append to geometry");
+
     auto ind_disp = geom.data_array.size();
 
     // Create vertices
@@ -125,6 +130,8 @@ void Screen_shader::append_to_geometry(Screen_geometry& geom,
 void Screen_shader::append_to_geometry(Screen_geometry& geom,
                                        const Triangle& triangle)
 {
+    PROFILE_ACCUMULATE("Append to geometry");
+
     auto ind_disp = geom.data_array.size();
 
     // Create vertices
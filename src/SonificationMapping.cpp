@@ -0,0 +1,295 @@
+//
+// Mapping of the features of a curve to the parameters of the synth.
+//
+
+#include "SonificationMapping.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+const char* const FEATURE_NAMES[] = {
+        "x", "y", "z", "w", "speed", "acceleration", "curvature",
+        "dimensionality"};
+
+const char* const PARAMETER_NAMES[] = {
+        "pitch", "loudness", "brightness", "pan"};
+
+bool parseFeature(const std::string& name, CurveFeature& feature) {
+    const size_t noOfFeatures = sizeof(FEATURE_NAMES) / sizeof(*FEATURE_NAMES);
+    for (size_t i = 0; i < noOfFeatures; i++) {
+        if (name == FEATURE_NAMES[i]) {
+            feature = (CurveFeature) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseParameter(const std::string& name, int& parameter) {
+    for (int i = 0; i < ControlCurve::PARTIAL; i++) {
+        if (name == PARAMETER_NAMES[i]) {
+            parameter = i;
+            return true;
+        }
+    }
+    const std::string partial = "partial";
+    if (name.size() == partial.size() + 1
+        && name.compare(0, partial.size(), partial) == 0) {
+        const int j = name.back() - '0';
+        if (j >= 0 && j < ControlCurve::MAX_PARTIALS) {
+            parameter = ControlCurve::PARTIAL + j;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Value of the feature at each point of the curve
+std::vector<float> sampleFeature(Curve& curve, CurveFeature feature) {
+    const Curve_stats& stats = curve.get_stats();
+    const auto& vertices = curve.vertices();
+    const size_t noOfPoints = curve.time_stamp().size();
+    std::vector<float> values(noOfPoints, 0.0f);
+
+    switch (feature) {
+        case CurveFeature::X:
+        case CurveFeature::Y:
+        case CurveFeature::Z:
+        case CurveFeature::W: {
+            const int axis = (int) feature - (int) CurveFeature::X;
+            for (size_t i = 0; i < noOfPoints && i < vertices.size(); i++) {
+                values[i] = vertices[i](axis);
+            }
+            break;
+        }
+        case CurveFeature::SPEED:
+        case CurveFeature::ACCELERATION: {
+            // One value per edge, the last point holds the one of its edge
+            const std::vector<float>& source = feature == CurveFeature::SPEED
+                    ? stats.speed : stats.acceleration;
+            for (size_t i = 0; i < noOfPoints && !source.empty(); i++) {
+                values[i] = source[std::min(i, source.size() - 1)];
+            }
+            break;
+        }
+        case CurveFeature::CURVATURE: {
+            // Angle between the segments around a point over their mean
+            // length, the end points take the one of their neighbour
+            auto segment = [&vertices](size_t i, float (&d)[4]) {
+                float length = 0.0f;
+                for (int k = 0; k < 4; k++) {
+                    d[k] = vertices[i + 1](k) - vertices[i](k);
+                    length += d[k] * d[k];
+                }
+                return std::sqrt(length);
+            };
+            const size_t n = std::min(noOfPoints, vertices.size());
+            for (size_t i = 1; i + 1 < n; i++) {
+                float a[4], b[4];
+                const float lengthA = segment(i - 1, a);
+                const float lengthB = segment(i, b);
+                if (lengthA <= 0.0f || lengthB <= 0.0f) {
+                    continue;
+                }
+                float cosine = 0.0f;
+                for (int k = 0; k < 4; k++) {
+                    cosine += a[k] * b[k];
+                }
+                cosine = std::max(-1.0f, std::min(cosine / (lengthA * lengthB),
+                                                  1.0f));
+                values[i] = std::acos(cosine) / (0.5f * (lengthA + lengthB));
+            }
+            if (n > 2) {
+                values[0] = values[1];
+                values[n - 1] = values[n - 2];
+            }
+            break;
+        }
+        case CurveFeature::DIMENSIONALITY: {
+            const size_t n = std::min(noOfPoints, stats.dimensionality.size());
+            for (size_t i = 0; i < n; i++) {
+                const unsigned int axes =
+                        ResonatorBank::axesOf(stats.dimensionality[i]);
+                for (unsigned int bits = axes; bits; bits &= bits - 1) {
+                    values[i] += 1.0f;
+                }
+            }
+            break;
+        }
+    }
+    return values;
+}
+
+// Range of the feature on the curve, speed and acceleration have the one of
+// the stats like setFrequencyFromCurve()
+void rangeOf(Curve& curve, CurveFeature feature,
+             const std::vector<float>& values, float& min, float& max) {
+    const Curve_stats& stats = curve.get_stats();
+    if (feature == CurveFeature::SPEED) {
+        min = stats.min_speed;
+        max = stats.max_speed;
+    } else if (feature == CurveFeature::ACCELERATION) {
+        min = stats.min_acceleration;
+        max = stats.max_acceleration;
+    } else {
+        const auto range = std::minmax_element(values.begin(), values.end());
+        min = *range.first;
+        max = *range.second;
+    }
+}
+
+} // namespace
+
+MappingSpec defaultMappingSpec(Scene_state::SonificationData source) {
+    MappingSpec spec;
+    if (source == Scene_state::SonificationData::SPEED
+        || source == Scene_state::SonificationData::ACC) {
+        MappingRule rule;
+        rule.feature = source == Scene_state::SonificationData::SPEED
+                ? CurveFeature::SPEED : CurveFeature::ACCELERATION;
+        rule.parameter = ControlCurve::PITCH;
+        spec.rules.push_back(rule);
+    }
+    return spec;
+}
+
+bool parseMappingSpec(std::istream& stream, MappingSpec& spec,
+                      std::string& error) {
+    spec.rules.clear();
+    std::string line;
+    for (int lineNumber = 1; std::getline(stream, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream tokens(line);
+        std::string featureName, parameterName;
+        if (!(tokens >> featureName)) {
+            continue;
+        }
+
+        auto fail = [&](const std::string& message) {
+            error = "Line " + std::to_string(lineNumber) + ": " + message;
+            return false;
+        };
+        MappingRule rule;
+        if (!parseFeature(featureName, rule.feature)) {
+            return fail("unknown feature '" + featureName + "'");
+        }
+        if (!(tokens >> parameterName)
+            || !parseParameter(parameterName, rule.parameter)) {
+            return fail("unknown parameter '" + parameterName + "'");
+        }
+
+        std::string option;
+        while (tokens >> option) {
+            if (option == "in") {
+                rule.hasInputRange = true;
+                if (!(tokens >> rule.inMin >> rule.inMax)) {
+                    return fail("'in' needs a minimum and a maximum");
+                }
+            } else if (option == "out") {
+                if (!(tokens >> rule.outMin >> rule.outMax)) {
+                    return fail("'out' needs a minimum and a maximum");
+                }
+            } else if (option == "log") {
+                rule.scale = MappingRule::LOG;
+            } else if (option == "shape") {
+                if (!(tokens >> rule.shape) || rule.shape <= 0.0f) {
+                    return fail("'shape' needs a positive power");
+                }
+            } else {
+                return fail("unknown option '" + option + "'");
+            }
+        }
+        spec.rules.push_back(rule);
+    }
+    return true;
+}
+
+bool loadMappingSpec(const std::string& fileName, MappingSpec& spec,
+                     std::string& error) {
+    std::ifstream stream(fileName);
+    if (!stream.is_open()) {
+        error = "Cannot open " + fileName;
+        return false;
+    }
+    return parseMappingSpec(stream, spec, error);
+}
+
+std::shared_ptr<const ControlCurve> compileMapping(Curve& curve,
+                                                   const MappingSpec& spec) {
+    const std::vector<float>& times = curve.time_stamp();
+    if (times.empty() || curve.t_duration() <= 0.0f) {
+        return nullptr;
+    }
+
+    // A single point is held over the whole curve
+    std::vector<float> positions;
+    for (float time : times) {
+        positions.push_back((time - curve.t_min()) / curve.t_duration());
+    }
+    const bool isSinglePoint = positions.size() == 1;
+    if (isSinglePoint) {
+        positions.push_back(1.0f);
+    }
+
+    // One track per rule with the normalized and shaped feature, the output
+    // range becomes the scale of the operation and part of the base
+    float base[ControlCurve::NO_OF_PARAMETERS];
+    for (int p = 0; p < ControlCurve::NO_OF_PARAMETERS; p++) {
+        base[p] = ControlCurve::defaultValue(p);
+    }
+    for (const MappingRule& rule : spec.rules) {
+        base[rule.parameter] = 0.0f;
+    }
+
+    std::vector<float> tracks;
+    std::vector<ControlCurve::Operation> operations;
+    for (const MappingRule& rule : spec.rules) {
+        std::vector<float> values = sampleFeature(curve, rule.feature);
+        if (isSinglePoint) {
+            values.push_back(values.front());
+        }
+
+        float min = rule.inMin, max = rule.inMax;
+        if (!rule.hasInputRange) {
+            rangeOf(curve, rule.feature, values, min, max);
+        }
+        if (rule.scale == MappingRule::LOG) {
+            min = std::max(min, 0.001f * max);
+        }
+        for (float& value : values) {
+            float x = std::max(min, std::min(value, max));
+            if (rule.scale == MappingRule::LOG) {
+                x = max > min && min > 0.0f
+                        ? std::log(x / min) / std::log(max / min) : 0.0f;
+            } else {
+                x = max > min ? (x - min) / (max - min) : 0.0f;
+            }
+            value = std::pow(x, rule.shape);
+        }
+
+        operations.push_back({(unsigned int) operations.size(),
+                              (unsigned int) rule.parameter,
+                              rule.outMax - rule.outMin});
+        base[rule.parameter] += rule.outMin;
+        tracks.insert(tracks.end(), values.begin(), values.end());
+    }
+
+    // The playback strikes the resonators at the dimensionality switches
+    const Curve_stats& stats = curve.get_stats();
+    std::vector<ControlCurve::Switch> switches;
+    for (size_t i : stats.switches_inds) {
+        if (i < times.size() && i < stats.dimensionality.size()) {
+            switches.push_back({positions[i],
+                                ResonatorBank::axesOf(stats.dimensionality[i])});
+        }
+    }
+
+    return std::make_shared<const ControlCurve>(std::move(positions),
+                                                std::move(tracks),
+                                                std::move(operations), base,
+                                                std::move(switches));
+}
@@ -0,0 +1,80 @@
+//
+// Mapping of the features of a curve to the parameters of the synth.
+//
+
+#ifndef MANYLANDS_SONIFICATIONMAPPING_H
+#define MANYLANDS_SONIFICATIONMAPPING_H
+
+#include "Audio.h"
+#include "Curve.h"
+#include "Scene_state.h"
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Value of the curve at each of its points
+enum class CurveFeature {
+    X, Y, Z, W,
+    SPEED,
+    ACCELERATION,
+    // Turning angle per length of the path
+    CURVATURE,
+    // Number of axes in the dimensionality, 0 to 4
+    DIMENSIONALITY
+};
+
+// Maps one feature to one ControlCurve::Parameter. The feature is normalized
+// to [0, 1] over the input range, shaped and scaled to the output range.
+// Rules on the same parameter add up
+struct MappingRule {
+    enum Scale { LINEAR, LOG };
+
+    CurveFeature feature = CurveFeature::SPEED;
+    int parameter = ControlCurve::PITCH;
+    // Without a range the range of the feature on the curve is used, values
+    // outside of it are clamped
+    bool hasInputRange = false;
+    float inMin = 0.0f;
+    float inMax = 1.0f;
+    // LOG normalizes the logarithm of the feature. The lower end is at least
+    // a thousandth of the upper end
+    Scale scale = LINEAR;
+    // The normalized feature is raised to this power
+    float shape = 1.0f;
+    float outMin = 0.0f;
+    float outMax = 1.0f;
+};
+
+struct MappingSpec {
+    std::vector<MappingRule> rules;
+};
+
+// The selected data to the pitch over the whole frequency range, like
+// setFrequencyFromCurve()
+MappingSpec defaultMappingSpec(Scene_state::SonificationData source);
+
+// Reads one rule per line, '#' starts a comment:
+//
+//   <feature> <parameter> [in <min> <max>] [log] [shape <power>]
+//             [out <min> <max>]
+//
+// The features are x, y, z, w, speed, acceleration, curvature and
+// dimensionality, the parameters pitch, loudness, brightness, pan and
+// partial0 to partial7. Returns false with the line in 'error' if a rule
+// cannot be read
+bool parseMappingSpec(std::istream& stream, MappingSpec& spec,
+                      std::string& error);
+bool loadMappingSpec(const std::string& fileName, MappingSpec& spec,
+                     std::string& error);
+
+// Samples the features at the points of the curve and compiles the rules
+// into the tracks and operations of a control curve, with the dimensionality
+// switches of the curve. Returns null if the curve has no points or no
+// duration
+std::shared_ptr<const ControlCurve> compileMapping(Curve& curve,
+                                                   const MappingSpec& spec);
+
+
+#endif //MANYLANDS_SONIFICATIONMAPPING_H
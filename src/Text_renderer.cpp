@@ -1,14 +1,27 @@
 #include "Text_renderer.h"
+// Local
+#include "Profiler.h"
 // ImGui
 #include "imgui.h"
+// std
+#include <algorithm>
+
+namespace
+{
+// Size of a cell of the collision grid in pixels
+const float Grid_cell_size = 32.f;
+} // namespace
 
 //******************************************************************************
 // render
 //******************************************************************************
 void Text_renderer::render(int width, int height)
 {
-    for(auto& t : text_array_)
-    {
+    if(text_array_.empty())
+        return;
+
+    PROFILE_SCOPE("Text");
+
     ImGui::SetNextWindowPos(ImVec2(0, 0));
     ImGui::SetNextWindowSize(ImVec2(
         static_cast<float>(width),
@@ -22,16 +35,34 @@ void Text_renderer::render(int width, int height)
           ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoInputs |
           ImGuiWindowFlags_NoFocusOnAppearing |
           ImGuiWindowFlags_NoBringToFrontOnFocus |
-          ImGuiWindowFlags_NoBackground);   
-   
-        ImGui::GetWindowDrawList()->AddText(
-           NULL,
-           0.0f,
-           ImVec2(t.pos.x, height - t.pos.y),
-           ImColor(0.0f, 0.0f, 0.0f, 1.0f),
-           t.text.c_str());
-        ImGui::End();    
+          ImGuiWindowFlags_NoBackground);
+
+    auto draw_list = ImGui::GetWindowDrawList();
+    const ImU32 color = ImColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    reset_grid(width, height);
+
+    for(auto& t : text_array_)
+    {
+        const char* text_begin = t.text.c_str();
+        const char* text_end = text_begin + t.text.size();
+        const ImVec2 size = ImGui::CalcTextSize(text_begin, text_end);
+
+        Text_box box;
+        box.min = glm::vec2(t.pos.x, height - t.pos.y);
+        box.max = box.min + glm::vec2(size.x, size.y);
+
+        if(!occupy(box))
+            continue;
+
+        draw_list->AddText(
+            ImVec2(box.min.x, box.min.y),
+            color,
+            text_begin,
+            text_end);
     }
+
+    ImGui::End();
 }
 
 //******************************************************************************
@@ -55,3 +86,59 @@ void Text_renderer::clear()
 {
     text_array_.clear();
 }
+
+//******************************************************************************
+// reset_grid
+//******************************************************************************
+
+void Text_renderer::reset_grid(int width, int height)
+{
+    grid_cols_ = std::max(1, static_cast<int>(width / Grid_cell_size) + 1);
+    grid_rows_ = std::max(1, static_cast<int>(height / Grid_cell_size) + 1);
+
+    // Cells keep their capacity between frames
+    grid_.resize(static_cast<size_t>(grid_cols_) * grid_rows_);
+    for(auto& cell : grid_)
+        cell.clear();
+}
+
+//******************************************************************************
+// occupy
+//******************************************************************************
+
+bool Text_renderer::occupy(const Text_box& box)
+{
+    auto cell_index = [](float coord, int num_cells) {
+        return std::min(
+            std::max(static_cast<int>(coord / Grid_cell_size), 0),
+            num_cells - 1);
+    };
+
+    const int col_min = cell_index(box.min.x, grid_cols_),
+              col_max = cell_index(box.max.x, grid_cols_),
+              row_min = cell_index(box.min.y, grid_rows_),
+              row_max = cell_index(box.max.y, grid_rows_);
+
+    for(int r = row_min; r <= row_max; ++r)
+    {
+        for(int c = col_min; c <= col_max; ++c)
+        {
+            for(const auto& other : grid_[r * grid_cols_ + c])
+            {
+                if(box.min.x < other.max.x && other.min.x < box.max.x &&
+                   box.min.y < other.max.y && other.min.y < box.max.y)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    for(int r = row_min; r <= row_max; ++r)
+    {
+        for(int c = col_min; c <= col_max; ++c)
+            grid_[r * grid_cols_ + c].push_back(box);
+    }
+
+    return true;
+}
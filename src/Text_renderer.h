@@ -11,7 +11,8 @@
 //******************************************************************************
 // Text_renderer
 //
-// This is a very simple text renderer that uses ImGui backend
+// This is a very simple text renderer that uses ImGui backend. All texts are
+// drawn into one draw list, a text overlapping an earlier added one is skipped
 //******************************************************************************
 
 class Text_renderer
@@ -28,6 +29,12 @@ private:
         glm::vec2 pos;
         std::string text;
     };
+
+    // Screen-space bounding box of a drawn text
+    struct Text_box
+    {
+        glm::vec2 min, max;
+    };
     
 public:
     void render(int width, int height);
@@ -38,5 +45,14 @@ public:
     void clear();
 
 private:
+    void reset_grid(int width, int height);
+    // Returns false if the box overlaps a box occupied earlier
+    bool occupy(const Text_box& box);
+
     std::vector<Text_data> text_array_;
+
+    // Uniform grid used to find overlapping texts. Each cell lists the boxes
+    // intersecting it
+    std::vector<std::vector<Text_box>> grid_;
+    int grid_cols_, grid_rows_;
 };
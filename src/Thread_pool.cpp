@@ -0,0 +1,130 @@
+#include "Thread_pool.h"
+// std
+#include <algorithm>
+
+//******************************************************************************
+// Thread_pool
+//******************************************************************************
+
+Thread_pool::Thread_pool()
+    : Thread_pool(std::max(std::thread::hardware_concurrency(), 1u) - 1)
+{
+}
+
+//******************************************************************************
+// Thread_pool
+//******************************************************************************
+
+Thread_pool::Thread_pool(unsigned int num_workers)
+    : func_(nullptr)
+    , count_(0)
+    , next_item_(0)
+    , busy_workers_(0)
+    , generation_(0)
+    , stop_(false)
+{
+    workers_.reserve(num_workers);
+    for(unsigned int i = 0; i < num_workers; ++i)
+        workers_.emplace_back(&Thread_pool::worker_loop, this);
+}
+
+//******************************************************************************
+// ~Thread_pool
+//******************************************************************************
+
+Thread_pool::~Thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    job_cv_.notify_all();
+
+    for(auto& w : workers_)
+        w.join();
+}
+
+//******************************************************************************
+// num_threads
+//******************************************************************************
+
+unsigned int Thread_pool::num_threads() const
+{
+    return static_cast<unsigned int>(workers_.size()) + 1;
+}
+
+//******************************************************************************
+// parallel_for
+//******************************************************************************
+
+void Thread_pool::parallel_for(
+    size_t count,
+    const std::function<void(size_t)>& func)
+{
+    if(count == 0)
+        return;
+
+    if(workers_.empty() || count == 1)
+    {
+        for(size_t i = 0; i < count; ++i)
+            func(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        func_ = &func;
+        count_ = count;
+        next_item_ = 0;
+        busy_workers_ = workers_.size();
+        ++generation_;
+    }
+    job_cv_.notify_all();
+
+    run_items();
+
+    // The job must not be released while a worker may still access it
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return busy_workers_ == 0; });
+    func_ = nullptr;
+}
+
+//******************************************************************************
+// worker_loop
+//******************************************************************************
+
+void Thread_pool::worker_loop()
+{
+    unsigned long long seen_generation = 0;
+
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            job_cv_.wait(lock, [&] {
+                return stop_ || generation_ != seen_generation;
+            });
+            if(stop_)
+                return;
+            seen_generation = generation_;
+        }
+
+        run_items();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --busy_workers_;
+        }
+        done_cv_.notify_one();
+    }
+}
+
+//******************************************************************************
+// run_items
+//******************************************************************************
+
+void Thread_pool::run_items()
+{
+    for(size_t i = next_item_++; i < count_; i = next_item_++)
+        (*func_)(i);
+}
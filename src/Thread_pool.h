@@ -0,0 +1,53 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//******************************************************************************
+// Thread_pool
+//
+// A fixed set of worker threads executing data-parallel loops. The calling
+// thread takes part in the work, therefore a pool with zero workers runs the
+// loops serially.
+//******************************************************************************
+
+class Thread_pool
+{
+public:
+    // Creates one thread less than the number of cores, the remaining core is
+    // used by the calling thread
+    Thread_pool();
+    explicit Thread_pool(unsigned int num_workers);
+    ~Thread_pool();
+
+    Thread_pool(const Thread_pool&) = delete;
+    Thread_pool& operator=(const Thread_pool&) = delete;
+
+    unsigned int num_threads() const;
+
+    // Calls 'func(i)' for every i in [0, count) and returns when all calls
+    // have finished. The order of the calls is not specified
+    void parallel_for(size_t count, const std::function<void(size_t)>& func);
+
+private:
+    void worker_loop();
+    void run_items();
+
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable job_cv_, done_cv_;
+
+    // Current job
+    const std::function<void(size_t)>* func_;
+    size_t count_;
+    std::atomic<size_t> next_item_;
+    size_t busy_workers_;
+    unsigned long long generation_;
+    bool stop_;
+};
@@ -3,12 +3,14 @@
 // Local
 #include "Consts.h"
 #include "Global.h"
+#include "Profiler.h"
 #include "Scene_wireframe_object.h"
 // glm
 #include <glm/gtc/type_ptr.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/closest_point.hpp>
 // std
+#include <functional>
 #include <vector>
 #include <tuple>
 #include <complex>
@@ -18,20 +20,32 @@
 // CDT
 #include "CDT.h"
 
+namespace
+{
+    // Lanes are not made lower than this, the rest is scrolled
+    const float Min_lane_height = 40.f;
+}
+
 //******************************************************************************
 // Timeline_renderer
 //******************************************************************************
 
 Timeline_renderer::Timeline_renderer(std::shared_ptr<Scene_state> state)
-    : pictogram_size_(0.f)
+    : Base_renderer(Scene_state::Dirty_timeline)
+    , pictogram_size_(0.f)
     , pictogram_spacing_(1.5f)
     , splitter_(0.5f)
     , pictogram_scale_(1.f)
     , pictogram_magnification_region_(4)
+    , pictogram_tesseract_size_()
     , mouse_pos_(0.f, 0.f)
     , is_mouse_inside_(false)
     , track_mouse_(false)
     , show_axes_(4, true)
+    , view_t_start_(0.f)
+    , view_t_end_(0.f)
+    , track_pan_(false)
+    , first_lane_(0)
 {
     set_state(state);
 }
@@ -62,9 +76,33 @@ void Timeline_renderer::set_text_renderer(
 void Timeline_renderer::render()
 {
     if(!state_->selected_curve())
+    {
+        text_renderer_->clear();
         return;
+    }
 
-    screen_geom_ = std::make_unique<Screen_shader::Screen_geometry>();
+    PROFILE_SCOPE("Timeline");
+
+    update_view();
+
+    // The geometry is only rebuilt if a part of the state it depends on has
+    // changed, otherwise the buffers of the previous frame are drawn again.
+    // The marker has its own geometry, so the playback only rebuilds it
+    const std::uint32_t plot_flags = Scene_state::Dirty_selection |
+                                     Scene_state::Dirty_colors    |
+                                     Scene_state::Dirty_curves    |
+                                     Scene_state::Dirty_options   |
+                                     Scene_state::Dirty_timeline;
+    const bool rebuild =
+        state_->is_dirty(plot_flags) || screen_geom_ == nullptr;
+    const bool rebuild_marker =
+        rebuild || state_->is_dirty(Scene_state::Dirty_timeplayer);
+
+    if(screen_geom_ == nullptr)
+    {
+        screen_geom_ = std::make_unique<Screen_shader::Screen_geometry>();
+        marker_geom_ = std::make_unique<Screen_shader::Screen_geometry>();
+    }
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -86,26 +124,46 @@ void Timeline_renderer::render()
                        GL_FALSE,
                        glm::value_ptr(proj_ortho));
 
-    std::vector<Compas_state> pos_and_scale =
-        get_compases_state(pictogram_region_);
+    if(rebuild)
+    {
+        screen_geom_->data_array.clear();
+        screen_geom_->indices.clear();
+        text_renderer_->clear();
 
-    // On-screen rendering
-    
-    if(!pictogram_mouse_down)
-        highlight_hovered_region(plot_region_, pos_and_scale);
-    draw_selection(plot_region_, mouse_selection_);
-
-    draw_axes(plot_region_);
-    draw_curve(plot_region_);
-    draw_switches(plot_region_);
-    if(state_->is_timeplayer_active)
-        draw_marker(plot_region_);
-    draw_pictograms(pictogram_region_, pos_and_scale);
-
-    if(screen_geom_->data_array.size() > 0)
+        std::vector<Compas_state> pos_and_scale =
+            get_compases_state(pictogram_region_);
+
+        // On-screen rendering
+
+        if(!pictogram_mouse_down)
+            highlight_hovered_region(plot_region_, pos_and_scale);
+        draw_selection(plot_region_, mouse_selection_);
+
+        draw_axes(plot_region_);
+        draw_curve(plot_region_);
+        draw_switches(plot_region_);
+        draw_pictograms(pictogram_region_, pos_and_scale);
+
+        screen_geom_->update_buffers();
+    }
+
+    if(rebuild_marker)
     {
-        screen_geom_->init_buffers();
-        screen_shader_->draw_geometry(*screen_geom_.get());
+        marker_geom_->data_array.clear();
+        marker_geom_->indices.clear();
+
+        if(state_->is_timeplayer_active)
+            draw_marker(plot_region_);
+
+        marker_geom_->update_buffers();
+    }
+
+    {
+        PROFILE_SCOPE("Draw");
+        if(screen_geom_->data_array.size() > 0)
+            screen_shader_->draw_geometry(*screen_geom_.get());
+        if(marker_geom_->data_array.size() > 0)
+            screen_shader_->draw_geometry(*marker_geom_.get());
     }
 }
 
@@ -115,6 +173,13 @@ void Timeline_renderer::render()
 
 void Timeline_renderer::process_input(const Renderer_io& io)
 {
+    // The plot reacts to hovering, so any input over it needs a new frame
+    if(is_mouse_inside_ || region_.contains(io.mouse_pos) ||
+       track_mouse_ || track_pan_ || pictogram_mouse_down)
+    {
+        state_->mark_dirty(view_flag_);
+    }
+
     is_mouse_inside_ = region_.contains(io.mouse_pos);
     mouse_pos_ = io.mouse_pos - glm::vec2(region_.left(), region_.bottom());
 
@@ -139,6 +204,28 @@ void Timeline_renderer::process_input(const Renderer_io& io)
         mouse_selection_.end_pnt = mouse_pos_;
     }
 
+    // The plot is zoomed with the mouse wheel and panned with the right button.
+    // The lanes are scrolled with the mouse wheel while shift is pressed
+    if(state_->selected_curve())
+    {
+        if(io.mouse_wheel && plot_region_.contains(mouse_pos_))
+        {
+            if(io.key_shift)
+                scroll_lanes(io.mouse_wheel_y > 0.f ? -1 : 1);
+            else
+                zoom_view(std::pow(0.9f, io.mouse_wheel_y), mouse_pos_.x);
+        }
+
+        if(io.right_mouse_down && plot_region_.contains(mouse_pos_))
+            track_pan_ = true;
+
+        if(track_pan_ && io.mouse_move.x != 0.f)
+            pan_view(io.mouse_move.x);
+    }
+
+    if(io.mouse_up)
+        track_pan_ = false;
+
     if(io.mouse_down && pictogram_region_.contains(mouse_pos_))
     {
         pictogram_mouse_down = true;
@@ -214,6 +301,9 @@ void Timeline_renderer::process_input(const Renderer_io& io)
 
 void Timeline_renderer::show_axes(std::vector<bool> show)
 {
+    if(show_axes_ != show)
+        state_->mark_dirty(view_flag_);
+
     show_axes_ = show;
 }
 
@@ -237,6 +327,9 @@ void Timeline_renderer::set_redering_region(Region region,
 
 void Timeline_renderer::set_splitter(float splitter)
 {
+    if(splitter_ != splitter)
+        state_->mark_dirty(view_flag_);
+
     splitter_ = splitter;
 }
 
@@ -246,6 +339,9 @@ void Timeline_renderer::set_splitter(float splitter)
 
 void Timeline_renderer::set_pictogram_size(float size)
 {
+    if(pictogram_size_ != size)
+        state_->mark_dirty(view_flag_);
+
     pictogram_size_ = size;
     update_regions();
 }
@@ -256,10 +352,36 @@ void Timeline_renderer::set_pictogram_size(float size)
 
 void Timeline_renderer::set_pictogram_magnification(float scale, int region_size)
 {
+    if(pictogram_scale_ != scale ||
+       pictogram_magnification_region_ != static_cast<size_t>(region_size))
+    {
+        state_->mark_dirty(view_flag_);
+    }
+
     pictogram_scale_ = scale;
     pictogram_magnification_region_ = region_size;
 }
 
+//******************************************************************************
+// build_pictograms
+//******************************************************************************
+
+size_t Timeline_renderer::build_pictograms()
+{
+    if(!state_->selected_curve())
+        return 0;
+
+    if(screen_geom_ == nullptr)
+        screen_geom_ = std::make_unique<Screen_shader::Screen_geometry>();
+
+    screen_geom_->data_array.clear();
+    screen_geom_->indices.clear();
+
+    draw_pictograms(pictogram_region_, get_compases_state(pictogram_region_));
+
+    return screen_geom_->data_array.size();
+}
+
 //******************************************************************************
 // draw_axes
 //******************************************************************************
@@ -288,9 +410,7 @@ void Timeline_renderer::draw_axes(const Region& region)
     draw_line(glm::vec2(region.left(),  region.bottom()),
               glm::vec2(region.left(),  region.top()));
 
-    const float t_min = state_->selected_curve()->t_min();
-    const float t_max = state_->selected_curve()->t_max();
-    const float t_durr = t_max - t_min;
+    const float t_durr = view_t_end_ - view_t_start_;
 
     float dist = region.width() / num_section;
     float sub_dist = dist / num_subsection;
@@ -318,7 +438,7 @@ void Timeline_renderer::draw_axes(const Region& region)
         std::snprintf(
             buff,
             sizeof buff, "%.0f",
-            t_min + i * t_durr / num_section);
+            view_t_start_ + i * t_durr / num_section);
         std::string output_text(buff);
 
         const auto symbol_width(6.f);
@@ -333,58 +453,82 @@ void Timeline_renderer::draw_axes(const Region& region)
 
 //******************************************************************************
 // draw_curve
+//
+// Every curve is drawn in its own lane. Only the visible lanes are built
 //******************************************************************************
 
 void Timeline_renderer::draw_curve(const Region& region)
 {
-    const float t_min = state_->selected_curve()->t_min();
-    const float t_max = state_->selected_curve()->t_max();
-    const float t_duration = t_max - t_min;
+    const auto& curves = state_->curves;
+    const size_t lanes = lanes_per_view(region);
+    const float lane_height = region.height() / lanes;
+
+    first_lane_ = std::min(first_lane_, curves.size() - lanes);
+
+    const glm::vec4 separator_color(0.8f, 0.8f, 0.8f, 1.f);
+
+    for(size_t i = 0; i < lanes; ++i)
+    {
+        const float top = region.top() - i * lane_height;
+        const Region lane(
+            region.left(), top - lane_height, region.right(), top);
+
+        draw_lane(lane, curves[first_lane_ + i]);
+
+        if(i > 0)
+        {
+            Screen_shader::Line_strip separator;
+            separator.emplace_back(Screen_shader::Line_point(
+                glm::vec2(region.left(), top), 1.f, separator_color));
+            separator.emplace_back(Screen_shader::Line_point(
+                glm::vec2(region.right(), top), 1.f, separator_color));
+            screen_shader_->append_to_geometry(*screen_geom_, separator);
+        }
+    }
+}
+
+//******************************************************************************
+// draw_lane
+//******************************************************************************
 
-    auto get_strip = [this](
+void Timeline_renderer::draw_lane(
+    const Region& region,
+    const std::shared_ptr<Curve>& c)
+{
+    auto& cached = get_pyramid(c);
+
+    // One column of the decimation per pixel
+    const size_t columns = static_cast<size_t>(
+        std::max(1.f, std::ceil(display_scale_x_ * region.width())));
+
+    auto get_strip = [this, &cached, columns](
         const Region& region,
         size_t dim_ind,
-        float t_duration,
         float scale,
         const glm::vec4& norm_color,
         const glm::vec4& dim_color)
     {
         const float width = 2.5f;
 
-        Screen_shader::Line_strip strip;
+        const auto& points = get_decimated(cached, dim_ind, columns);
 
-        glm::vec2 prev_pnt;
-        const float t_min  = state_->selected_curve()->t_min();
-
-        const float min_delta_t = width * t_duration / region.width();
-        float prev_t = -min_delta_t;
+        Screen_shader::Line_strip strip;
+        strip.reserve(points.size());
 
-        for(size_t i = 0; i < state_->selected_curve()->get_vertices().size(); i++)
+        for(const auto& p : points)
         {
-            const float t_curr = state_->selected_curve()->time_stamp()[i];
-            if(t_curr < prev_t + min_delta_t)
-                continue;
-
-            const float val = static_cast<float>(
-                state_->selected_curve()->get_vertices()[i](dim_ind));
-            const float x_point =
-                region.left() + region.width() * (t_curr - t_min) / t_duration;
+            const float x_point = time_to_x(p.t, region);
             const float y_point =
-                region.bottom() + region.height() * (0.5f + val / scale);
+                region.bottom() + region.height() * (0.5f + p.value / scale);
             glm::vec2 curr_pnt(x_point, y_point);
             
             glm::vec4 color;
             if(state_->curve_selection != nullptr)
             {
-                if(state_->curve_selection->t_start <= t_curr &&
-                    t_curr <= state_->curve_selection->t_end)
-                {
+                if(state_->curve_selection->in_range(p.t))
                     color = norm_color;
-                }
                 else
-                {
                     color = dim_color;
-                }
             }
             else
             {
@@ -393,8 +537,6 @@ void Timeline_renderer::draw_curve(const Region& region)
 
             strip.emplace_back(
                 Screen_shader::Line_point(curr_pnt, width, color));
-
-            prev_pnt = curr_pnt;
         }
 
         return strip;
@@ -426,7 +568,6 @@ void Timeline_renderer::draw_curve(const Region& region)
         {
             auto strip = get_strip(region,
                                    i,
-                                   t_duration,
                                    max_tesseract_size,
                                    colors[i],
                                    defocused);
@@ -451,6 +592,10 @@ void Timeline_renderer::draw_switches(const Region& region)
     calculate_switch_points(points, region);
     for(auto p : points)
     {
+        // Switches outside of the view are skipped
+        if(p <= region.left() || p >= region.right())
+            continue;
+
         // HACK: we need to shift the x postion for 0.5 to enable the pixel 
         // perfect rendering 
         float p_rounded = std::round(p) + 0.5f;
@@ -476,7 +621,12 @@ void Timeline_renderer::draw_marker(const Region& region)
     const float width(3.f);
     const glm::vec4 color(1.f, 0.f, 0.f, 0.5f);
     
-    float x_pos = region.left() + state_->timeplayer_pos * region.width();
+    const auto curve = state_->selected_curve();
+    float x_pos = time_to_x(
+        curve->t_min() + state_->timeplayer_pos * curve->t_duration(),
+        region);
+    if(x_pos < region.left() || x_pos > region.right())
+        return;
     x_pos = std::round(x_pos) + 0.5f;
 
     Screen_shader::Line_strip line;
@@ -484,7 +634,7 @@ void Timeline_renderer::draw_marker(const Region& region)
         glm::vec2(x_pos, region.top()), width, color));
     line.emplace_back(Screen_shader::Line_point(
         glm::vec2(x_pos, region.bottom()), width, color));
-    screen_shader_->append_to_geometry(*screen_geom_, line);
+    screen_shader_->append_to_geometry(*marker_geom_, line);
 }
 
 //******************************************************************************
@@ -509,12 +659,14 @@ void Timeline_renderer::draw_selection(const Region& region,
     }
     else
     {
-        auto width_ratio = (region.right() - region.left()) /
-            state_->selected_curve()->t_duration();
-        auto left = region.left() +
-            state_->curve_selection->t_start * width_ratio;
-        auto right = region.left() +
-            state_->curve_selection->t_end   * width_ratio;
+        auto left = std::clamp(
+            time_to_x(state_->curve_selection->t_start, region),
+            region.left(),
+            region.right());
+        auto right = std::clamp(
+            time_to_x(state_->curve_selection->t_end, region),
+            region.left(),
+            region.right());
 
         const glm::vec4 background = glm::vec4(0.f, 0.f, 0.f, 0.07f);
 
@@ -547,7 +699,9 @@ void Timeline_renderer::draw_pictograms(
 {
     if(state_->selected_curve()->get_stats().switches_inds.size() == 0)
         return;
-    
+
+    PROFILE_SCOPE("Pictograms");
+
     // Draw pictograms
     size_t pictogram_num = state_->selected_curve()->get_stats().switches_inds.size() + 1;
 
@@ -611,115 +765,72 @@ void Timeline_renderer::draw_pictogram(const glm::vec2& center,
     if(!state_->tesseract)
         return;
 
-    auto fill_wireframe_obj = [this, &center](Scene_wireframe_object& obj,
-                                              float speed)
-    {
-        typedef CDT::Triangulation<float> Triangulation_type;
-        typedef CDT::V2d<float> Vert_type;
-
-        std::vector<Vert_type> verts;
-        for(size_t i = 0; i < obj.vertices().size(); ++i)
-        {
-            verts.emplace_back(
-                Vert_type::make(center.x + obj.vertices()[i](0),
-                                center.y + obj.vertices()[i](1)));
-        }
+    update_pictogram_cache();
 
+    // The cached geometry is projected for the unit size
+    auto to_screen = [&center, size](const glm::vec2& v) {
+        return center + size * v;
+    };
 
-        Triangulation_type cdt;
-        cdt.insertVertices(verts);
-        cdt.eraseSuperTriangle();
+    auto fill_pictogram = [this, &to_screen](
+                              const std::vector<glm::vec2>& triangles,
+                              float speed) {
+        const glm::vec4 color(
+            0.39f + speed * 0.51f,
+            0.39f + speed * 0.51f,
+            0.39f + speed * 0.51f,
+            1.f);
 
-        for(auto& t : cdt.triangles)
+        for(size_t i = 0; i + 2 < triangles.size(); i += 3)
         {
             Screen_shader::Triangle screen_t;
-
-            screen_t.v1 = glm::vec2(cdt.vertices[t.vertices[0]].pos.x,
-                                    cdt.vertices[t.vertices[0]].pos.y);
-            screen_t.v2 = glm::vec2(cdt.vertices[t.vertices[1]].pos.x,
-                                    cdt.vertices[t.vertices[1]].pos.y);
-            screen_t.v3 = glm::vec2(cdt.vertices[t.vertices[2]].pos.x,
-                                    cdt.vertices[t.vertices[2]].pos.y);
-
-            screen_t.color = glm::vec4(
-                0.39f + speed * 0.51f,
-                0.39f + speed * 0.51f,
-                0.39f + speed * 0.51f,
-                1.f);
+            screen_t.v1 = to_screen(triangles[i]);
+            screen_t.v2 = to_screen(triangles[i + 1]);
+            screen_t.v3 = to_screen(triangles[i + 2]);
+            screen_t.color = color;
 
             screen_shader_->append_to_geometry(*screen_geom_, screen_t);
         }
     };
 
-    auto draw_wireframe_obj = [this, &center](
-                                  const Scene_wireframe_object& obj) {
-        for(auto& e : obj.edges())
-        {
-            const auto& v1 = obj.vertices()[e.vert1];
-            const auto& v2 = obj.vertices()[e.vert2];
-
-            const float width(1.f);
-            const glm::vec4 color(0.f, 0.f, 0.f, 1.f);
+    auto draw_line = [this, &to_screen](const glm::vec2& v1,
+                                        const glm::vec2& v2) {
+        const float width(1.f);
+        const glm::vec4 color(0.f, 0.f, 0.f, 1.f);
 
-            Screen_shader::Line_strip line;
-            line.emplace_back(Screen_shader::Line_point(
-                center + glm::vec2(v1(0), v1(1)), width, color));
-            line.emplace_back(Screen_shader::Line_point(
-                center + glm::vec2(v2(0), v2(1)), width, color));
+        Screen_shader::Line_strip line;
+        line.emplace_back(Screen_shader::Line_point(
+            to_screen(v1), width, color));
+        line.emplace_back(Screen_shader::Line_point(
+            to_screen(v2), width, color));
 
-            screen_shader_->append_to_geometry(*screen_geom_, line);
-        }
+        screen_shader_->append_to_geometry(*screen_geom_, line);
     };
 
-    auto draw_curve =
-        [this, &center, &seleciton](const Curve& curve) {
-            for(auto& e : curve.edges())
-            {
-                const auto& v1 = curve.vertices()[e.vert1];
-                const auto& v2 = curve.vertices()[e.vert2];
+    // Points of the selected curve within the selection. The range is found
+    // once and then only these points are visited
+    const Curve& selected_curve = *state_->selected_curve().get();
+    const auto index_range = selected_curve.get_index_range(seleciton);
 
-                float t1 = curve.time_stamp()[e.vert1];
-                float t2 = curve.time_stamp()[e.vert2];
+    auto get_curve_speed = [&selected_curve, &index_range]() {
+        const auto& stats = selected_curve.get_stats();
 
-                if(seleciton.in_range(t1) && seleciton.in_range(t2))
-                {
-                    const float width(1.f);
-                    const glm::vec4 color(0.f, 0.f, 0.f, 1.f);
+        // Edge 'i' starts at the point 'i'
+        const size_t end_edge =
+            std::min(index_range.second, selected_curve.edges().size());
 
-                    Screen_shader::Line_strip line;
-                    line.emplace_back(Screen_shader::Line_point(
-                        center + glm::vec2(v1(0), v1(1)), width, color));
-                    line.emplace_back(Screen_shader::Line_point(
-                        center + glm::vec2(v2(0), v2(1)), width, color));
-
-                    screen_shader_->append_to_geometry(*screen_geom_, line);
-                }
-            }
-        };
-
-    auto get_curve_speed = [this, &seleciton](Curve& curve) {
         auto speed = std::numeric_limits<float>::min();
-        for(auto& e : curve.edges())
-        {
-            const auto& v1 = curve.vertices()[e.vert1];
-            float t = curve.time_stamp()[e.vert1];
-            if(seleciton.in_range(t))
-            {
-                speed = std::max(speed, curve.get_stats().speed[e.vert1]);
-            }
-        }
+        for(size_t i = index_range.first; i < end_edge; ++i)
+            speed = std::max(speed, stats.speed[i]);
 
         float norm_speed =
-            (speed - curve.get_stats().min_speed) /
-            (curve.get_stats().max_speed - curve.get_stats().min_speed);
+            (speed - stats.min_speed) /
+            (stats.max_speed - stats.min_speed);
         float log_speed = Global::log_speed(norm_speed);
 
         return log_speed;
     };
 
-    std::vector<Cube> cubes = state_->tesseract->split();
-    std::vector<Square> squares = Cube::split(cubes);
-
     auto average_range = [&range](int i) {
         if(i == 0)
             return 0.5f * (std::get<0>(range.x) + std::get<1>(range.x));
@@ -735,37 +846,40 @@ void Timeline_renderer::draw_pictogram(const glm::vec2& center,
         return 0.f;
     };
 
-    std::unique_ptr<Cube> cube;
-    std::unique_ptr<Square> square;
-    std::unique_ptr<Tesseract> tesseract;
+    // Find the cube, the plane or the tesseract to fill. The objects are
+    // created only if their geometry is not cached yet
+    auto get_cube = [this](size_t i) {
+        return [this, i]() -> Scene_wireframe_object {
+            return state_->tesseract->split()[i];
+        };
+    };
+
+    std::string key;
+    std::function<Scene_wireframe_object()> make_object;
 
     if(dim == "xyz")
     {
-        if(average_range(3) > 0)
-            cube = std::make_unique<Cube>(cubes[0]);
-        else
-            cube = std::make_unique<Cube>(cubes[1]);
+        const size_t i = average_range(3) > 0 ? 0 : 1;
+        key = "cube" + std::to_string(i);
+        make_object = get_cube(i);
     }
     else if(dim == "xyw")
     {
-        if(average_range(2) > 0)
-            cube = std::make_unique<Cube>(cubes[2]);
-        else
-            cube = std::make_unique<Cube>(cubes[3]);
+        const size_t i = average_range(2) > 0 ? 2 : 3;
+        key = "cube" + std::to_string(i);
+        make_object = get_cube(i);
     }
     else if(dim == "xzw")
     {
-        if(average_range(1) > 0)
-            cube = std::make_unique<Cube>(cubes[5]);
-        else
-            cube = std::make_unique<Cube>(cubes[4]);
+        const size_t i = average_range(1) > 0 ? 5 : 4;
+        key = "cube" + std::to_string(i);
+        make_object = get_cube(i);
     }
     else if(dim == "yzw")
     {
-        if(average_range(0) > 0)
-            cube = std::make_unique<Cube>(cubes[7]);
-        else
-            cube = std::make_unique<Cube>(cubes[6]);
+        const size_t i = average_range(0) > 0 ? 7 : 6;
+        key = "cube" + std::to_string(i);
+        make_object = get_cube(i);
     }
     else if(dim.size() == 2)
     {
@@ -793,53 +907,123 @@ void Timeline_renderer::draw_pictogram(const glm::vec2& center,
             if(mask[i] == 'n')
                 mask[i] = average_range(i) > 0 ? '1' : '0';
         }
-        square = std::make_unique<Square>(state_->tesseract->get_plain(mask));
+
+        key = "plane" + mask;
+        make_object = [this, mask]() -> Scene_wireframe_object {
+            return state_->tesseract->get_plain(mask);
+        };
     }
     else if(dim.size() == 4)
     {
-        tesseract = std::make_unique<Tesseract>(*state_->tesseract.get());
+        key = "tesseract";
+        make_object = [this]() -> Scene_wireframe_object {
+            return *state_->tesseract.get();
+        };
     }
 
-    if(cube)
+    if(make_object)
+        fill_pictogram(get_pictogram_fill(key, make_object), get_curve_speed());
+
+    for(size_t i = 0; i + 1 < pictogram_lines_.size(); i += 2)
+        draw_line(pictogram_lines_[i], pictogram_lines_[i + 1]);
+
+    for(size_t i = index_range.first + 1; i < index_range.second; ++i)
+        draw_line(pictogram_curve_[i - 1], pictogram_curve_[i]);
+}
+
+//******************************************************************************
+// update_pictogram_cache
+//
+// Pictograms only depend on the tesseract and the selected curve. Their
+// geometry is projected once for the unit size and scaled when drawing, as
+// the pictogram projection is linear in the size
+//******************************************************************************
+
+void Timeline_renderer::update_pictogram_cache()
+{
+    auto to_vec2 = [](const Scene_vertex_t& v) {
+        return glm::vec2(v(0), v(1));
+    };
+
+    const bool tesseract_changed =
+        pictogram_tesseract_.lock() != state_->tesseract ||
+        pictogram_tesseract_size_ != state_->tesseract_size;
+
+    if(tesseract_changed)
     {
-        // Draw a cube
-        project_point_array(
-            cube->get_vertices(),
-            size);
-        fill_wireframe_obj(*cube.get(), get_curve_speed(*state_->selected_curve().get()));
-        // draw_wireframe_obj(*cube.get());
+        pictogram_tesseract_ = state_->tesseract;
+        pictogram_tesseract_size_ = state_->tesseract_size;
+        pictogram_fills_.clear();
+
+        Tesseract t = *state_->tesseract.get();
+        project_point_array(t.get_vertices(), 1.f);
+
+        pictogram_lines_.clear();
+        for(auto& e : t.edges())
+        {
+            pictogram_lines_.push_back(to_vec2(t.vertices()[e.vert1]));
+            pictogram_lines_.push_back(to_vec2(t.vertices()[e.vert2]));
+        }
     }
-    else if(square)
+
+    const auto curve = state_->selected_curve();
+    if(tesseract_changed || pictogram_curve_source_.lock() != curve)
     {
-        // Draw a plain
-        project_point_array(
-            square->get_vertices(),
-            size);
-        fill_wireframe_obj(
-            *square.get(),
-            get_curve_speed(*state_->selected_curve().get()));
-        // draw_wireframe_obj(*square.get());
+        pictogram_curve_source_ = curve;
+
+        pictogram_curve_.resize(curve->vertices().size());
+        for(size_t i = 0; i < curve->vertices().size(); ++i)
+        {
+            Scene_vertex_t p = curve->vertices()[i];
+            project_point(p, 1.f);
+            pictogram_curve_[i] = to_vec2(p);
+        }
     }
+}
+
+//******************************************************************************
+// get_pictogram_fill
+//
+// Returns triangles covering the projection of the object at the unit size
+//******************************************************************************
 
-    if(tesseract)
+const std::vector<glm::vec2>& Timeline_renderer::get_pictogram_fill(
+    const std::string& key,
+    const std::function<Scene_wireframe_object()>& make_object)
+{
+    auto it = pictogram_fills_.find(key);
+    if(it != pictogram_fills_.end())
+        return it->second;
+
+    typedef CDT::Triangulation<float> Triangulation_type;
+    typedef CDT::V2d<float> Vert_type;
+
+    Scene_wireframe_object obj = make_object();
+    project_point_array(obj.get_vertices(), 1.f);
+
+    std::vector<Vert_type> verts;
+    for(size_t i = 0; i < obj.vertices().size(); ++i)
     {
-        // Draw a tesseract
-        project_point_array(
-            tesseract->get_vertices(),
-            size);
-        fill_wireframe_obj(
-            *tesseract.get(),
-            get_curve_speed(*state_->selected_curve().get()));
-        // draw_wireframe_obj(*tesseract.get());
+        verts.emplace_back(
+            Vert_type::make(obj.vertices()[i](0), obj.vertices()[i](1)));
     }
 
-    Tesseract t = *state_->tesseract.get();
-    project_point_array(t.get_vertices(), size);
-    draw_wireframe_obj(t);
+    Triangulation_type cdt;
+    cdt.insertVertices(verts);
+    cdt.eraseSuperTriangle();
+
+    std::vector<glm::vec2> triangles;
+    triangles.reserve(3 * cdt.triangles.size());
+    for(auto& t : cdt.triangles)
+    {
+        for(size_t i = 0; i < 3; ++i)
+        {
+            const auto& pos = cdt.vertices[t.vertices[i]].pos;
+            triangles.emplace_back(pos.x, pos.y);
+        }
+    }
 
-    Curve c = *state_->selected_curve().get();
-    project_point_array(c.get_vertices(), size);
-    draw_curve(c);
+    return pictogram_fills_[key] = std::move(triangles);
 }
 
 //******************************************************************************
@@ -997,34 +1181,19 @@ void Timeline_renderer::make_selection(const Mouse_selection& s)
         return;
     }
 
-    auto get_local_coord = [this](float x_coord) {
-        return (x_coord - plot_region_.left()) / (plot_region_.width());
-    };
-
     // Currently, we are interested only in X coordinates of the user selection
-    float x_min, x_max;
-    if(s.start_pnt.x < s.end_pnt.x)
-    {
-        // The selection was done from left to right
-        x_min = get_local_coord(s.start_pnt.x);
-        x_max = get_local_coord(s.end_pnt.x  );
-    }
-    else
-    {
-        // The selection was done from right to left
-        x_min = get_local_coord(s.end_pnt.x  );
-        x_max = get_local_coord(s.start_pnt.x);
-    }
-
-    auto t_start  = state_->selected_curve()->t_min();
-    auto t_end    = state_->selected_curve()->t_max();
-    auto t_length = t_end - t_start;
+    auto get_time = [this](float x_coord) {
+        return x_to_time(
+            std::clamp(x_coord, plot_region_.left(), plot_region_.right()),
+            plot_region_);
+    };
 
-    // FIXME: the current approach works only if the curve is defined by points
-    // with fixed delta time
+    // The selection can be done from left to right or from right to left
     state_->curve_selection = std::make_unique<Curve_selection>();
-    state_->curve_selection->t_start = t_start + x_min * t_length;
-    state_->curve_selection->t_end = t_start + x_max * t_length;
+    state_->curve_selection->t_start =
+        get_time(std::min(s.start_pnt.x, s.end_pnt.x));
+    state_->curve_selection->t_end =
+        get_time(std::max(s.start_pnt.x, s.end_pnt.x));
 }
 
 //******************************************************************************
@@ -1038,16 +1207,11 @@ void Timeline_renderer::calculate_switch_points(
     if(state_->selected_curve()->time_stamp().size() == 0)
         return;
 
-    float t_min = state_->selected_curve()->t_min();
-    float t_max = state_->selected_curve()->t_max();
-    float t_duration = t_max - t_min;
-
+    const auto& time_stamp = state_->selected_curve()->time_stamp();
     for(auto s : state_->selected_curve()->get_stats().switches_inds)
     {
-        float x_pos = region.left() +
-                      region.width() * state_->selected_curve()->time_stamp()[s] /
-                      t_duration;
-        out_points.push_back(x_pos);
+        float x_pos = time_to_x(time_stamp[s], region);
+        out_points.push_back(std::clamp(x_pos, region.left(), region.right()));
     }
 }
 
@@ -1119,6 +1283,230 @@ void Timeline_renderer::update_regions()
                                splitter_ * region_.height() - margin);
 }
 
+//******************************************************************************
+// update_view
+//
+// Resets the view to all curves if it is not initialized or does not fit the
+// curves anymore
+//******************************************************************************
+
+void Timeline_renderer::update_view()
+{
+    float t_min, t_max;
+    get_time_bounds(t_min, t_max);
+
+    if(view_t_end_ <= view_t_start_ ||
+       view_t_start_ < t_min ||
+       view_t_end_ > t_max)
+    {
+        view_t_start_ = t_min;
+        view_t_end_ = t_max;
+    }
+
+    // Remove pyramids of the deleted curves
+    for(auto it = pyramids_.begin(); it != pyramids_.end();)
+    {
+        if(it->second.curve.expired())
+            it = pyramids_.erase(it);
+        else
+            ++it;
+    }
+}
+
+//******************************************************************************
+// zoom_view
+//
+// Scales the view around the time at the screen position 'x'
+//******************************************************************************
+
+void Timeline_renderer::zoom_view(float factor, float x)
+{
+    update_view();
+
+    float t_min, t_max;
+    get_time_bounds(t_min, t_max);
+    const float min_duration = 1e-4f * (t_max - t_min);
+
+    const float ratio = std::clamp(
+        (x - plot_region_.left()) / plot_region_.width(), 0.f, 1.f);
+    const float t = x_to_time(x, plot_region_);
+    const float duration = std::clamp(
+        (view_t_end_ - view_t_start_) * factor, min_duration, t_max - t_min);
+
+    view_t_start_ = t - ratio * duration;
+    view_t_end_ = view_t_start_ + duration;
+
+    // Keep the view inside the curves
+    if(view_t_start_ < t_min)
+    {
+        view_t_start_ = t_min;
+        view_t_end_ = t_min + duration;
+    }
+    if(view_t_end_ > t_max)
+    {
+        view_t_end_ = t_max;
+        view_t_start_ = t_max - duration;
+    }
+}
+
+//******************************************************************************
+// pan_view
+//******************************************************************************
+
+void Timeline_renderer::pan_view(float dx)
+{
+    update_view();
+
+    float t_min, t_max;
+    get_time_bounds(t_min, t_max);
+    const float duration = view_t_end_ - view_t_start_;
+
+    const float dt = std::clamp(
+        -dx / plot_region_.width() * duration,
+        t_min - view_t_start_,
+        t_max - view_t_end_);
+
+    view_t_start_ += dt;
+    view_t_end_ += dt;
+}
+
+//******************************************************************************
+// time_to_x
+//******************************************************************************
+
+float Timeline_renderer::time_to_x(float t, const Region& region) const
+{
+    return region.left() +
+           region.width() * (t - view_t_start_) / (view_t_end_ - view_t_start_);
+}
+
+//******************************************************************************
+// x_to_time
+//******************************************************************************
+
+float Timeline_renderer::x_to_time(float x, const Region& region) const
+{
+    return view_t_start_ +
+           (x - region.left()) / region.width() * (view_t_end_ - view_t_start_);
+}
+
+//******************************************************************************
+// get_time_bounds
+//******************************************************************************
+
+void Timeline_renderer::get_time_bounds(float& t_min, float& t_max) const
+{
+    t_min = state_->selected_curve()->t_min();
+    t_max = state_->selected_curve()->t_max();
+
+    for(const auto& c : state_->curves)
+    {
+        if(c->time_stamp().empty())
+            continue;
+        t_min = std::min(t_min, c->t_min());
+        t_max = std::max(t_max, c->t_max());
+    }
+}
+
+//******************************************************************************
+// lanes_per_view
+//******************************************************************************
+
+size_t Timeline_renderer::lanes_per_view(const Region& region) const
+{
+    const size_t fit = static_cast<size_t>(
+        std::max(1.f, std::floor(region.height() / Min_lane_height)));
+
+    return std::max<size_t>(1, std::min(fit, state_->curves.size()));
+}
+
+//******************************************************************************
+// scroll_lanes
+//******************************************************************************
+
+void Timeline_renderer::scroll_lanes(int lanes)
+{
+    const size_t last_first =
+        state_->curves.size() - lanes_per_view(plot_region_);
+
+    if(lanes < 0)
+        first_lane_ -= std::min(first_lane_, static_cast<size_t>(-lanes));
+    else
+        first_lane_ = std::min(first_lane_ + lanes, last_first);
+}
+
+//******************************************************************************
+// get_pyramid
+//******************************************************************************
+
+Timeline_renderer::Cached_pyramid& Timeline_renderer::get_pyramid(
+    const std::shared_ptr<Curve>& curve)
+{
+    auto& cached = pyramids_[curve.get()];
+    if(!cached.pyramid || cached.curve.lock() != curve)
+    {
+        cached.curve = curve;
+        cached.pyramid = std::make_unique<Curve_pyramid>(*curve);
+        cached.is_valid.fill(false);
+        cached.t_start = cached.t_end = 0.f;
+        cached.columns = 0;
+    }
+
+    return cached;
+}
+
+//******************************************************************************
+// get_decimated
+//
+// The decimated points are kept until the view or the number of columns
+// changes, so the lanes are not decimated again every frame
+//******************************************************************************
+
+const std::vector<Curve_pyramid::Point>& Timeline_renderer::get_decimated(
+    Cached_pyramid& cached,
+    size_t dim,
+    size_t columns)
+{
+    if(cached.t_start != view_t_start_ ||
+       cached.t_end != view_t_end_ ||
+       cached.columns != columns)
+    {
+        cached.is_valid.fill(false);
+        cached.t_start = view_t_start_;
+        cached.t_end = view_t_end_;
+        cached.columns = columns;
+    }
+
+    auto& points = cached.points[dim];
+    if(cached.is_valid[dim])
+        return points;
+
+    points.clear();
+    cached.pyramid->decimate(
+        dim, view_t_start_, view_t_end_, columns, points);
+
+    // The first and the last points may be outside of the view, they are
+    // moved to its borders
+    auto clip = [](Curve_pyramid::Point& p,
+                   const Curve_pyramid::Point& inner,
+                   float t) {
+        if(p.t == inner.t)
+            return;
+        p.value += (t - p.t) / (inner.t - p.t) * (inner.value - p.value);
+        p.t = t;
+    };
+    if(points.size() > 1)
+    {
+        if(points.front().t < view_t_start_)
+            clip(points.front(), points[1], view_t_start_);
+        if(points.back().t > view_t_end_)
+            clip(points.back(), points[points.size() - 2], view_t_end_);
+    }
+
+    cached.is_valid[dim] = true;
+    return points;
+}
+
 //******************************************************************************
 // magnification_func
 //******************************************************************************
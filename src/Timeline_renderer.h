@@ -1,11 +1,15 @@
 #pragma once
 // local
 #include "Base_renderer.h"
+#include "Curve_pyramid.h"
 #include "Geometry_engine.h"
 #include "Scene_state.h"
 #include "Screen_shader.h"
 #include "Text_renderer.h"
 // std
+#include <array>
+#include <functional>
+#include <map>
 #include <memory.h>
 // glm
 #include <glm/glm.hpp>
@@ -37,6 +41,18 @@ private:
         float x_pos, scale;
     };
 
+    struct Cached_pyramid
+    {
+        std::weak_ptr<Curve> curve;
+        std::unique_ptr<Curve_pyramid> pyramid;
+
+        // Decimated points of the dimensions for the last drawn view
+        std::array<std::vector<Curve_pyramid::Point>, 4> points;
+        std::array<bool, 4> is_valid;
+        float t_start, t_end;
+        size_t columns;
+    };
+
     Timeline_renderer() = delete;
 
 public:
@@ -57,10 +73,15 @@ public:
     void set_pictogram_size(float size);
     void set_pictogram_magnification(float scale, int region_size);
 
+    // Builds the pictogram geometry without drawing it and returns the number
+    // of vertices. Used by the benchmarks
+    size_t build_pictograms();
+
 private:
     // Drawing functions
     void draw_axes(      const Region& region);
     void draw_curve(     const Region& region);
+    void draw_lane(      const Region& region, const std::shared_ptr<Curve>& c);
     void draw_switches(  const Region& region);
     void draw_marker(    const Region& region);
     void draw_selection( const Region& region, const Mouse_selection& s);
@@ -84,6 +105,11 @@ private:
         std::vector<float>& out_points,
         const Region& region);
 
+    void update_pictogram_cache();
+    const std::vector<glm::vec2>& get_pictogram_fill(
+        const std::string& key,
+        const std::function<Scene_wireframe_object()>& make_object);
+
     void project_point(
         Scene_vertex_t& point,
         float size);
@@ -93,11 +119,32 @@ private:
 
     void update_regions();
 
+    // Visible time range of the plot
+    void update_view();
+    void zoom_view(float factor, float x);
+    void pan_view(float dx);
+    float time_to_x(float t, const Region& region) const;
+    float x_to_time(float x, const Region& region) const;
+    // Time range of all curves
+    void get_time_bounds(float& t_min, float& t_max) const;
+
+    // Stacked lanes, one per curve
+    size_t lanes_per_view(const Region& region) const;
+    void scroll_lanes(int lanes);
+
+    Cached_pyramid& get_pyramid(const std::shared_ptr<Curve>& curve);
+    const std::vector<Curve_pyramid::Point>& get_decimated(
+        Cached_pyramid& cached,
+        size_t dim,
+        size_t columns);
+
     float magnification_func(float x);
     float magnification_func_area(float x_start, float x_end);
 
     std::shared_ptr<Screen_shader> screen_shader_;
     std::unique_ptr<Screen_shader::Screen_geometry> screen_geom_;
+    // The time marker, drawn over the plot
+    std::unique_ptr<Screen_shader::Screen_geometry> marker_geom_;
 
     std::shared_ptr<Text_renderer> text_renderer_;
 
@@ -105,6 +152,15 @@ private:
     float pictogram_size_, pictogram_spacing_, pictogram_scale_;
     size_t pictogram_magnification_region_;
 
+    // Pictogram geometry for the unit size: filled cubes, planes and the
+    // tesseract by key, the tesseract edges and the curve
+    std::map<std::string, std::vector<glm::vec2>> pictogram_fills_;
+    std::vector<glm::vec2> pictogram_lines_;
+    std::vector<glm::vec2> pictogram_curve_;
+    std::weak_ptr<Tesseract> pictogram_tesseract_;
+    std::array<float, 4> pictogram_tesseract_size_;
+    std::weak_ptr<Curve> pictogram_curve_source_;
+
     glm::vec2 mouse_pos_;
     bool track_mouse_;
     bool is_mouse_inside_;
@@ -115,4 +171,13 @@ private:
     float splitter_;
 
     std::vector<bool> show_axes_;
+
+    float view_t_start_, view_t_end_;
+    bool track_pan_;
+
+    // Index of the curve in the topmost visible lane
+    size_t first_lane_;
+
+    // Decimation pyramids of the curves, rebuilt if a curve is reloaded
+    std::map<const Curve*, Cached_pyramid> pyramids_;
 };
@@ -3,3 +3,113 @@
 //
 
 #include "Transport.h"
+
+#include "Stk.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+void Transport::play() {
+    pendingPlaying.store(true, std::memory_order_relaxed);
+    playCount.fetch_add(1, std::memory_order_release);
+    publishedPlaying.store(true, std::memory_order_relaxed);
+}
+
+void Transport::pause() {
+    pendingPlaying.store(false, std::memory_order_relaxed);
+    playCount.fetch_add(1, std::memory_order_release);
+    publishedPlaying.store(false, std::memory_order_relaxed);
+}
+
+void Transport::seek(double position) {
+    position = std::max(0.0, std::min(position, 1.0));
+    pendingSeekPosition.store(position, std::memory_order_relaxed);
+    seekCount.fetch_add(1, std::memory_order_release);
+    publishedPosition.store(position, std::memory_order_relaxed);
+}
+
+void Transport::setSpeed(double speed) {
+    this->speed.store(speed, std::memory_order_relaxed);
+}
+
+void Transport::setLoop(bool isLooping) {
+    this->isLooping.store(isLooping, std::memory_order_relaxed);
+}
+
+double Transport::getPosition() const {
+    return publishedPosition.load(std::memory_order_relaxed);
+}
+
+bool Transport::isPlaying() const {
+    return publishedPlaying.load(std::memory_order_relaxed);
+}
+
+unsigned long long Transport::getFrames() const {
+    return publishedFrames.load(std::memory_order_relaxed);
+}
+
+const Transport::Block& Transport::advance(unsigned int nFrames) {
+    const unsigned int seeks = seekCount.load(std::memory_order_acquire);
+    if (seeks != appliedSeekCount) {
+        setAnchor(pendingSeekPosition.load(std::memory_order_relaxed));
+        appliedSeekCount = seeks;
+    }
+
+    const unsigned int commands = playCount.load(std::memory_order_acquire);
+    if (commands != appliedPlayCount) {
+        const bool play = pendingPlaying.load(std::memory_order_relaxed);
+        // After stopping at the end the playback starts over
+        if (play && !playing && position >= 1.0) {
+            position = 0.0;
+        }
+        playing = play;
+        setAnchor(position);
+        appliedPlayCount = commands;
+    }
+
+    const double newSpeed = speed.load(std::memory_order_relaxed);
+    if (newSpeed != appliedSpeed) {
+        setAnchor(position);
+        appliedSpeed = newSpeed;
+    }
+
+    block.start = position;
+    frames += nFrames;
+    double end = position;
+    if (playing) {
+        end = anchorPosition
+              + (frames - anchorFrames) * appliedSpeed / stk::Stk::sampleRate();
+    }
+    if (end >= 1.0) {
+        if (isLooping.load(std::memory_order_relaxed)) {
+            // The anchor moves back by the laps, the block ends past 1
+            const double laps = std::floor(end);
+            anchorPosition -= laps;
+            position = end - laps;
+        } else {
+            end = 1.0;
+            position = 1.0;
+            playing = false;
+        }
+    } else {
+        position = end;
+    }
+    block.end = end;
+
+    // Values of the last block are not published over pending commands
+    if (seekCount.load(std::memory_order_relaxed) == appliedSeekCount) {
+        publishedPosition.store(position, std::memory_order_relaxed);
+    }
+    if (playCount.load(std::memory_order_relaxed) == appliedPlayCount) {
+        publishedPlaying.store(playing, std::memory_order_relaxed);
+    }
+    publishedFrames.store(frames, std::memory_order_relaxed);
+    return block;
+}
+
+void Transport::setAnchor(double position) {
+    this->position = position;
+    anchorPosition = position;
+    anchorFrames = frames;
+}
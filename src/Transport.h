@@ -5,9 +5,79 @@
 #ifndef MANYLANDS_TRANSPORT_H
 #define MANYLANDS_TRANSPORT_H
 
+#include <atomic>
 
+
+// Playback position of the curves, shared by the voices, the marker and the
+// OSC messages. The UI thread plays, pauses, seeks and sets the speed and the
+// loop through atomics. The audio callback applies them at the start of each
+// block and moves the position on by the frames of the block, so the position
+// follows the audio clock and does not depend on the frame rate of the UI.
+//
+// The position is computed from the frames since the last change of the
+// playback instead of being summed up block by block, so it does not drift.
+// It is published after every block and read by any thread without locks.
 class Transport {
+public:
+    // Part of the curve played by a block, 'end' is past 1 if the block wraps
+    // around the end of the loop
+    struct Block {
+        double start;
+        double end;
+    };
+
+    // The position and the playing state are published right away, the
+    // callback applies them with the next block
+    void play();
+    void pause();
+    // Position in [0, 1]
+    void seek(double position);
+    // Positions per second
+    void setSpeed(double speed);
+    // Without the loop the playback stops at the end, play() starts over
+    void setLoop(bool isLooping);
+
+    double getPosition() const;
+    bool isPlaying() const;
+    // Frames the transport was moved on by, playing or not
+    unsigned long long getFrames() const;
+
+    // Called by the audio callback at the start of a block of nFrames, or by
+    // the UI thread while no stream runs. Does not allocate or lock
+    const Block& advance(unsigned int nFrames);
+    // Block of the last advance(), only used by the callback
+    const Block& getBlock() const {
+        return block;
+    }
+
+private:
+    // The position moves on from 'position' at the current frame
+    void setAnchor(double position);
+
+    // Written by the UI thread, read by the callback. A command is pending
+    // while its count differs from the applied one
+    std::atomic<bool> pendingPlaying{false};
+    std::atomic<unsigned int> playCount{0};
+    std::atomic<double> pendingSeekPosition{0.0};
+    std::atomic<unsigned int> seekCount{0};
+    std::atomic<double> speed{0.0};
+    std::atomic<bool> isLooping{true};
+
+    // Published by the callback
+    std::atomic<double> publishedPosition{0.0};
+    std::atomic<bool> publishedPlaying{false};
+    std::atomic<unsigned long long> publishedFrames{0};
 
+    // Only used by the callback
+    unsigned int appliedPlayCount = 0;
+    unsigned int appliedSeekCount = 0;
+    double appliedSpeed = 0.0;
+    bool playing = false;
+    double position = 0.0;
+    unsigned long long frames = 0;
+    double anchorPosition = 0.0;
+    unsigned long long anchorFrames = 0;
+    Block block{0.0, 0.0};
 };
 
 
@@ -0,0 +1,168 @@
+//
+// Voices of the sonification, one per sonified curve.
+//
+
+#include "VoicePool.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+void VoicePool::init(int noOfVoices, const TickData& instrument) {
+    voices.clear();
+    for (int i = 0; i < noOfVoices; i++) {
+        voices.push_back(std::make_unique<Voice>());
+        voices.back()->data.copyFrom(instrument);
+        voices.back()->data.setGate(false);
+    }
+    scratch.assign(stk::RT_BUFFER_SIZE, 0.0);
+    noOfAssignments = 0;
+}
+
+int VoicePool::acquire(const void* owner, bool& isNew) {
+    isNew = false;
+    int found = -1;
+    for (int i = 0; i < size(); i++) {
+        if (voices[i]->owner == owner) {
+            return i;
+        }
+        // Free, then releasing, then the first assigned voice
+        auto rank = [](const Voice& voice) {
+            return voice.owner ? 2 : voice.isSounding.load() ? 1 : 0;
+        };
+        if (found < 0
+            || rank(*voices[i]) < rank(*voices[found])
+            || (rank(*voices[i]) == rank(*voices[found])
+                && voices[i]->assignedAt < voices[found]->assignedAt)) {
+            found = i;
+        }
+    }
+    if (found < 0) {
+        return -1;
+    }
+
+    Voice& voice = *voices[found];
+    voice.owner = owner;
+    voice.assignedAt = ++noOfAssignments;
+    voice.data.setGate(isGateOn);
+    isNew = true;
+    return found;
+}
+
+void VoicePool::release(const void* owner) {
+    for (auto& voice : voices) {
+        if (voice->owner == owner) {
+            voice->owner = nullptr;
+            voice->data.setGate(false);
+        }
+    }
+}
+
+void VoicePool::releaseOthers(const std::vector<const void*>& owners) {
+    for (auto& voice : voices) {
+        if (voice->owner && std::find(owners.begin(), owners.end(),
+                                      voice->owner) == owners.end()) {
+            voice->owner = nullptr;
+            voice->data.setGate(false);
+        }
+    }
+}
+
+TickData& VoicePool::getVoice(int voice) {
+    return voices[voice]->data;
+}
+
+void VoicePool::setMix(int voice, float gain, float pan) {
+    voices[voice]->gain.store(gain, std::memory_order_relaxed);
+    voices[voice]->pan.store(std::max(-1.0f, std::min(pan, 1.0f)),
+                             std::memory_order_relaxed);
+}
+
+void VoicePool::setGate(bool isOn) {
+    isGateOn = isOn;
+    for (auto& voice : voices) {
+        if (voice->owner) {
+            voice->data.setGate(isOn);
+        }
+    }
+}
+
+void VoicePool::updateMinMaxFrequency(float minFrequency, float maxFrequency) {
+    for (auto& voice : voices) {
+        voice->data.updateMinMaxFrequency(minFrequency, maxFrequency);
+    }
+}
+
+int VoicePool::getNoOfSoundingVoices() const {
+    int noOfSounding = 0;
+    for (auto& voice : voices) {
+        noOfSounding += voice->isSounding.load(std::memory_order_relaxed);
+    }
+    return noOfSounding;
+}
+
+void VoicePool::render(stk::StkFloat* out, unsigned int nFrames,
+                       const Transport::Block* block) {
+    std::fill(out, out + NO_OF_CHANNELS * nFrames, 0.0);
+
+    // Blocks longer than the scratch buffer are split
+    const unsigned int blockSize = (unsigned int) scratch.size();
+    for (unsigned int start = 0; start < nFrames; start += blockSize) {
+        const unsigned int count = std::min(blockSize, nFrames - start);
+        // The part of the transport block, from the start of the curve
+        Transport::Block part{0.0, 0.0};
+        if (block) {
+            const double span = block->end - block->start;
+            part.start = block->start + span * start / nFrames;
+            part.end = block->start + span * (start + count) / nFrames;
+            const double laps = std::floor(part.start);
+            part.start -= laps;
+            part.end -= laps;
+        }
+        for (auto& voice : voices) {
+            // Silent voices take their parameters but are not rendered
+            if (block) {
+                voice->data.applyPendingParameters(count, part);
+            } else {
+                voice->data.applyPendingParameters(count);
+            }
+            const bool isSounding = !voice->data.isSilent();
+            voice->isSounding.store(isSounding, std::memory_order_relaxed);
+            if (isSounding) {
+                voice->data.render(scratch.data(), count);
+                mix(*voice, scratch.data(), out + NO_OF_CHANNELS * start,
+                    count);
+            }
+        }
+    }
+}
+
+void VoicePool::mix(Voice& voice, const stk::StkFloat* samples,
+                    stk::StkFloat* out, unsigned int nFrames) {
+    const float quarterPi = 0.785398163f;
+    auto left = [quarterPi](float gain, float pan) {
+        return gain * std::cos((pan + 1.0f) * quarterPi);
+    };
+    auto right = [quarterPi](float gain, float pan) {
+        return gain * std::sin((pan + 1.0f) * quarterPi);
+    };
+
+    const float gain = voice.gain.load(std::memory_order_relaxed);
+    // The pan of the control curve moves the voice
+    const float pan = std::max(-1.0f, std::min(
+            voice.pan.load(std::memory_order_relaxed) + voice.data.getPan(),
+            1.0f));
+    stk::StkFloat l = left(voice.appliedGain, voice.appliedPan);
+    stk::StkFloat r = right(voice.appliedGain, voice.appliedPan);
+    const stk::StkFloat dl = (left(gain, pan) - l) / nFrames;
+    const stk::StkFloat dr = (right(gain, pan) - r) / nFrames;
+    for (unsigned int i = 0; i < nFrames; i++) {
+        l += dl;
+        r += dr;
+        out[NO_OF_CHANNELS * i] += l * samples[i];
+        out[NO_OF_CHANNELS * i + 1] += r * samples[i];
+    }
+
+    voice.appliedGain = gain;
+    voice.appliedPan = pan;
+}
@@ -0,0 +1,83 @@
+//
+// Voices of the sonification, one per sonified curve.
+//
+
+#ifndef MANYLANDS_VOICEPOOL_H
+#define MANYLANDS_VOICEPOOL_H
+
+#include "Audio.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Preallocated voices that are panned and mixed into a stereo stream. The UI
+// thread assigns the voices to owners, e.g. curves, and sets their parameters
+// through the atomics of TickData. The audio callback renders the voices that
+// sound and sums them up, it does not allocate or lock.
+//
+// An owner keeps its voice until it is released. A released voice is free
+// when its release has ended. Without a free voice a releasing one is taken,
+// and without one of those the voice that was assigned first is stolen.
+class VoicePool {
+public:
+    static const unsigned int NO_OF_CHANNELS = 2;
+
+    // Copies the settings of 'instrument' into every voice. Must not be
+    // called while the stream runs
+    void init(int noOfVoices, const TickData& instrument);
+    int size() const { return (int) voices.size(); }
+
+    // Voice of 'owner', it gets one if it has none. 'isNew' tells if the voice
+    // was assigned by this call
+    int acquire(const void* owner, bool& isNew);
+    // Closes the gate of the voice of 'owner' and frees it
+    void release(const void* owner);
+    // Releases the voices of the owners that are not in 'owners'
+    void releaseOthers(const std::vector<const void*>& owners);
+
+    TickData& getVoice(int voice);
+    // 'pan' goes from -1 (left) to 1 (right) with constant power
+    void setMix(int voice, float gain, float pan);
+
+    // Applied to all assigned voices and to the ones assigned later
+    void setGate(bool isOn);
+    void updateMinMaxFrequency(float minFrequency, float maxFrequency);
+
+    int getNoOfSoundingVoices() const;
+
+    // Called by the audio callback, renders nFrames interleaved stereo frames.
+    // With a block of a Transport the voices play its part of the curve
+    // instead of their own playback
+    void render(stk::StkFloat* out, unsigned int nFrames,
+                const Transport::Block* block = nullptr);
+
+private:
+    struct Voice {
+        TickData data;
+        std::atomic<float> gain{1.0f};
+        std::atomic<float> pan{0.0f};
+        // Published by the callback
+        std::atomic<bool> isSounding{false};
+
+        // Only used by the UI thread
+        const void* owner = nullptr;
+        unsigned long long assignedAt = 0;
+
+        // Only used by the callback, the mix is ramped over a block
+        float appliedGain = 0.0f;
+        float appliedPan = 0.0f;
+    };
+
+    void mix(Voice& voice, const stk::StkFloat* samples, stk::StkFloat* out,
+             unsigned int nFrames);
+
+    std::vector<std::unique_ptr<Voice>> voices;
+    // One mono block of a voice
+    std::vector<stk::StkFloat> scratch;
+    unsigned long long noOfAssignments = 0;
+    bool isGateOn = false;
+};
+
+
+#endif //MANYLANDS_VOICEPOOL_H
@@ -45,7 +45,7 @@ template<class TVertex, class TEdge>
 Wireframe_object<TVertex, TEdge>& Wireframe_object<TVertex, TEdge>::operator=(
     const Wireframe_object& other)
 {
-    vertices_ = other.vertices_; // Copy the vertex array
+    this->vertices_ = other.vertices_; // Copy the vertex array
     edges_ = other.edges_;       // Copy the edge array
 
     return *this;
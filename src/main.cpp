@@ -48,7 +48,12 @@
 #include "Timeline_renderer.h"
 #include "Diffuse_shader.h"
 #include "Screen_shader.h"
+#include "Profiler.h"
 #include "Audio.h"
+#include "AudioGraph.h"
+#include "AudioRenderer.h"
+#include "Transport.h"
+#include "VoicePool.h"
 #include "Mandolin.h"
 #include "Whistle.h"
 #include "TubeBell.h"
@@ -115,27 +120,60 @@ const std::shared_ptr<Diffuse_shader> Diffuse_shad =
     std::make_shared<Diffuse_shader>();
 const std::shared_ptr<Screen_shader> Screen_shad =
     std::make_shared<Screen_shader>();
-const std::shared_ptr<Text_renderer> Text_ren =
+// The renderers rebuild their texts independently
+const std::shared_ptr<Text_renderer> Scene_text =
+    std::make_shared<Text_renderer>();
+const std::shared_ptr<Text_renderer> Timeline_text =
     std::make_shared<Text_renderer>();
 
 
 Scene Scene_objs(State);
 
 RtAudio dac;
-Audio audio(&dac);
+Audio audio(std::make_unique<DeviceAudioBackend>(&dac));
+// Settings of the voices and the frequency sent over OSC
 TickData instrumentData;
+// Every sonified curve plays on its own voice
+const int No_of_voices = 64;
+VoicePool voices;
+// Playback position of the voices, the marker and OSC, on the audio clock
+Transport transport;
+// The voices with their effect sends, the connections of the sends
+AudioGraph graph;
+int reverbSend = -1;
+int chorusSend = -1;
 OscpController oscpController;
 bool isAudioPlaying = false;
 std::string prevDimensionality = "";
+// Mapping loaded from a file, without one the selected data is mapped to the
+// pitch
+std::shared_ptr<const MappingSpec> mappingFile;
+// Source and mapping of the control curves of the audio callback
+Scene_state::SonificationData controlledData = Scene_state::SPEED;
+const MappingSpec* controlledMapping = nullptr;
 
 Base_renderer::Region Scene_region, Timeline_region;
 Base_renderer::Renderer_io Previous_io;
 
-std::chrono::time_point<std::chrono::system_clock> Last_timepoint;
+std::chrono::time_point<std::chrono::steady_clock> Last_timepoint;
+
+// Render-on-demand: the scene is rebuilt only if the state has changed and no
+// frames are drawn at all while the application is idle
+const int Frames_to_settle = 3;       // Frames drawn after the last change
+const Uint32 Idle_timeout_ms = 250;   // Longest sleep while waiting for events
+int Idle_frames(0);
+unsigned int Rebuilt_frames(0), Reused_frames(0), Skipped_frames(0);
+
+auto Show_profiler(false);
+// The 4D projection of the curves in the vertex shader, the CPU projection is
+// the reference
+auto Gpu_projection(true);
 
-// Timeplayer
-auto Is_player_active(false);
+// Timeplayer, it plays and pauses the transport
 auto Player_speed(0.1f);
+auto Is_player_looping(true);
+// Frames of the steady clock the transport has not been moved on by
+auto Clock_frames(0.);
 
 auto Curve_max_deviation(0.8f);
 
@@ -195,11 +233,14 @@ void process_mouse_input(const SDL_Event& event)
                               io.mouse_pos.y - Previous_io.mouse_pos.y);
     io.mouse_down = (event.button.button == SDL_BUTTON_LEFT &&
                      event.type == SDL_MOUSEBUTTONDOWN);
+    io.right_mouse_down = (event.button.button == SDL_BUTTON_RIGHT &&
+                           event.type == SDL_MOUSEBUTTONDOWN);
     io.mouse_up = (event.type == SDL_MOUSEBUTTONUP);
     io.mouse_wheel = (event.type == SDL_MOUSEWHEEL);
     io.mouse_wheel_y = 0;
     if(io.mouse_wheel)
         io.mouse_wheel_y = event.wheel.y > 0.f ? 3.f : -3.f;
+    io.key_shift = (SDL_GetModState() & KMOD_SHIFT) != 0;
 
     if(event.type == SDL_KEYDOWN)
     {
@@ -272,23 +313,130 @@ void process_mouse_input(const SDL_Event& event)
     Previous_io = io;
 }
 
+//******************************************************************************
+// init_instrument
+//******************************************************************************
+
+void init_instrument(TickData& data)
+{
+    data.initSines(6);
+    data.overtoneSteps.insert( data.overtoneSteps.end(), { 0, 3, 7, 12});
+    data.overToneLoudness.insert( data.overToneLoudness.end(), {0.2, 0.2, 0.2, 0.2 });
+    data.scaler = 0.4;
+}
+
+//******************************************************************************
+// init_graph
+//******************************************************************************
+
+// voices -> master, voices -> reverb -> master, voices -> chorus -> master
+void init_graph()
+{
+    const int voices_node =
+        graph.addNode(std::make_unique<VoicesNode>(&voices, &transport));
+    const int reverb_node = graph.addNode(std::make_unique<ReverbNode>());
+    const int chorus_node = graph.addNode(std::make_unique<ChorusNode>());
+    const int master_node = graph.addNode(std::make_unique<MixNode>());
+
+    graph.connect(voices_node, master_node);
+    reverbSend = graph.connect(voices_node, reverb_node, State->reverb_send);
+    graph.connect(reverb_node, master_node);
+    chorusSend = graph.connect(voices_node, chorus_node, State->chorus_send);
+    graph.connect(chorus_node, master_node);
+    graph.setTransport(&transport);
+    graph.compile(master_node, stk::RT_BUFFER_SIZE);
+}
+
+//******************************************************************************
+// update_voices
+//******************************************************************************
+
+// Gives every sonified curve a voice with its control curve and its mix, the
+// voices of the other curves are released
+void update_voices(bool curves_changed)
+{
+    // The pans of new curves are spread from left to right
+    const size_t no_of_curves = State->curves.size();
+    if(State->curve_voices.size() != no_of_curves)
+    {
+        State->curve_voices.assign(no_of_curves, Scene_state::Curve_voice());
+        for(size_t i = 0; no_of_curves > 1 && i < no_of_curves; ++i)
+        {
+            State->curve_voices[i].pan =
+                -1.f + 2.f * static_cast<float>(i) / (no_of_curves - 1);
+        }
+    }
+
+    const auto selected = State->selected_curve();
+    std::vector<size_t> sonified;
+    std::vector<const void*> owners;
+    for(size_t i = 0; i < no_of_curves; ++i)
+    {
+        const bool is_sonified = State->sonify_all_curves
+            ? State->curve_voices[i].is_sonified
+            : State->curves[i] == selected;
+        // More curves than voices would steal from each other
+        if(is_sonified && sonified.size() < static_cast<size_t>(voices.size()))
+        {
+            sonified.push_back(i);
+            owners.push_back(State->curves[i].get());
+        }
+    }
+
+    // Released first, so their voices can be taken when they are silent
+    voices.releaseOthers(owners);
+
+    const bool mapping_changed =
+        State->active_sonification_data != controlledData ||
+        mappingFile.get() != controlledMapping;
+    controlledData = State->active_sonification_data;
+    controlledMapping = mappingFile.get();
+    const MappingSpec mapping = mappingFile
+        ? *mappingFile
+        : defaultMappingSpec(State->active_sonification_data);
+    for(size_t i : sonified)
+    {
+        const auto& curve = State->curves[i];
+        bool is_new;
+        const int voice = voices.acquire(curve.get(), is_new);
+        if(is_new || mapping_changed || curves_changed)
+        {
+            voices.getVoice(voice).setControlCurve(
+                compileMapping(*curve, mapping));
+        }
+
+        // The voices share the level of a single voice
+        const auto& mix = State->curve_voices[i];
+        voices.setMix(
+            voice,
+            mix.gain / std::sqrt(static_cast<float>(sonified.size())),
+            State->sonify_all_curves ? mix.pan : 0.f);
+    }
+}
+
 //******************************************************************************
 // update_timer
 //******************************************************************************
 
+// The transport keeps the time on the audio clock, the marker follows it.
+// Without a stream, e.g. in the browser, the transport is moved on by the
+// steady clock instead
 void update_timer()
 {
-    auto current = std::chrono::system_clock::now();
+    auto current = std::chrono::steady_clock::now();
     std::chrono::duration<double> delta_t = current - Last_timepoint;
     Last_timepoint = current;
 
-    if(Is_player_active)
+    transport.setSpeed(Player_speed);
+    transport.setLoop(Is_player_looping);
+    if(!audio.hasStream())
     {
-        State->timeplayer_pos = std::fmod(
-            State->timeplayer_pos +
-            static_cast<float>(delta_t.count()) * Player_speed, 1.f);
-
+        Clock_frames += delta_t.count() * stk::Stk::sampleRate();
+        const auto frames = static_cast<unsigned int>(Clock_frames);
+        Clock_frames -= frames;
+        transport.advance(frames);
     }
+    State->timeplayer_pos = static_cast<float>(transport.getPosition());
 }
 
 //******************************************************************************
@@ -301,9 +449,31 @@ void mainloop()
 
     ImGuiIO& io = ImGui::GetIO(); (void)io;
 
+    // Skip the frame if nothing has changed. The native build sleeps until the
+    // next event arrives
+    if(Idle_frames >= Frames_to_settle &&
+       !transport.isPlaying() &&
+       State->update_dirty() == Scene_state::Dirty_none)
+    {
+#ifdef __EMSCRIPTEN__
+        if(!SDL_PollEvent(nullptr))
+#else
+        if(!SDL_WaitEventTimeout(nullptr, Idle_timeout_ms))
+#endif
+        {
+            ++Skipped_frames;
+            return;
+        }
+    }
+
+    Profiler::instance().begin_frame();
+
+    bool has_events = false;
+
     SDL_Event event;
     while (SDL_PollEvent(&event))
     {
+        has_events = true;
         ImGui_ImplSDL2_ProcessEvent(&event);
         if (event.type == SDL_QUIT)
         {
@@ -341,6 +511,8 @@ void mainloop()
 
     // ImGui windows start
     {
+        PROFILE_SCOPE("UI");
+
         static float tesseract_thickness = 3.f,
                      curve_thickness = 3.f,
                      sphere_diameter = 3.f,
@@ -371,6 +543,13 @@ void mainloop()
             ImGuiWindowFlags_NoResize);
 
         ImGui::Text("%.1f FPS", io.Framerate);
+        ImGui::Text("Frames: %u rebuilt, %u reused, %u skipped",
+                    Rebuilt_frames,
+                    Reused_frames,
+                    Skipped_frames);
+        ImGui::Checkbox("Profiler", &Show_profiler);
+        ImGui::SameLine();
+        ImGui::Checkbox("GPU projection", &Gpu_projection);
 #ifdef DEBUG
         ImGui::Text((char*)glGetString(GL_VERSION));
         ImGui::Text("OpenGL error: %d", glGetError());
@@ -454,12 +633,106 @@ void mainloop()
                 ImGui::SliderFloat("Min. frequency", &State->min_freq, MIN_FREQ_RANGE, MAX_FREQ_RANGE);
                 ImGui::SliderFloat("Max. frequency", &State->max_freq, MIN_FREQ_RANGE, MAX_FREQ_RANGE);
 
+                // Output of the built-in sound and the timing of its callback
+                const char* outputs[] = {"device", "null", "file"};
+                const std::string output_name = audio.getBackend().getName();
+                int output_current = output_name == "device" ? 0 : output_name == "null" ? 1 : 2;
+                if (ImGui::Combo("Output", &output_current, outputs, IM_ARRAYSIZE(outputs))) {
+                    if (output_current == 0) {
+                        audio.setBackend(std::make_unique<DeviceAudioBackend>(&dac));
+                    } else if (output_current == 1) {
+                        audio.setBackend(std::make_unique<NullAudioBackend>());
+                    } else {
+                        audio.setBackend(std::make_unique<FileAudioBackend>("recording.wav"));
+                    }
+                    audio.initStream(&voices, &graph);
+                }
+                if (!audio.hasStream()) {
+                    ImGui::Text("The output cannot be opened");
+                }
+
+                const auto stats = audio.getBackend().getStats().getSnapshot();
+                ImGui::Text("Callback: %.0f us mean, %.0f us max", stats.meanMicros, stats.maxMicros);
+                ImGui::Text("Load: %.1f%% mean, %.1f%% max, %llu xruns",
+                            100.0 * stats.meanLoad, 100.0 * stats.maxLoad,
+                            (unsigned long long) stats.xruns);
+                float histogram[CallbackStats::NO_OF_BUCKETS];
+                for (int i = 0; i < CallbackStats::NO_OF_BUCKETS; i++) {
+                    histogram[i] = static_cast<float>(stats.buckets[i]);
+                }
+                ImGui::PlotHistogram("Duration", histogram, CallbackStats::NO_OF_BUCKETS,
+                                     0, "callbacks below 1, 2, 4 ... us", 0.f, FLT_MAX, ImVec2(0, 60));
+
+                ImGui::Text("Voices: %d sounding", voices.getNoOfSoundingVoices());
+                ImGui::SliderFloat("Reverb", &State->reverb_send, 0.f, 1.f);
+                ImGui::SliderFloat("Chorus", &State->chorus_send, 0.f, 1.f);
+
+                // Mix of the curves, each one plays on its own voice
+                ImGui::Checkbox("Sonify all curves", &State->sonify_all_curves);
+                if (State->sonify_all_curves) {
+                    for (size_t i = 0; i < State->curve_voices.size(); ++i) {
+                        auto& voice = State->curve_voices[i];
+                        ImGui::PushID(static_cast<int>(i));
+                        ImGui::Checkbox("##sonified", &voice.is_sonified);
+                        ImGui::SameLine();
+                        if (ImGui::TreeNode("voice", "Curve %d", static_cast<int>(i) + 1)) {
+                            ImGui::SliderFloat("Gain", &voice.gain, 0.f, 2.f);
+                            ImGui::SliderFloat("Pan", &voice.pan, -1.f, 1.f);
+                            ImGui::TreePop();
+                        }
+                        ImGui::PopID();
+                    }
+                }
+
                 ImGui::Separator();
                 ImGui::Text("Sonification data selection:");
                 const char* items[] = {"speed", "acceleration"};
                 static int item_current = 0;
                 ImGui::Combo("choose data", &item_current, items, IM_ARRAYSIZE(items));
                 State->active_sonification_data = static_cast<Scene_state::SonificationData>(item_current);
+
+                // A mapping file replaces the data selection
+                static char mapping_name[256] = "assets/mapping-default.txt";
+                static std::string mapping_status;
+                ImGui::InputText("Mapping file", mapping_name, sizeof(mapping_name));
+                if (ImGui::Button("Load mapping")) {
+                    MappingSpec spec;
+                    std::string error;
+                    if (loadMappingSpec(mapping_name, spec, error)) {
+                        mappingFile = std::make_shared<const MappingSpec>(std::move(spec));
+                        mapping_status = "Loaded " + std::string(mapping_name);
+                    } else {
+                        mapping_status = error;
+                    }
+                }
+                if (mappingFile) {
+                    ImGui::SameLine();
+                    if (ImGui::Button("Use data selection")) {
+                        mappingFile.reset();
+                        mapping_status.clear();
+                    }
+                }
+                if (!mapping_status.empty()) {
+                    ImGui::Text("%s", mapping_status.c_str());
+                }
+
+                // The whole curve at the player speed, faster than real time
+                static std::string export_status;
+                auto curve = State->selected_curve();
+                if (curve && Player_speed > 0.f && ImGui::Button("Export WAV")) {
+                    TickData exportData;
+                    init_instrument(exportData);
+                    exportData.updateMinMaxFrequency(State->min_freq, State->max_freq);
+                    AudioRenderer renderer;
+                    export_status = renderer.renderToFile(
+                        exportData, *curve,
+                        mappingFile ? *mappingFile : defaultMappingSpec(State->active_sonification_data),
+                        1.0 / Player_speed, "sonification.wav")
+                        ? "Written to sonification.wav" : "Cannot write sonification.wav";
+                }
+                if (!export_status.empty()) {
+                    ImGui::Text("%s", export_status.c_str());
+                }
             }
 
 
@@ -467,26 +740,30 @@ void mainloop()
         if (ImGui::CollapsingHeader("Player"))
         {
             static auto time(0.f);
-            if(!Is_player_active)
+            if(!transport.isPlaying())
             {
                 if(ImGui::Button("Start"))
                 {
-                    Is_player_active = true;
+                    transport.play();
                 }
             }
             else
             {
                 if(ImGui::Button("Stop"))
                 {
-                    Is_player_active = false;
+                    transport.pause();
                 }
 
             }
             ImGui::SameLine();
             ImGui::Checkbox("Show timepoint", &State->is_timeplayer_active);
-            if(!State->is_timeplayer_active) Is_player_active = false;
+            if(!State->is_timeplayer_active && transport.isPlaying())
+                transport.pause();
+            ImGui::SameLine();
+            ImGui::Checkbox("Loop", &Is_player_looping);
 
-            ImGui::SliderFloat("Time", &State->timeplayer_pos, 0.f, 1.f);
+            if(ImGui::SliderFloat("Time", &State->timeplayer_pos, 0.f, 1.f))
+                transport.seek(State->timeplayer_pos);
             ImGui::SliderFloat("Speed", &Player_speed, 0.f, 0.5f);
         }
 
@@ -659,6 +936,7 @@ void mainloop()
                         State->stat_max_movement,
                         State->stat_max_value);
                 }
+                State->mark_dirty(Scene_state::Dirty_curves);
             }
         }
 
@@ -730,6 +1008,11 @@ void mainloop()
         Renderer.set_line_thickness(tesseract_thickness, curve_thickness);
         Renderer.set_sphere_diameter(sphere_diameter);
         Renderer.set_fog(fog_dist, fog_range);
+        Renderer.set_gpu_projection(Gpu_projection);
+
+        Profiler::instance().set_enabled(Show_profiler);
+        if(Show_profiler)
+            Profiler::instance().draw_overlay(&Show_profiler);
     } // ImGui windows end
 
     // Rendering
@@ -765,8 +1048,8 @@ void mainloop()
                                  io.DisplayFramebufferScale.x,
                                  io.DisplayFramebufferScale.y);
 
-    Renderer.set_text_renderer(Text_ren);
-    Timeline.set_text_renderer(Text_ren);
+    Renderer.set_text_renderer(Scene_text);
+    Timeline.set_text_renderer(Timeline_text);
 
     Timeline.set_splitter(splitter);
 
@@ -801,33 +1084,49 @@ void mainloop()
     separator.init_buffers();
     Screen_shad->draw_geometry(separator);*/
 
-    // Draw other objects
-    Text_ren->clear();
+    // Draw other objects. The geometry and the texts of the previous frame are
+    // reused if the state has not changed
+    const bool rebuild = State->update_dirty() != Scene_state::Dirty_none;
+    const bool curves_changed = State->is_dirty(Scene_state::Dirty_curves);
+    if(rebuild)
+    {
+        ++Rebuilt_frames;
+    }
+    else
+    {
+        ++Reused_frames;
+    }
 
     Renderer.render();
     Timeline.render();
-    Text_ren->render(width, height);
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    SDL_GL_SwapWindow(MainWindow);
+    State->clear_dirty();
+    Scene_text->render(width, height);
+    Timeline_text->render(width, height);
+    {
+        PROFILE_SCOPE("ImGui");
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
+    {
+        PROFILE_SCOPE("Swap");
+        SDL_GL_SwapWindow(MainWindow);
+    }
+    Profiler::instance().end_frame();
+
+    Idle_frames = (has_events || rebuild) ? 0 : Idle_frames + 1;
 
     // Audio
     auto curve = State->selected_curve();
     instrumentData.updateMinMaxFrequency(State->min_freq, State->max_freq);
+    voices.updateMinMaxFrequency(State->min_freq, State->max_freq);
+    update_voices(curves_changed);
+    graph.setGain(reverbSend, State->reverb_send);
+    graph.setGain(chorusSend, State->chorus_send);
+
     if (curve) {
 
-        auto minSpeed = curve->get_stats().min_speed;
-        auto maxSpeed = curve->get_stats().max_speed;
         float time = curve->t_min() +  State->timeplayer_pos * curve->t_duration();
-
-        float value = 0;
-        if (State->active_sonification_data == Scene_state::SonificationData::SPEED) {
-            value = curve->get_interpolated_speed_at(time);
-            instrumentData.setFundamentalFrequencyFromSpeed(value, curve->get_stats().min_speed, curve->get_stats().max_speed);
-        } else if (State->active_sonification_data == Scene_state::SonificationData::ACC) {
-            value = curve->get_interpolated_acceleration_at(time);
-            instrumentData.setFundamentalFrequencyFromSpeed(value, curve->get_stats().min_acceleration, curve->get_stats().max_acceleration);
-        }
+        setFrequencyFromCurve(instrumentData, *curve, State->active_sonification_data, time);
 
         auto dimens = curve->get_dimensionality_at(time);
 
@@ -842,7 +1141,7 @@ void mainloop()
             }
         }
     }
-    if (Is_player_active && !isAudioPlaying && State->is_audio_enabled) {
+    if (transport.isPlaying() && !isAudioPlaying && State->is_audio_enabled) {
         if (State->is_oscp_active) {
             char sendBuffer[512];
             oscpController.sendStartMessage(&sendBuffer, std::size(sendBuffer));
@@ -851,7 +1150,7 @@ void mainloop()
             audio.startPlayingAudio();
         }
         isAudioPlaying = true;
-    } else if (!Is_player_active && isAudioPlaying && State->is_audio_enabled) {
+    } else if (!transport.isPlaying() && isAudioPlaying && State->is_audio_enabled) {
         if (State->is_oscp_active) {
             char sendBuffer[512];
             oscpController.sendStopMessage(&sendBuffer, std::size(sendBuffer));
@@ -1012,21 +1311,23 @@ int main(int, char**)
     State->camera_4D <<= 0., 0., 0., 550., 0.;
 
 
+    Last_timepoint = std::chrono::steady_clock::now();
 #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop(mainloop, 0, 0);
 #else
-    Last_timepoint = std::chrono::system_clock::now();
-
     stk::Stk::setRawwavePath("rawwaves");
     stk::Stk::setSampleRate( 44100.0 );
     stk::Stk::showWarnings(true);
-    instrumentData.initSines(6);
-    instrumentData.overtoneSteps.insert( instrumentData.overtoneSteps.end(), { 0, 3, 7, 12});
-    instrumentData.overToneLoudness.insert( instrumentData.overToneLoudness.end(), {0.2, 0.2, 0.2, 0.2 });
-    instrumentData.scaler = 0.4;
-    audio.initStream(&instrumentData);
-    audio.setTickData(&instrumentData);
-    instrumentData.fundamentalFrequency = 440.0;
+    init_instrument(instrumentData);
+    instrumentData.setFundamentalFrequency(440.0);
+    voices.init(No_of_voices, instrumentData);
+    init_graph();
+    // Without a sound device the player still runs on the audio clock
+    if (!audio.initStream(&voices, &graph)) {
+        printf("Audio: no sound device, the sound is not played\n");
+        audio.setBackend(std::make_unique<NullAudioBackend>());
+        audio.initStream(&voices, &graph);
+    }
 
     oscpController.start();
 
@@ -1038,7 +1339,7 @@ int main(int, char**)
 
     // Cleanup
 
-    dac.closeStream();
+    audio.closeStream();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,306 @@
+//******************************************************************************
+// audio_callback_test
+//
+// Runs the audio callbacks on a null backend that requests the buffers without
+// waiting, while another thread changes their parameters like the UI thread
+// does:
+//  - tick() of a single TickData, with the frequency, the gate and the control
+//    curve changing;
+//  - tickGraph() of the graph of the app (voices, reverb and chorus sends)
+//    with a transport, with the voices, the transport and the send gains
+//    changing.
+// Built with ThreadSanitizer, which fails the test on a data race between the
+// two threads. The test also fails if a callback does not run or renders
+// samples that are not finite.
+//
+// Usage: audio_callback_test
+//******************************************************************************
+
+// Local
+#include "src/Audio.h"
+#include "src/AudioBackend.h"
+#include "src/AudioGraph.h"
+#include "src/Transport.h"
+#include "src/VoicePool.h"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// Changes of every parameter made by the writer thread
+const int Min_changes = 2000;
+const int Num_voices = 8;
+// Buffers the callback renders while the writer thread runs
+const uint64_t Min_callbacks = 200;
+
+//******************************************************************************
+// Checked_backend
+//
+// Counts the samples that are not finite
+//******************************************************************************
+
+class Checked_backend : public NullAudioBackend
+{
+public:
+    explicit Checked_backend(unsigned int channels)
+        : NullAudioBackend(false)
+        , invalid_samples(0)
+        , channels_(channels)
+    {
+    }
+    ~Checked_backend() override
+    {
+        close();
+    }
+
+    std::atomic<uint64_t> invalid_samples;
+
+protected:
+    void write(const stk::StkFloat* samples, unsigned int nFrames) override
+    {
+        for(unsigned int i = 0; i < nFrames * channels_; ++i)
+        {
+            if(!std::isfinite(samples[i]))
+                invalid_samples.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    const unsigned int channels_;
+};
+
+//******************************************************************************
+// make_control_curve
+//
+// Pitch and loudness ramps with a dimensionality switch in the middle, 'shift'
+// makes the curves of the writer thread differ
+//******************************************************************************
+
+std::shared_ptr<const ControlCurve> make_control_curve(float shift)
+{
+    float base[ControlCurve::NO_OF_PARAMETERS];
+    for(int p = 0; p < ControlCurve::NO_OF_PARAMETERS; ++p)
+        base[p] = ControlCurve::defaultValue(p);
+    base[ControlCurve::PITCH] = 0.f;
+    base[ControlCurve::LOUDNESS] = 0.5f;
+
+    std::vector<float> positions = {0.f, 0.5f, 1.f};
+    std::vector<float> tracks = {shift, 1.f, 0.f, 0.f, 1.f - shift, 1.f};
+    std::vector<ControlCurve::Operation> operations = {
+        {0, ControlCurve::PITCH, 1.f},
+        {1, ControlCurve::LOUDNESS, 0.5f}};
+    std::vector<ControlCurve::Switch> switches = {
+        {0.5f, ResonatorBank::X | ResonatorBank::Y}};
+
+    return std::make_shared<const ControlCurve>(std::move(positions),
+                                                std::move(tracks),
+                                                std::move(operations),
+                                                base,
+                                                std::move(switches));
+}
+
+//******************************************************************************
+// init_instrument
+//******************************************************************************
+
+void init_instrument(TickData& data)
+{
+    const float steps[] = {0.f, 12.f, 19.f, 24.f};
+
+    data.initSines(4);
+    for(size_t i = 0; i < 4; ++i)
+    {
+        data.overtoneSteps.push_back(steps[i]);
+        data.overToneLoudness.push_back(1.f / (i + 1));
+    }
+}
+
+//******************************************************************************
+// run_stream
+//
+// Streams the callback while 'change(i)' is called by another thread. The
+// writer thread goes on until the callback has rendered enough buffers, so
+// the changes overlap with the rendering. Returns false if the test fails
+//******************************************************************************
+
+template<typename Change>
+bool run_stream(const char* name,
+                RtAudioCallback callback,
+                void* data,
+                unsigned int channels,
+                Change change)
+{
+    Checked_backend backend(channels);
+    if(!backend.open(static_cast<unsigned int>(stk::Stk::sampleRate()),
+                     stk::RT_BUFFER_SIZE,
+                     channels,
+                     callback,
+                     data))
+    {
+        std::fprintf(stderr, "%s: the null backend cannot be opened\n", name);
+        return false;
+    }
+
+    std::thread writer([&backend, &change]() {
+        const uint64_t start = backend.getStats().getSnapshot().callbacks;
+        for(int i = 0;
+            i < Min_changes ||
+            backend.getStats().getSnapshot().callbacks < start + Min_callbacks;
+            ++i)
+        {
+            change(i);
+            std::this_thread::yield();
+        }
+    });
+    writer.join();
+    backend.close();
+
+    const auto stats = backend.getStats().getSnapshot();
+    const uint64_t invalid_samples = backend.invalid_samples.load();
+    std::printf("%s: callbacks: %llu, invalid samples: %llu\n",
+                name,
+                static_cast<unsigned long long>(stats.callbacks),
+                static_cast<unsigned long long>(invalid_samples));
+
+    if(stats.callbacks < Min_callbacks)
+    {
+        std::fprintf(stderr, "%s: the callback did not run\n", name);
+        return false;
+    }
+    if(invalid_samples > 0)
+    {
+        std::fprintf(
+            stderr, "%s: the callback rendered invalid samples\n", name);
+        return false;
+    }
+    return true;
+}
+
+//******************************************************************************
+// run_tick
+//
+// A single TickData with its own playback, like the offline render
+//******************************************************************************
+
+bool run_tick()
+{
+    TickData data;
+    init_instrument(data);
+    data.setControlCurve(make_control_curve(0.f));
+    data.setPlaybackSpeed(2.0);
+    data.setGate(true);
+
+    return run_stream("tick", &tick, &data, 1, [&data](int i) {
+        data.setFundamentalFrequency(200.0 + (i % 600));
+        data.setGate(i % 7 != 0);
+        if(i % 3 == 0)
+            data.setControlCurve(make_control_curve((i % 10) / 10.f));
+        else if(i % 11 == 0)
+            data.setControlCurve(nullptr);
+    });
+}
+
+//******************************************************************************
+// run_graph
+//
+// The voices played by a transport through the graph of the app:
+//
+//   voices -> master, voices -> reverb -> master, voices -> chorus -> master
+//******************************************************************************
+
+bool run_graph()
+{
+    TickData instrument;
+    init_instrument(instrument);
+    VoicePool voices;
+    voices.init(Num_voices, instrument);
+
+    Transport transport;
+    transport.setSpeed(0.5);
+    transport.play();
+
+    AudioGraph graph;
+    const int voices_node =
+        graph.addNode(std::make_unique<VoicesNode>(&voices, &transport));
+    const int reverb_node = graph.addNode(std::make_unique<ReverbNode>());
+    const int chorus_node = graph.addNode(std::make_unique<ChorusNode>());
+    const int master_node = graph.addNode(std::make_unique<MixNode>());
+    graph.connect(voices_node, master_node);
+    const int reverb_send = graph.connect(voices_node, reverb_node, 0.2f);
+    graph.connect(reverb_node, master_node);
+    const int chorus_send = graph.connect(voices_node, chorus_node, 0.2f);
+    graph.connect(chorus_node, master_node);
+    graph.setTransport(&transport);
+    if(!graph.compile(master_node, stk::RT_BUFFER_SIZE))
+    {
+        std::fprintf(stderr, "graph: the graph cannot be compiled\n");
+        return false;
+    }
+
+    // The owners of the voices, some of them are released and acquired again
+    int owners[Num_voices + 2];
+    voices.setGate(true);
+
+    return run_stream(
+        "graph",
+        &tickGraph,
+        &graph,
+        AudioGraph::NO_OF_CHANNELS,
+        [&](int i) {
+            const void* owner = &owners[i % (Num_voices + 2)];
+            if(i % 13 == 0)
+            {
+                voices.release(owner);
+            }
+            else
+            {
+                bool is_new;
+                const int voice = voices.acquire(owner, is_new);
+                if(voice >= 0)
+                {
+                    voices.setMix(voice,
+                                  1.f / Num_voices,
+                                  (i % 5) / 2.f - 1.f);
+                    if(is_new || i % 3 == 0)
+                    {
+                        voices.getVoice(voice).setControlCurve(
+                            make_control_curve((i % 10) / 10.f));
+                    }
+                }
+            }
+            voices.setGate(i % 7 != 0);
+
+            if(i % 17 == 0)
+                transport.pause();
+            else if(i % 17 == 1)
+                transport.play();
+            if(i % 5 == 0)
+                transport.seek((i % 100) / 100.);
+            transport.setSpeed(0.1 + (i % 10) / 10.);
+            transport.setLoop(i % 23 != 0);
+
+            graph.setGain(reverb_send, (i % 10) / 10.f);
+            graph.setGain(chorus_send, ((i + 5) % 10) / 10.f);
+        });
+}
+
+} // namespace
+
+//******************************************************************************
+// main
+//******************************************************************************
+
+int main()
+{
+    const bool is_tick_ok = run_tick();
+    const bool is_graph_ok = run_graph();
+    return is_tick_ok && is_graph_ok ? 0 : 1;
+}
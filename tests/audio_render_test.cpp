@@ -0,0 +1,142 @@
+//******************************************************************************
+// audio_render_test
+//
+// Renders a curve offline whose loudness falls from full to silent at its end.
+// The release after the curve must keep the loudness of the end of the curve,
+// so it has to be silent as well. The test fails if the release takes the
+// parameters of another position of the curve, e.g. of its start after the
+// playback has wrapped around.
+//
+// Usage: audio_render_test
+//******************************************************************************
+
+// Local
+#include "src/Audio.h"
+#include "src/AudioRenderer.h"
+#include "src/Curve.h"
+#include "src/SonificationMapping.h"
+
+// boost
+#include <boost/numeric/ublas/assignment.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const size_t Curve_points = 200;
+// Whether the playback ends a little before or after the end of the curve
+// depends on the rounding of the duration, both cases are rendered
+const double Durations[] = {1., 2., 2.5};
+// Largest sample of the release, the curve ends silent
+const double Max_release_sample = 1e-6;
+
+//******************************************************************************
+// make_curve
+//
+// Straight line along the X-axis from 1 to 0, it has no dimensionality
+// switches that would ring the resonators
+//******************************************************************************
+
+Curve make_curve()
+{
+    Curve c;
+    for(size_t i = 0; i < Curve_points; ++i)
+    {
+        const float t = static_cast<float>(i) / (Curve_points - 1);
+
+        Scene_vertex_t v(5);
+        v <<= 1.f - t, 0.f, 0.f, 0.f, 1.f;
+        c.add_point(v, t);
+    }
+    return c;
+}
+
+//******************************************************************************
+// max_abs
+//******************************************************************************
+
+double max_abs(const std::vector<stk::StkFloat>& samples,
+               size_t first,
+               size_t last)
+{
+    double max = 0.;
+    for(size_t i = first; i < last; ++i)
+        max = std::max(max, std::abs(samples[i]));
+    return max;
+}
+
+} // namespace
+
+//******************************************************************************
+// main
+//******************************************************************************
+
+int main()
+{
+    TickData instrument;
+    instrument.initSines(4);
+    instrument.overtoneSteps = {0.f, 12.f, 19.f, 24.f};
+    instrument.overToneLoudness = {0.25f, 0.25f, 0.25f, 0.25f};
+
+    std::istringstream rules("x loudness\n");
+    MappingSpec mapping;
+    std::string error;
+    if(!parseMappingSpec(rules, mapping, error))
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    Curve curve = make_curve();
+    AudioRenderer renderer(2);
+    std::vector<stk::StkFloat> samples;
+
+    int result = 0;
+    for(const double duration : Durations)
+    {
+        renderer.render(instrument, curve, mapping, duration, samples);
+
+        // The gate closes after the blocks of the curve
+        const unsigned int block_size = stk::RT_BUFFER_SIZE;
+        const size_t curve_blocks = static_cast<size_t>(
+            std::ceil(duration * stk::Stk::sampleRate() / block_size));
+        const size_t release_start = curve_blocks * block_size;
+        if(samples.size() <= release_start)
+        {
+            std::fprintf(stderr, "%g s: the render has no release\n", duration);
+            result = 1;
+            continue;
+        }
+
+        const double curve_max = max_abs(samples, 0, release_start);
+        const double release_max =
+            max_abs(samples, release_start, samples.size());
+        std::printf("%g s: curve: %g, release: %g (%zu samples)\n",
+                    duration,
+                    curve_max,
+                    release_max,
+                    samples.size() - release_start);
+
+        if(curve_max <= Max_release_sample)
+        {
+            std::fprintf(stderr, "%g s: the curve is silent\n", duration);
+            result = 1;
+        }
+        if(release_max > Max_release_sample)
+        {
+            std::fprintf(stderr,
+                         "%g s: the release does not follow the loudness at "
+                         "the end of the curve\n",
+                         duration);
+            result = 1;
+        }
+    }
+    return result;
+}